@@ -0,0 +1,187 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of SFLib:
+ *
+ *   http://www.stevefryatt.org.uk/software/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file: arena.c
+ *
+ * Flex-based arena allocator, for short-lived memory which can be claimed
+ * by bumping a pointer and released all at once.
+ */
+
+#include <stdlib.h>
+
+/* Acorn C header files. */
+
+#include "flex.h"
+
+/* OS-Lib header files. */
+
+#include "oslib/types.h"
+
+/* SF-Lib header files. */
+
+#include "arena.h"
+
+
+#define ARENA_GRANULARITY 1024							/**< The size of standard allocations from flex.		*/
+#define ARENA_ALIGN(x) (((x) + 3) & ~3)						/**< Round a size up to a whole number of words.		*/
+
+/**
+ * An arena instance.
+ */
+
+struct arena {
+	byte			*anchor;					/**< The flex anchor for the arena's memory.			*/
+	size_t			size;						/**< The size of the flex block, in bytes.			*/
+	size_t			used;						/**< The amount of the flex block in use, in bytes.		*/
+};
+
+
+static osbool		arena_grow(struct arena *arena, size_t required);
+
+
+/* Create a new arena.
+ *
+ * This is an external interface, documented in arena.h
+ */
+
+struct arena *arena_create(size_t size)
+{
+	struct arena	*arena;
+
+	arena = malloc(sizeof(struct arena));
+	if (arena == NULL)
+		return NULL;
+
+	if (size == 0)
+		size = ARENA_GRANULARITY;
+
+	arena->anchor = NULL;
+	arena->size = ARENA_ALIGN(size);
+	arena->used = 0;
+
+	if (flex_alloc((flex_ptr) &(arena->anchor), arena->size) == 0) {
+		free(arena);
+		return NULL;
+	}
+
+	return arena;
+}
+
+
+/* Destroy an arena, freeing its flex block.
+ *
+ * This is an external interface, documented in arena.h
+ */
+
+void arena_destroy(struct arena *arena)
+{
+	if (arena == NULL)
+		return;
+
+	if (arena->anchor != NULL)
+		flex_free((flex_ptr) &(arena->anchor));
+
+	free(arena);
+}
+
+
+/* Allocate memory from an arena, growing the arena if required.
+ *
+ * This is an external interface, documented in arena.h
+ */
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	void	*block;
+
+	if (arena == NULL)
+		return NULL;
+
+	size = ARENA_ALIGN(size);
+
+	if (arena->used + size > arena->size && !arena_grow(arena, arena->used + size))
+		return NULL;
+
+	block = arena->anchor + arena->used;
+	arena->used += size;
+
+	return block;
+}
+
+
+/* Return a mark recording the current allocation position in an arena.
+ *
+ * This is an external interface, documented in arena.h
+ */
+
+size_t arena_mark(struct arena *arena)
+{
+	return (arena != NULL) ? arena->used : 0;
+}
+
+
+/* Release all of the memory allocated from an arena since a mark was taken.
+ *
+ * This is an external interface, documented in arena.h
+ */
+
+void arena_reset(struct arena *arena, size_t mark)
+{
+	if (arena == NULL || mark > arena->used)
+		return;
+
+	arena->used = mark;
+}
+
+
+/**
+ * Grow an arena's flex block, doubling its size if possible but always
+ * making it at least as large as required.
+ *
+ * \param *arena	The arena to be grown.
+ * \param required	The minimum size required, in bytes.
+ * \return		TRUE if successful; else FALSE.
+ */
+
+static osbool arena_grow(struct arena *arena, size_t required)
+{
+	size_t	size;
+
+	required = ((required + ARENA_GRANULARITY - 1) / ARENA_GRANULARITY) * ARENA_GRANULARITY;
+
+	size = arena->size * 2;
+	if (size < required)
+		size = required;
+
+	if (flex_extend((flex_ptr) &(arena->anchor), size) == 0) {
+		size = required;
+
+		if (flex_extend((flex_ptr) &(arena->anchor), size) == 0)
+			return FALSE;
+	}
+
+	arena->size = size;
+
+	return TRUE;
+}
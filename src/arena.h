@@ -0,0 +1,105 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of SFLib:
+ *
+ *   http://www.stevefryatt.org.uk/software/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file: arena.h
+ *
+ * Flex-based arena allocator, for short-lived memory which can be claimed
+ * by bumping a pointer and released all at once.
+ *
+ * Each arena lives in its own flex block, so flex must have been initialised
+ * via flex_init() before any arenas are created. Growing an arena extends its
+ * flex block without moving it, but like any flex block the arena can still
+ * be moved by flex when blocks below it in memory change size: pointers
+ * returned by arena_alloc() should therefore not be held across operations
+ * which might allocate, extend or free other flex blocks.
+ */
+
+#ifndef SFLIB_ARENA
+#define SFLIB_ARENA
+
+#include <stddef.h>
+
+/**
+ * An arena instance.
+ */
+
+struct arena;
+
+
+/**
+ * Create a new arena.
+ *
+ * \param size		The initial size of the arena, in bytes, or zero
+ *			to use a default.
+ * \return		Pointer to the new arena, or NULL on failure.
+ */
+
+struct arena *arena_create(size_t size);
+
+
+/**
+ * Destroy an arena, freeing its flex block. All of the memory allocated
+ * from the arena becomes invalid.
+ *
+ * \param *arena	The arena to be destroyed.
+ */
+
+void arena_destroy(struct arena *arena);
+
+
+/**
+ * Allocate memory from an arena, growing the arena if required. The memory
+ * is word-aligned.
+ *
+ * \param *arena	The arena to allocate from.
+ * \param size		The amount of memory to claim, in bytes.
+ * \return		Pointer to the claimed memory, or NULL on failure.
+ */
+
+void *arena_alloc(struct arena *arena, size_t size);
+
+
+/**
+ * Return a mark recording the current allocation position in an arena,
+ * which can later be passed to arena_reset().
+ *
+ * \param *arena	The arena of interest.
+ * \return		The current allocation mark.
+ */
+
+size_t arena_mark(struct arena *arena);
+
+
+/**
+ * Release all of the memory allocated from an arena since a mark was taken
+ * with arena_mark(). The arena's flex block is kept at its current size,
+ * ready for re-use.
+ *
+ * \param *arena	The arena to be reset.
+ * \param mark		The mark to return to, or 0 to release everything.
+ */
+
+void arena_reset(struct arena *arena, size_t mark);
+
+#endif
@@ -49,6 +49,7 @@
 /* SF-Lib header files. */
 
 #include "config.h"
+#include "hash.h"
 #include "string.h"
 
 #ifdef __CC_NORCROFT
@@ -56,13 +57,40 @@
 #endif
 
 #define CONFIG_BOOL_LEN 64
+#define CONFIG_SAVE_BUFFER 4096							/**< The size of the output buffer used when saving.		*/
+#define CONFIG_SAVE_TEMP_LEAF "ChoicesNew"					/**< The leafname used to write new Choices before replacement.	*/
+#define CONFIG_SAVE_BACKUP_LEAF "ChoicesOld"					/**< The leafname used to hold old Choices during replacement.	*/
+
+/**
+ * The types of config value which can be held in the registry.
+ */
+
+enum config_type {
+	CONFIG_TYPE_OPT,							/**< A boolean config value.					*/
+	CONFIG_TYPE_INT,							/**< An integer config value.					*/
+	CONFIG_TYPE_STR								/**< A textual config value.					*/
+};
+
+/**
+ * Structure for the details common to all config settings, which is used to
+ * link them into the registry.
+ */
+
+struct config_entry {
+	char			*name;						/**< The name of the config value, in the string pool.		*/
+	enum config_type	type;						/**< The type of the config value.				*/
+	unsigned int		key;						/**< The hash key of the config value's name.			*/
+	osbool			dirty;						/**< TRUE if the value has changed since the last save.		*/
+
+	struct config_entry	*chain;						/**< The next config value with the same hash key, or NULL.	*/
+};
 
 /**
  * Structure for storing boolean config settings.
  */
 
 typedef struct config_opt {
-	char			name[sf_MAX_CONFIG_NAME];			/**< The name of the config value.				*/
+	struct config_entry	entry;						/**< The registry details; must be first in the structure.	*/
 	osbool			value;						/**< The current value.						*/
 	osbool			initial;					/**< The initial, or default, value.				*/
 
@@ -74,7 +102,7 @@ typedef struct config_opt {
  */
 
 typedef struct config_int {
-	char			name[sf_MAX_CONFIG_NAME];			/**< The name of the config value.				*/
+	struct config_entry	entry;						/**< The registry details; must be first in the structure.	*/
 	int			value;						/**< The current value.						*/
 	int			initial;					/**< The initial, or default, value.				*/
 
@@ -87,25 +115,60 @@ typedef struct config_int {
  */
 
 typedef struct config_str {
-	char			name[sf_MAX_CONFIG_NAME];			/**< The name of the config value.				*/
-	char			value[sf_MAX_CONFIG_STR];			/**< The current value.						*/
-	char			initial[sf_MAX_CONFIG_STR];			/**< The initial, or default, value.				*/
+	struct config_entry	entry;						/**< The registry details; must be first in the structure.	*/
+	char			*value;						/**< The current value; the same as initial if unchanged.	*/
+	char			*initial;					/**< The initial, or default, value, in the string pool.	*/
 
 	struct config_str	*next;						/**< Pointer to the next text config value, or NULL.		*/
 } config_str;
 
 
+/**
+ * Structure for storing a string in the string pool, where identical names
+ * and default values share storage. Pooled strings are never freed.
+ */
+
+struct config_string {
+	struct config_string	*chain;						/**< The next pooled string with the same hash key, or NULL.	*/
+	char			text[1];					/**< The string itself, extending beyond the structure.		*/
+};
+
+/**
+ * Structure for holding a Choices file which has been loaded into memory
+ * in its entirety for parsing.
+ */
+
+struct config_file {
+	char			*data;						/**< The contents of the file, tokenised in place.		*/
+	char			*position;					/**< The start of the next line to be parsed.			*/
+	char			*end;						/**< The terminator following the end of the data.		*/
+};
+
+
 /* Global variables. */
 
 static config_opt		*opt_list = NULL;				/**< The chain of boolean config values.			*/
 static config_int		*int_list = NULL;				/**< The chain of integer config values.			*/
 static config_str		*str_list = NULL;				/**< The chain of textual config values.			*/
+static struct hash_table	*config_registry = NULL;			/**< The index of config values of all types, by name.		*/
+static unsigned int		config_dirty_count = 0;				/**< The number of values changed since the last save.		*/
+static struct hash_table	*config_strings = NULL;				/**< The pool of shared names and default values.		*/
 
 static char			*choices_dir = NULL;				/**< The name of the application's folder in Choices:.		*/
 static char			*local_dir = NULL;				/**< The full path to the application's own folder.		*/
 static char			*application_name = NULL;			/**< The application name as registered with the Wimp.		*/
 
 
+static struct config_entry	*config_find_entry(char *name);
+static char			*config_file_next_line(struct config_file *file);
+static void			config_set_dirty(struct config_entry *entry);
+static void			config_clear_dirty(void);
+static osbool			config_str_assign(config_str *option, char *value);
+static char			*config_intern_string(char *string);
+static osbool			config_register_entry(struct config_entry *entry, char *name, enum config_type type);
+static void			config_build_save_file(char *file, size_t len, char *leaf, osbool create);
+static void			config_recover_save_file(void);
+
 
 /**
  * Initialise the config module for the given application.
@@ -143,13 +206,13 @@ osbool config_initialise(char *app_name, char *c_dir, char *l_dir)
 
 static config_opt *config_find_opt(char *name)
 {
-	config_opt	*block = opt_list;
+	struct config_entry	*entry;
 
+	entry = config_find_entry(name);
+	if (entry == NULL || entry->type != CONFIG_TYPE_OPT)
+		return NULL;
 
-	while (block != NULL && (strcmp(block->name, name) != 0))
-		block = block->next;
-
-	return block;
+	return (config_opt *) entry;
 }
 
 
@@ -169,7 +232,11 @@ int config_opt_init(char *name, osbool value)
 	if (new == NULL)
 		return FALSE;
 
-	string_copy(new->name, name, sf_MAX_CONFIG_NAME);
+	if (!config_register_entry(&(new->entry), name, CONFIG_TYPE_OPT)) {
+		free(new);
+		return FALSE;
+	}
+
 	new->initial = value;
 	new->value = value;
 
@@ -196,7 +263,10 @@ osbool config_opt_set(char *name, osbool value)
 	if (option == NULL)
 		return FALSE;
 
-	option->value = value;
+	if (option->value != value) {
+		option->value = value;
+		config_set_dirty(&(option->entry));
+	}
 
 	return TRUE;
 }
@@ -221,6 +291,24 @@ osbool config_opt_read(char *name)
 }
 
 
+/**
+ * Return a handle on a boolean config value, for fast repeated reading.
+ *
+ * This is an external interface, documented in config.h
+ */
+
+const osbool *config_opt_handle(char *name)
+{
+	config_opt	*option;
+
+	option = config_find_opt(name);
+	if (option == NULL)
+		return NULL;
+
+	return &(option->value);
+}
+
+
 /**
  * Find an int-config block based on its name.
  *
@@ -230,12 +318,13 @@ osbool config_opt_read(char *name)
 
 static config_int *config_find_int(char *name)
 {
-	config_int	*block = int_list;
+	struct config_entry	*entry;
 
-	while (block != NULL && (strcmp(block->name, name) != 0))
-		block = block->next;
+	entry = config_find_entry(name);
+	if (entry == NULL || entry->type != CONFIG_TYPE_INT)
+		return NULL;
 
-	return block;
+	return (config_int *) entry;
 }
 
 
@@ -255,7 +344,11 @@ osbool config_int_init(char *name, int value)
 	if (new == NULL)
 		return FALSE;
 
-	string_copy(new->name, name, sf_MAX_CONFIG_NAME);
+	if (!config_register_entry(&(new->entry), name, CONFIG_TYPE_INT)) {
+		free(new);
+		return FALSE;
+	}
+
 	new->initial = value;
 	new->value = value;
 
@@ -282,7 +375,10 @@ osbool config_int_set(char *name, int value)
 	if (option == NULL)
 		return FALSE;
 
-	option->value = value;
+	if (option->value != value) {
+		option->value = value;
+		config_set_dirty(&(option->entry));
+	}
 
 	return TRUE;
 }
@@ -307,6 +403,24 @@ int config_int_read(char *name)
 }
 
 
+/**
+ * Return a handle on an integer config value, for fast repeated reading.
+ *
+ * This is an external interface, documented in config.h
+ */
+
+const int *config_int_handle(char *name)
+{
+	config_int	*option;
+
+	option = config_find_int(name);
+	if (option == NULL)
+		return NULL;
+
+	return &(option->value);
+}
+
+
 /**
  * Find an str-config block based on its name.
  *
@@ -316,12 +430,13 @@ int config_int_read(char *name)
 
 static config_str *config_find_str(char *name)
 {
-	config_str	*block = str_list;
+	struct config_entry	*entry;
 
-	while (block != NULL && (strcmp(block->name, name) != 0))
-		block = block->next;
+	entry = config_find_entry(name);
+	if (entry == NULL || entry->type != CONFIG_TYPE_STR)
+		return NULL;
 
-	return block;
+	return (config_str *) entry;
 }
 
 
@@ -341,9 +456,14 @@ osbool config_str_init(char *name, char *value)
 	if (new == NULL)
 		return FALSE;
 
-	string_copy(new->name, name, sf_MAX_CONFIG_NAME);
-	string_copy(new->initial, value, sf_MAX_CONFIG_STR);
-	string_copy(new->value, value, sf_MAX_CONFIG_STR);
+	new->initial = config_intern_string(value);
+
+	if (new->initial == NULL || !config_register_entry(&(new->entry), name, CONFIG_TYPE_STR)) {
+		free(new);
+		return FALSE;
+	}
+
+	new->value = new->initial;
 
 	new->next = str_list;
 	str_list = new;
@@ -368,7 +488,15 @@ osbool config_str_set(char *name, char *value)
 	if (option == NULL)
 		return FALSE;
 
-	string_copy(option->value, value, sf_MAX_CONFIG_STR);
+	if (value == NULL)
+		value = "";
+
+	if (strcmp(option->value, value) != 0) {
+		if (!config_str_assign(option, value))
+			return FALSE;
+
+		config_set_dirty(&(option->entry));
+	}
 
 	return TRUE;
 }
@@ -393,6 +521,25 @@ char *config_str_read(char *name)
 }
 
 
+/**
+ * Return a handle on a string config value, which can be dereferenced to
+ * find the current value without having to look it up by name.
+ *
+ * This is an external interface, documented in config.h
+ */
+
+char * const *config_str_handle(char *name)
+{
+	config_str	*option;
+
+	option = config_find_str(name);
+	if (option == NULL)
+		return NULL;
+
+	return &(option->value);
+}
+
+
 /**
  * Get a filename for the file to load the choices settings from.  The global
  * Choices: paths are tried first; fall back to the application folder.
@@ -424,6 +571,23 @@ void config_find_load_file(char *file, size_t len, char *leaf)
  */
 
 void config_find_save_file(char *file, size_t len, char *leaf)
+{
+	config_build_save_file(file, len, leaf, TRUE);
+}
+
+
+/**
+ * Build a filename for the file to save the choices settings to, in the
+ * same way as config_find_save_file(), optionally creating the application's
+ * folder in <Choices$Write> if it doesn't already exist.
+ *
+ * \param *file			A buffer to hold a full pathname.
+ * \param len			The size of the buffer.
+ * \param *leaf			The leaf file name to use.
+ * \param create		TRUE to create the Choices folder if required.
+ */
+
+static void config_build_save_file(char *file, size_t len, char *leaf, osbool create)
 {
 	int		var_len;
 
@@ -434,15 +598,44 @@ void config_find_save_file(char *file, size_t len, char *leaf)
 	if (var_len == 0) {
 		string_printf(file, len, "%s.%s", local_dir, leaf);
 	} else {
-		string_printf(file, len, "<Choices$Write>.%s", choices_dir);
-		if (osfile_read_no_path(file, NULL, NULL, NULL, NULL) == fileswitch_NOT_FOUND)
-			osfile_create_dir(file, 0);
+		if (create) {
+			string_printf(file, len, "<Choices$Write>.%s", choices_dir);
+			if (osfile_read_no_path(file, NULL, NULL, NULL, NULL) == fileswitch_NOT_FOUND)
+				osfile_create_dir(file, 0);
+		}
 
 		string_printf(file, len, "<Choices$Write>.%s.%s", choices_dir, leaf);
 	}
 }
 
 
+/**
+ * Recover the Choices file after an interrupted save, if it is missing but
+ * the new or backup copy written by config_save() is present. The new copy
+ * is preferred, as it is only renamed into place once complete.
+ */
+
+static void config_recover_save_file(void)
+{
+	char	file[1024], copy[1024];
+
+	config_build_save_file(file, sizeof(file), "Choices", FALSE);
+
+	if (*file == '\0' || osfile_read_no_path(file, NULL, NULL, NULL, NULL) == fileswitch_IS_FILE)
+		return;
+
+	config_build_save_file(copy, sizeof(copy), CONFIG_SAVE_TEMP_LEAF, FALSE);
+
+	if (*copy != '\0' && osfile_read_no_path(copy, NULL, NULL, NULL, NULL) == fileswitch_IS_FILE && rename(copy, file) == 0)
+		return;
+
+	config_build_save_file(copy, sizeof(copy), CONFIG_SAVE_BACKUP_LEAF, FALSE);
+
+	if (*copy != '\0' && osfile_read_no_path(copy, NULL, NULL, NULL, NULL) == fileswitch_IS_FILE)
+		rename(copy, file);
+}
+
+
 /**
  * Load the currently saved configuration into memory, overriding any settings
  * currently stored in memory.
@@ -452,9 +645,16 @@ void config_find_save_file(char *file, size_t len, char *leaf)
 
 osbool config_load(void)
 {
-	char		file[sf_MAX_CONFIG_FILE_BUFFER], token[sf_MAX_CONFIG_FILE_BUFFER], contents[sf_MAX_CONFIG_FILE_BUFFER];
-	FILE		*in;
+	char			file[sf_MAX_CONFIG_FILE_BUFFER], *token, *contents;
+	struct config_file	*in;
+	struct config_entry	*entry;
+
 
+	/* If a save was interrupted while the files were being swapped over,
+	 * put whichever copy survived back in place.
+	 */
+
+	config_recover_save_file();
 
 	/* Find the options.  First try the Choices: file then the one in the application. */
 
@@ -465,23 +665,32 @@ osbool config_load(void)
 
 	/* If a config file was found, use it. */
 
-	in = fopen(file, "r");
+	in = config_file_open(file);
 
 	if (in == NULL)
 		return FALSE;
 
-	while (config_read_token_pair(in, token, contents, NULL) != sf_CONFIG_READ_EOF) {
+	while (config_file_read_token_pair(in, &token, &contents, NULL) != sf_CONFIG_READ_EOF) {
 		/* If the token can be matched to a current setting, save it. */
 
-		if (config_find_opt(token) != NULL)
-			config_opt_set(token, config_read_opt_string(contents));
-		else if (config_find_int(token) != NULL)
-			config_int_set(token, atoi (contents));
-		else if (config_find_str(token) != NULL)
-			config_str_set(token, contents);
+		entry = config_find_entry(token);
+		if (entry == NULL)
+			continue;
+
+		switch (entry->type) {
+		case CONFIG_TYPE_OPT:
+			((config_opt *) entry)->value = config_read_opt_string(contents);
+			break;
+		case CONFIG_TYPE_INT:
+			((config_int *) entry)->value = atoi(contents);
+			break;
+		case CONFIG_TYPE_STR:
+			config_str_assign((config_str *) entry, contents);
+			break;
+		}
 	}
 
-	fclose(in);
+	config_file_close(in);
 
 	return TRUE;
 }
@@ -489,18 +698,23 @@ osbool config_load(void)
 
 /**
  * Save the current configuration from memory into the applicable Choices
- * file, recording only those values which differ from the defaults.
+ * file, recording only those values which differ from the defaults. The
+ * new file is written under a temporary name, and the old file is renamed
+ * to a backup while the new one is moved into place, so that the existing
+ * choices are not lost if the save fails. If the files can't be swapped
+ * over, the new file is kept and will be recovered by config_load().
  *
  * \return		TRUE if successful; else FALSE.
  */
 
 osbool config_save(void)
 {
-	char		file[1024];
+	char		file[1024], temp[1024], backup[1024];
 	FILE		*out;
 	config_opt	*opt_block;
 	config_int	*int_block;
 	config_str	*str_block;
+	osbool		failed = FALSE;
 
 
 	config_find_save_file(file, sizeof(file), "Choices");
@@ -508,11 +722,22 @@ osbool config_save(void)
 	if (file == NULL || *file == '\0')
 		return FALSE;
 
-	out = fopen(file, "w");
+	/* Write the new choices to a temporary file alongside the old ones,
+	 * so that the existing file survives if anything goes wrong.
+	 */
+
+	config_find_save_file(temp, sizeof(temp), CONFIG_SAVE_TEMP_LEAF);
+
+	if (*temp == '\0')
+		return FALSE;
+
+	out = fopen(temp, "w");
 
 	if (out == NULL)
 		return FALSE;
 
+	setvbuf(out, NULL, _IOFBF, CONFIG_SAVE_BUFFER);
+
 	fprintf(out, "# >Choices for %s\n\n", application_name);
 
 	/* Do the opt configs */
@@ -521,7 +746,7 @@ osbool config_save(void)
 
 	while (opt_block != NULL) {
 		if (opt_block->value != opt_block->initial)
-			fprintf(out, "%s: %s\n", opt_block->name, config_return_opt_string(opt_block->value));
+			fprintf(out, "%s: %s\n", opt_block->entry.name, config_return_opt_string(opt_block->value));
 
 		opt_block = opt_block->next;
 	}
@@ -532,7 +757,7 @@ osbool config_save(void)
 
 	while (int_block != NULL) {
 		if (int_block->value != int_block->initial)
-			fprintf(out, "%s: %d\n", int_block->name, int_block->value);
+			fprintf(out, "%s: %d\n", int_block->entry.name, int_block->value);
 
 		int_block = int_block->next;
 	}
@@ -542,18 +767,69 @@ osbool config_save(void)
 	str_block = str_list;
 
 	while (str_block != NULL) {
-		if (strcmp(str_block->value, str_block->initial) != 0)
-			fprintf(out, "%s: \"%s\"\n", str_block->name, str_block->value);
+		if (str_block->value != str_block->initial)
+			fprintf(out, "%s: \"%s\"\n", str_block->entry.name, str_block->value);
 
 		str_block = str_block->next;
 	}
 
-	fclose(out);
+	if (ferror(out))
+		failed = TRUE;
+
+	if (fclose(out) != 0)
+		failed = TRUE;
+
+	/* Replace the old file with the new one. */
+
+	if (failed) {
+		remove(temp);
+		return FALSE;
+	}
+
+	/* Move the old file out of the way, so that it can be restored if the
+	 * new one can't be renamed into place. If either step fails, the new
+	 * file is left for config_load() to recover.
+	 */
+
+	config_find_save_file(backup, sizeof(backup), CONFIG_SAVE_BACKUP_LEAF);
+
+	if (*backup == '\0')
+		return FALSE;
+
+	remove(backup);
+
+	if (osfile_read_no_path(file, NULL, NULL, NULL, NULL) == fileswitch_IS_FILE && rename(file, backup) != 0)
+		return FALSE;
+
+	if (rename(temp, file) != 0) {
+		rename(backup, file);
+		return FALSE;
+	}
+
+	remove(backup);
+
+	config_clear_dirty();
 
 	return TRUE;
 }
 
 
+/**
+ * Save the current configuration to the applicable Choices file, but only
+ * if any values have been changed since it was last saved.
+ *
+ * This is an external interface, documented in config.h
+ */
+
+osbool config_save_if_changed(void)
+{
+	if (config_dirty_count == 0)
+		return TRUE;
+
+	return config_save();
+}
+
+
 /**
  * Restore the default configuration settings.
  *
@@ -568,6 +844,66 @@ osbool config_restore_default(void)
 }
 
 
+/**
+ * Find a config value of any type in the registry, based on its name.
+ *
+ * \param *name		The name of the value to find.
+ * \return		Pointer to the value's registry details, or NULL.
+ */
+
+static struct config_entry *config_find_entry(char *name)
+{
+	struct config_entry	*entry;
+	unsigned int		key;
+
+	if (name == NULL)
+		return NULL;
+
+	key = hash_string(name);
+
+	entry = hash_find(config_registry, key);
+
+	while (entry != NULL && strcmp(entry->name, name) != 0)
+		entry = entry->chain;
+
+	return entry;
+}
+
+
+/**
+ * Add a new config value to the registry. Any existing value with the
+ * same name is hidden by the new one.
+ *
+ * \param *entry	The registry details of the new value.
+ * \param *name		The name of the value.
+ * \param type		The type of the value.
+ * \return		TRUE if successful; else FALSE.
+ */
+
+static osbool config_register_entry(struct config_entry *entry, char *name, enum config_type type)
+{
+	if (config_registry == NULL) {
+		config_registry = hash_create(0);
+		if (config_registry == NULL)
+			return FALSE;
+	}
+
+	entry->name = config_intern_string(name);
+	if (entry->name == NULL)
+		return FALSE;
+
+	entry->type = type;
+	entry->key = hash_string(entry->name);
+	entry->dirty = FALSE;
+
+	/* Values whose names share a hash key are chained from the table. */
+
+	entry->chain = hash_find(config_registry, entry->key);
+
+	return hash_add(config_registry, entry->key, entry);
+}
+
+
 /**
  * Process lines from a file, until a valid token/value pair is found or EOF is
  * reached.  Return values for the token and value in *token and *value; if a new
@@ -601,7 +937,7 @@ enum config_read_status config_read_token_pair(FILE *file, char *token, char *va
 		if (*line != '#') {
 			stripped_line = string_strip_surrounding_whitespace(line);
 
-			if (string_wildcard_compare("[*]", stripped_line, 1)) {
+			if (*stripped_line == '[' && *(strchr(stripped_line, '\0') - 1) == ']') {
 				*strrchr(stripped_line, ']') = '\0';
 				if (section != NULL)
 					string_copy(section, stripped_line + 1, sf_MAX_CONFIG_FILE_BUFFER);
@@ -649,6 +985,276 @@ enum config_read_status config_read_token_pair(FILE *file, char *token, char *va
 }
 
 
+/**
+ * Change the value of a string config value. Values matching the default
+ * share its storage, while any others are given their own heap block.
+ *
+ * \param *option	The config value to update.
+ * \param *value	The new value to assign.
+ * \return		TRUE if successful; else FALSE.
+ */
+
+static osbool config_str_assign(config_str *option, char *value)
+{
+	char	*copy;
+
+	if (strcmp(option->initial, value) == 0) {
+		copy = option->initial;
+	} else {
+		copy = strdup(value);
+		if (copy == NULL)
+			return FALSE;
+	}
+
+	if (option->value != option->initial)
+		free(option->value);
+
+	option->value = copy;
+
+	return TRUE;
+}
+
+
+/**
+ * Find a string in the string pool, adding it if it isn't already there.
+ *
+ * \param *string	The string to find.
+ * \return		Pointer to the pooled copy of the string, or NULL
+ *			on failure.
+ */
+
+static char *config_intern_string(char *string)
+{
+	struct config_string	*pooled, *first;
+	unsigned int		key;
+
+	if (string == NULL)
+		string = "";
+
+	if (config_strings == NULL) {
+		config_strings = hash_create(0);
+		if (config_strings == NULL)
+			return NULL;
+	}
+
+	key = hash_string(string);
+
+	first = hash_find(config_strings, key);
+
+	for (pooled = first; pooled != NULL; pooled = pooled->chain) {
+		if (strcmp(pooled->text, string) == 0)
+			return pooled->text;
+	}
+
+	pooled = malloc(sizeof(struct config_string) + strlen(string));
+	if (pooled == NULL)
+		return NULL;
+
+	strcpy(pooled->text, string);
+	pooled->chain = first;
+
+	if (!hash_add(config_strings, key, pooled)) {
+		free(pooled);
+		return NULL;
+	}
+
+	return pooled->text;
+}
+
+
+/**
+ * Mark a config value as having changed since the last save.
+ *
+ * \param *entry	The registry details of the value.
+ */
+
+static void config_set_dirty(struct config_entry *entry)
+{
+	if (entry->dirty)
+		return;
+
+	entry->dirty = TRUE;
+	config_dirty_count++;
+}
+
+
+/**
+ * Mark all of the config values as being unchanged since the last save.
+ */
+
+static void config_clear_dirty(void)
+{
+	config_opt	*opt_block;
+	config_int	*int_block;
+	config_str	*str_block;
+
+	for (opt_block = opt_list; opt_block != NULL; opt_block = opt_block->next)
+		opt_block->entry.dirty = FALSE;
+
+	for (int_block = int_list; int_block != NULL; int_block = int_block->next)
+		int_block->entry.dirty = FALSE;
+
+	for (str_block = str_list; str_block != NULL; str_block = str_block->next)
+		str_block->entry.dirty = FALSE;
+
+	config_dirty_count = 0;
+}
+
+
+/**
+ * Load a Choices file into memory in its entirety, ready to be parsed
+ * with config_file_read_token_pair().
+ *
+ * This is an external interface, documented in config.h
+ */
+
+struct config_file *config_file_open(char *filename)
+{
+	struct config_file	*file;
+	fileswitch_object_type	type;
+	int			size;
+
+	if (filename == NULL || *filename == '\0')
+		return NULL;
+
+	if (xosfile_read_stamped_no_path(filename, &type, NULL, NULL, &size, NULL, NULL) != NULL || type != fileswitch_IS_FILE)
+		return NULL;
+
+	file = malloc(sizeof(struct config_file));
+	if (file == NULL)
+		return NULL;
+
+	file->data = malloc(size + 1);
+	if (file->data == NULL) {
+		free(file);
+		return NULL;
+	}
+
+	if (xosfile_load_stamped_no_path(filename, (byte *) file->data, NULL, NULL, NULL, NULL, NULL) != NULL) {
+		free(file->data);
+		free(file);
+		return NULL;
+	}
+
+	file->data[size] = '\0';
+	file->position = file->data;
+	file->end = file->data + size;
+
+	return file;
+}
+
+
+/**
+ * Parse lines from a Choices file held in memory, until a valid token/value
+ * pair is found or the end of the file is reached.
+ *
+ * This is an external interface, documented in config.h
+ */
+
+enum config_read_status config_file_read_token_pair(struct config_file *file, char **token, char **value, char **section)
+{
+	char				*line, *end, *separator;
+	enum config_read_status		result = sf_CONFIG_READ_VALUE_RETURNED;
+
+	if (file == NULL)
+		return sf_CONFIG_READ_EOF;
+
+	while ((line = config_file_next_line(file)) != NULL) {
+		if (*line == '#')
+			continue;
+
+		while (isspace(*line))
+			line++;
+
+		end = strchr(line, '\0');
+		while (end > line && isspace(*(end - 1)))
+			end--;
+		*end = '\0';
+
+		/* A line in square brackets starts a new section. */
+
+		if (*line == '[' && end - line >= 2 && *(end - 1) == ']') {
+			*(end - 1) = '\0';
+			if (section != NULL)
+				*section = line + 1;
+			result = sf_CONFIG_READ_NEW_SECTION;
+			continue;
+		}
+
+		/* Any other line is a token/value pair if it contains a colon. */
+
+		separator = strchr(line, ':');
+		if (separator == NULL)
+			continue;
+
+		*separator++ = '\0';
+
+		while (isspace(*separator))
+			separator++;
+
+		/* Remove enclosing quotes from the value, if present. */
+
+		if (*separator == '"' && end - separator >= 2 && *(end - 1) == '"') {
+			separator++;
+			*(end - 1) = '\0';
+		}
+
+		if (token != NULL)
+			*token = line;
+
+		if (value != NULL)
+			*value = separator;
+
+		return result;
+	}
+
+	return sf_CONFIG_READ_EOF;
+}
+
+
+/**
+ * Close a Choices file which was loaded by config_file_open(), freeing
+ * the memory that it used.
+ *
+ * This is an external interface, documented in config.h
+ */
+
+void config_file_close(struct config_file *file)
+{
+	if (file == NULL)
+		return;
+
+	free(file->data);
+	free(file);
+}
+
+
+/**
+ * Terminate the next line of a Choices file held in memory in place, and
+ * return a pointer to it.
+ *
+ * \param *file		The file to take the line from.
+ * \return		Pointer to the line, or NULL at the end of the file.
+ */
+
+static char *config_file_next_line(struct config_file *file)
+{
+	char	*line, *end;
+
+	if (file->position >= file->end)
+		return NULL;
+
+	line = file->position;
+
+	for (end = line; end < file->end && *end != '\n' && *end != '\r' && *end != '\0'; end++);
+
+	*end = '\0';
+	file->position = end + 1;
+
+	return line;
+}
+
+
 /**
  * Write a token/value pair to file, enclosing parameters that contain
  * leading or trailing whitespace in quotes.
@@ -39,8 +39,8 @@
 
 /* ================================================================================================================== */
 
-#define sf_MAX_CONFIG_NAME 32							/**< The maximum length of a config value name.		*/
-#define sf_MAX_CONFIG_STR  1024							/**< The maximum length of a textual config value.	*/
+#define sf_MAX_CONFIG_NAME 32							/**< A suggested maximum length for a config value name.	*/
+#define sf_MAX_CONFIG_STR  1024							/**< A suggested maximum length for a textual config value.	*/
 #define sf_MAX_CONFIG_FILE_BUFFER 1024						/**< The maximum size of a file load buffer.		*/
 
 enum config_read_status {
@@ -73,7 +73,11 @@ osbool config_load(void);
 
 /**
  * Save the current configuration from memory into the applicable Choices
- * file, recording only those values which differ from the defaults.
+ * file, recording only those values which differ from the defaults. The
+ * new file is written under a temporary name, and the old file is renamed
+ * to a backup while the new one is moved into place, so that the existing
+ * choices are not lost if the save fails. If the files can't be swapped
+ * over, the new file is kept and will be recovered by config_load().
  *
  * \return		TRUE if successful; else FALSE.
  */
@@ -81,6 +85,18 @@ osbool config_load(void);
 osbool config_save(void);
 
 
+/**
+ * Save the current configuration from memory into the applicable Choices
+ * file if any values have been changed with config_opt_set(),
+ * config_int_set() or config_str_set() since it was last saved; otherwise
+ * do nothing.
+ *
+ * \return		TRUE if successful or no save was required; else FALSE.
+ */
+
+osbool config_save_if_changed(void);
+
+
 /**
  * Restore the default configuration settings.
  *
@@ -124,6 +140,18 @@ osbool config_opt_set(char *name, osbool value);
 osbool config_opt_read(char *name);
 
 
+/**
+ * Return a handle on a boolean config value, which can be dereferenced to
+ * read the current value without having to look it up by name. The handle
+ * remains valid for the life of the application.
+ *
+ * \param *name		The name of the config value.
+ * \return		Pointer to the value, or NULL if not found.
+ */
+
+const osbool *config_opt_handle(char *name);
+
+
 /**
  * Create and initialise an integer config value.
  *
@@ -156,6 +184,18 @@ osbool config_int_set(char *name, int value);
 int config_int_read(char *name);
 
 
+/**
+ * Return a handle on an integer config value, which can be dereferenced to
+ * read the current value without having to look it up by name. The handle
+ * remains valid for the life of the application.
+ *
+ * \param *name		The name of the config value.
+ * \return		Pointer to the value, or NULL if not found.
+ */
+
+const int *config_int_handle(char *name);
+
+
 /**
  * Create and initialise a string config value.
  *
@@ -182,12 +222,26 @@ osbool config_str_set(char *name, char *value);
  * Read a string config value.
  *
  * \param *name		The name of the config value to read.
- * \return		Pointer to the value, or to "" if not found.
+ * \return		Pointer to the value, or to "" if not found; the
+ *			value is shared and must not be modified.
  */
 
 char *config_str_read(char *name);
 
 
+/**
+ * Return a handle on a string config value, which can be dereferenced to
+ * find a pointer to the current value without having to look it up by name.
+ * The handle remains valid for the life of the application, but the value
+ * that it points to will change if the config value is updated.
+ *
+ * \param *name		The name of the config value.
+ * \return		Pointer to the value pointer, or NULL if not found.
+ */
+
+char * const *config_str_handle(char *name);
+
+
 /**
  * Process lines from a file, until a valid token/value pair is found or EOF is
  * reached.  Return values for the token and value in *token and *value; if a new
@@ -203,6 +257,53 @@ char *config_str_read(char *name);
 enum config_read_status config_read_token_pair(FILE *file, char *token, char *value, char *section);
 
 
+/**
+ * A Choices file which has been loaded into memory for parsing.
+ */
+
+struct config_file;
+
+
+/**
+ * Load a Choices file into memory in its entirety, using a single OS_File
+ * call, ready to be parsed with config_file_read_token_pair().
+ *
+ * \param *filename	The name of the file to load.
+ * \return		Pointer to the loaded file, or NULL on failure.
+ */
+
+struct config_file *config_file_open(char *filename);
+
+
+/**
+ * Parse lines from a Choices file held in memory, until a valid token/value
+ * pair is found or the end of the file is reached. The file is tokenised in
+ * place, and pointers to the token, value and section names are returned
+ * without being copied: they remain valid until the file is closed.
+ *
+ * New sections are returned with the first token in the section; sections
+ * which contain no tokens are skipped.
+ *
+ * \param *file		The file to read from.
+ * \param **token	Pointer to variable to take a pointer to the token name.
+ * \param **value	Pointer to variable to take a pointer to the token value.
+ * \param **section	Pointer to variable to take a pointer to the section name.
+ * \return		Result code.
+ */
+
+enum config_read_status config_file_read_token_pair(struct config_file *file, char **token, char **value, char **section);
+
+
+/**
+ * Close a Choices file which was loaded by config_file_open(), freeing
+ * the memory that it used.
+ *
+ * \param *file		The file to be closed.
+ */
+
+void config_file_close(struct config_file *file);
+
+
 /**
  * Write a token/value pair to file, enclosing parameters that contain
  * leading or trailing whitespace in quotes.
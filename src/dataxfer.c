@@ -32,6 +32,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdio.h>
 
 /* Acorn C header files */
 
@@ -51,6 +52,7 @@
 #include "errors.h"
 #include "event.h"
 #include "general.h"
+#include "hash.h"
 #include "string.h"
 
 #ifdef __CC_NORCROFT
@@ -64,6 +66,10 @@
 
 #define DATAXFER_CLIPBOARD_NAME "Clipboard"
 
+#define DATAXFER_RAM_MINIMUM 1024									/**< The smallest block to request in a Message_RAMFetch.		*/
+
+#define DATAXFER_STREAM_CHUNK 4096									/**< The default buffer size for streamed transfers.			*/
+
 /**
  * The purpose of a transfer.
  */
@@ -97,15 +103,22 @@ struct dataxfer_descriptor {
 	int				my_ref;								/**< The MyRef of the sent message.					*/
 	wimp_t				task;								/**< The task handle of the recipient task.				*/
 	osbool				(*save_callback)(char *filename, void *data);			/**< The callback function to be used if a save is required.		*/
+	size_t				(*serialise_callback)(void *buffer, size_t size,
+							size_t offset, void *data);			/**< The callback function to be used if a RAM save is required.	*/
 	osbool				(*receive_callback)(void *content, size_t size, bits type,
 							void *data);					/**< The callback function to be used if clipboard data is received.	*/
+	osbool				(*stream_callback)(void *content, size_t size, bits type,
+							osbool complete, void *data);			/**< The callback function to be used if data is being streamed.	*/
+	size_t				stream_chunk;							/**< The size of the buffer to use for streamed data.			*/
 	void				*callback_data;							/**< Data to be passed to the callback function.			*/
+	struct dataxfer_incoming_target	*incoming;							/**< The incoming target for the transfer, or NULL.			*/
 	char				*intermediate_filename;						/**< The filename to use for the disc-based Data Transfer Protocol.	*/
 
 	byte				*ram_data;							/**< The buffer for RAM transfers.					*/
-	size_t				ram_allocation;							/**< The amount of memory being allocated to the RAM buffer.		*/
+	size_t				ram_allocation;							/**< The number of bytes requested by the last Message_RAMFetch.	*/
 	size_t				ram_size;							/**< The size of the buffer for RAM transfers.				*/
 	size_t				ram_used;							/**< The amount of RAM buffer used.					*/
+	osbool				ram_local;							/**< TRUE if the RAM buffer was claimed with malloc().			*/
 
 	wimp_full_message_data_xfer	*saved_message;							/**< A saved data transfer message block.				*/
 
@@ -115,6 +128,8 @@ struct dataxfer_descriptor {
 
 static struct dataxfer_descriptor	*dataxfer_descriptors = NULL;					/**< List of currently active message operations.			*/
 
+static struct hash_table		*dataxfer_descriptor_refs = NULL;				/**< Index of active message operations, by MyRef.			*/
+
 /**
  * Data associated with incoming transfer targets.
  */
@@ -141,17 +156,26 @@ struct dataxfer_incoming_target {
 
 	osbool				(*callback)(wimp_w w, wimp_i i,
 			unsigned filetype, char *filename, void *data);					/**< The callback function to be used if a load is required.		*/
+	osbool				(*receive_callback)(void *content, size_t size, bits type,
+							void *data);					/**< The callback function to be used if a RAM load is possible.	*/
+	osbool				(*stream_callback)(void *content, size_t size, bits type,
+							osbool complete, void *data);			/**< The callback function to be used if data is to be streamed.	*/
+	size_t				stream_chunk;							/**< The size of the buffer to use for streamed data.			*/
 	void				*callback_data;							/**< Data to be passed to the callback function.			*/
 
 	char				*intermediate_filename;						/**< Filename to be used for disc-based transfers.			*/
 
 	struct dataxfer_incoming_target	*children;							/**< Pointer to a list of child targets (window or icon lists).		*/
+	struct hash_table		*index;								/**< Index of the child targets, by window or icon handle, or NULL.	*/
 
 	struct dataxfer_incoming_target	*next;								/**< The next target in the chain, or NULL.				*/
+	struct dataxfer_incoming_target	*chain;								/**< The next filetype target with the same filetype, or NULL.		*/
 };
 
 struct dataxfer_incoming_target		*dataxfer_incoming_targets = NULL;				/**< List of defined incoming targets.					*/
 
+static struct hash_table		*dataxfer_incoming_types = NULL;				/**< Index of the incoming filetype targets, by filetype.		*/
+
 /**
  * Data asscoiated with drag box handling.
  */
@@ -165,6 +189,12 @@ static void	(*dataxfer_drag_end_callback)(wimp_pointer *, void *) = NULL;				/**
 
 static struct dataxfer_memory		*dataxfer_memory_handlers = NULL;				/**< Pointer to client functions for handling memory.			*/
 
+/**
+ * Activity counters.
+ */
+
+static struct dataxfer_statistics	dataxfer_statistics = {0, 0, 0, 0};				/**< Counters recording the data transfer activity.			*/
+
 /**
  * Clipboard content locator.
  */
@@ -197,13 +227,29 @@ static osbool				dataxfer_message_data_open(wimp_message *message);
 
 static osbool				dataxfer_message_bounced(wimp_message *message);
 
+static osbool				dataxfer_send_data_save(wimp_pointer *pointer, char *name, int size, bits type, int your_ref,
+							osbool (*save_callback)(char *filename, void *data),
+							size_t (*serialise_callback)(void *buffer, size_t size, size_t offset, void *data), void *data);
+static osbool				dataxfer_request_data(wimp_w w, wimp_i i, os_coord pos, bits types[],
+							osbool (*receive_callback)(void *content, size_t size, bits type, void *data),
+							osbool (*stream_callback)(void *content, size_t size, bits type, osbool complete, void *data), size_t chunk, void *data);
+static osbool				dataxfer_start_ram_receive(struct dataxfer_descriptor *descriptor, wimp_full_message_data_xfer *datasave);
+static void				dataxfer_free_ram_buffer(struct dataxfer_descriptor *descriptor);
+static osbool				dataxfer_stream_file(char *filename, bits type, size_t chunk,
+							osbool (*stream_callback)(void *content, size_t size, bits type, osbool complete, void *data), void *data);
+
 static osbool				dataxfer_set_load_target(enum dataxfer_target_type target, unsigned filetype, wimp_w w, wimp_i i, char *intermediate,
-							osbool (*callback)(wimp_w w, wimp_i i, unsigned filetype, char *filename, void *data), void *data);
+							osbool (*callback)(wimp_w w, wimp_i i, unsigned filetype, char *filename, void *data),
+							osbool (*receive_callback)(void *content, size_t size, bits type, void *data),
+							osbool (*stream_callback)(void *content, size_t size, bits type, osbool complete, void *data), size_t chunk, void *data);
 static void				dataxfer_delete_load_target(enum dataxfer_target_type target, unsigned filetype, wimp_w w, wimp_i i);
 static struct dataxfer_incoming_target	*dataxfer_find_incoming_target(enum dataxfer_target_type target, wimp_w w, wimp_i i, unsigned filetype);
+static void				dataxfer_unlink_incoming_type(struct dataxfer_incoming_target *type);
+static void				dataxfer_free_incoming_target(struct dataxfer_incoming_target *target);
 
 static struct dataxfer_descriptor	*dataxfer_new_descriptor(void);
 static struct dataxfer_descriptor	*dataxfer_find_descriptor(int ref, enum dataxfer_message_type type);
+static void				dataxfer_set_descriptor_ref(struct dataxfer_descriptor *descriptor, int ref);
 static void				dataxfer_delete_descriptor(struct dataxfer_descriptor *message);
 
 
@@ -230,17 +276,40 @@ void dataxfer_initialise(wimp_t task_handle, struct dataxfer_memory *handlers)
 	
 	dataxfer_memory_handlers = handlers;
 
-	if (handlers != NULL) {
-		event_add_message_handler(message_RAM_FETCH, EVENT_MESSAGE_INCOMING, dataxfer_message_ram_fetch);
-		event_add_message_handler(message_RAM_TRANSMIT, EVENT_MESSAGE_INCOMING, dataxfer_message_ram_transmit);
-		event_add_message_handler(message_RAM_FETCH, EVENT_MESSAGE_ACKNOWLEDGE, dataxfer_message_ram_fetch_bounced);
-		event_add_message_handler(message_RAM_TRANSMIT, EVENT_MESSAGE_ACKNOWLEDGE, dataxfer_message_bounced);
-	}
+	/* The RAM transfer handlers are always needed, as streamed transfers
+	 * don't rely on the client's memory handlers.
+	 */
+
+	event_add_message_handler(message_RAM_FETCH, EVENT_MESSAGE_INCOMING, dataxfer_message_ram_fetch);
+	event_add_message_handler(message_RAM_TRANSMIT, EVENT_MESSAGE_INCOMING, dataxfer_message_ram_transmit);
+	event_add_message_handler(message_RAM_FETCH, EVENT_MESSAGE_ACKNOWLEDGE, dataxfer_message_ram_fetch_bounced);
+	event_add_message_handler(message_RAM_TRANSMIT, EVENT_MESSAGE_ACKNOWLEDGE, dataxfer_message_bounced);
 
 	dataxfer_task_handle = task_handle;
 }
 
 
+/**
+ * Read the counters recording the data transfer activity.
+ *
+ * \param *statistics	Pointer to a block to take the counter values.
+ * \param reset		TRUE to reset the counters after reading them.
+ */
+
+void dataxfer_read_statistics(struct dataxfer_statistics *statistics, osbool reset)
+{
+	if (statistics != NULL)
+		*statistics = dataxfer_statistics;
+
+	if (reset) {
+		dataxfer_statistics.transfers = 0;
+		dataxfer_statistics.ram_messages = 0;
+		dataxfer_statistics.ram_bytes = 0;
+		dataxfer_statistics.ram_allocations = 0;
+	}
+}
+
+
 /**
  * Start dragging from a window work area, creating a sprite to drag and starting
  * a drag action.  When the action completes, a callback will be made to the
@@ -438,6 +507,59 @@ static void dataxfer_terminate_user_drag(wimp_dragged *drag, void *data)
  */
 
 osbool dataxfer_request_clipboard(wimp_w w, wimp_i i, os_coord pos, bits types[], osbool (*receive_callback)(void *content, size_t size, bits type, void *data), void *data)
+{
+	if (receive_callback == NULL)
+		return FALSE;
+
+	return dataxfer_request_data(w, i, pos, types, receive_callback, NULL, 0, data);
+}
+
+
+/**
+ * Start a clipboard data request operation, streaming the data to the client
+ * as it arrives.
+ *
+ * \param w			The window to which the data will be targetted.
+ * \param i			The icon to which the data will be targetted.
+ * \param pos			The position of the caret.
+ * \param types[]		A list of acceptable filetypes, terminated by -1.
+ * \param chunk			The size of the buffer to use, or 0 for a default.
+ * \param *stream_callback	The function to be called when each block of
+ *				data has been received.
+ * \param *data			Data to be passed to the callback function.
+ * \return			TRUE on success; FALSE on failure.
+ */
+
+osbool dataxfer_request_clipboard_stream(wimp_w w, wimp_i i, os_coord pos, bits types[], size_t chunk,
+		osbool (*stream_callback)(void *content, size_t size, bits type, osbool complete, void *data), void *data)
+{
+	if (stream_callback == NULL)
+		return FALSE;
+
+	return dataxfer_request_data(w, i, pos, types, NULL, stream_callback, (chunk > 0) ? chunk : DATAXFER_STREAM_CHUNK, data);
+}
+
+
+/**
+ * Start a clipboard data request operation, with the data being returned
+ * to the client either as a single block or as a stream.
+ *
+ * \param w			The window to which the data will be targetted.
+ * \param i			The icon to which the data will be targetted.
+ * \param pos			The position of the caret.
+ * \param types[]		A list of acceptable filetypes, terminated by -1.
+ * \param *receive_callback	The function to be called when the data has
+ *				been received, or NULL.
+ * \param *stream_callback	The function to be called when each block of
+ *				data has been received, or NULL.
+ * \param chunk			The size of the buffer to use for streamed data.
+ * \param *data			Data to be passed to the callback function.
+ * \return			TRUE on success; FALSE on failure.
+ */
+
+static osbool dataxfer_request_data(wimp_w w, wimp_i i, os_coord pos, bits types[],
+		osbool (*receive_callback)(void *content, size_t size, bits type, void *data),
+		osbool (*stream_callback)(void *content, size_t size, bits type, osbool complete, void *data), size_t chunk, void *data)
 {
 	struct dataxfer_descriptor	*descriptor;
 	wimp_full_message_data_request	datarequest;
@@ -445,9 +567,6 @@ osbool dataxfer_request_clipboard(wimp_w w, wimp_i i, os_coord pos, bits types[]
 	int				j;
 
 
-	if (receive_callback == NULL)
-		return FALSE;
-
 	/* Allocate a block to store details of the message. */
 
 	descriptor = dataxfer_new_descriptor();
@@ -458,6 +577,8 @@ osbool dataxfer_request_clipboard(wimp_w w, wimp_i i, os_coord pos, bits types[]
 	
 	descriptor->save_callback = NULL;
 	descriptor->receive_callback = receive_callback;
+	descriptor->stream_callback = stream_callback;
+	descriptor->stream_chunk = chunk;
 	descriptor->callback_data = data;
 
 	/* Set up and send the datasave message. If it fails, give an error
@@ -487,7 +608,7 @@ osbool dataxfer_request_clipboard(wimp_w w, wimp_i i, os_coord pos, bits types[]
 	/* Complete the message descriptor information. */
 
 	descriptor->type = DATAXFER_MESSAGE_REQUEST;
-	descriptor->my_ref = datarequest.my_ref;
+	dataxfer_set_descriptor_ref(descriptor, datarequest.my_ref);
 
 	return TRUE;
 }
@@ -510,15 +631,70 @@ osbool dataxfer_request_clipboard(wimp_w w, wimp_i i, os_coord pos, bits types[]
  */
 
 osbool dataxfer_start_save(wimp_pointer *pointer, char *name, int size, bits type, int your_ref, osbool (*save_callback)(char *filename, void *data), void *data)
+{
+	if (save_callback == NULL)
+		return FALSE;
+
+	return dataxfer_send_data_save(pointer, name, size, type, your_ref, save_callback, NULL, data);
+}
+
+
+/**
+ * Start a data save action by sending a message to another task, offering
+ * to transfer the data by RAM if the recipient can accept it.  The data
+ * transfer protocol will be started, and at an appropriate time a callback
+ * will be made either to save the data to disc or to serialise it into
+ * memory.
+ *
+ * \param *pointer		The Wimp pointer details of the save target.
+ * \param *name			The proposed file leafname.
+ * \param size			The estimated file size.
+ * \param type			The proposed file type.
+ * \param your_ref		The "your ref" to use for the opening message, or 0.
+ * \param *save_callback	The function to be called with the full pathname
+ *				to save the file.
+ * \param *serialise_callback	The function to be called to copy the data
+ *				into a buffer for a RAM transfer.
+ * \param *data			Data to be passed to the callback functions.
+ * \return			TRUE on success; FALSE on failure.
+ */
+
+osbool dataxfer_start_ram_save(wimp_pointer *pointer, char *name, int size, bits type, int your_ref, osbool (*save_callback)(char *filename, void *data),
+		size_t (*serialise_callback)(void *buffer, size_t size, size_t offset, void *data), void *data)
+{
+	if (save_callback == NULL || serialise_callback == NULL)
+		return FALSE;
+
+	return dataxfer_send_data_save(pointer, name, size, type, your_ref, save_callback, serialise_callback, data);
+}
+
+
+/**
+ * Send a Message_DataSave to start a data save action, with or without the
+ * option of a RAM transfer.
+ *
+ * \param *pointer		The Wimp pointer details of the save target.
+ * \param *name			The proposed file leafname.
+ * \param size			The estimated file size.
+ * \param type			The proposed file type.
+ * \param your_ref		The "your ref" to use for the opening message, or 0.
+ * \param *save_callback	The function to be called with the full pathname
+ *				to save the file.
+ * \param *serialise_callback	The function to be called to copy the data
+ *				into a buffer for a RAM transfer, or NULL.
+ * \param *data			Data to be passed to the callback functions.
+ * \return			TRUE on success; FALSE on failure.
+ */
+
+static osbool dataxfer_send_data_save(wimp_pointer *pointer, char *name, int size, bits type, int your_ref,
+		osbool (*save_callback)(char *filename, void *data),
+		size_t (*serialise_callback)(void *buffer, size_t size, size_t offset, void *data), void *data)
 {
 	struct dataxfer_descriptor	*descriptor;
 	wimp_full_message_data_xfer	message;
 	os_error			*error;
 
 
-	if (save_callback == NULL)
-		return FALSE;
-
 	/* Allocate a block to store details of the message. */
 
 	descriptor = dataxfer_new_descriptor();
@@ -528,9 +704,14 @@ osbool dataxfer_start_save(wimp_pointer *pointer, char *name, int size, bits typ
 	descriptor->purpose = DATAXFER_FILE_SAVE;
 
 	descriptor->save_callback = save_callback;
+	descriptor->serialise_callback = serialise_callback;
 	descriptor->receive_callback = NULL;
 	descriptor->callback_data = data;
 
+	/* Any RAM transfer will be serialised through a local buffer. */
+
+	descriptor->ram_local = TRUE;
+
 	/* Set up and send the datasave message. If it fails, give an error
 	 * and delete the message details as we won't need them again.
 	 */
@@ -556,7 +737,7 @@ osbool dataxfer_start_save(wimp_pointer *pointer, char *name, int size, bits typ
 	/* Complete the message descriptor information. */
 
 	descriptor->type = DATAXFER_MESSAGE_SAVE;
-	descriptor->my_ref = message.my_ref;
+	dataxfer_set_descriptor_ref(descriptor, message.my_ref);
 
 	return TRUE;
 }
@@ -618,7 +799,7 @@ osbool dataxfer_start_load(wimp_pointer *pointer, char *name, int size, bits typ
 	/* Complete the message descriptor information. */
 
 	descriptor->type = DATAXFER_MESSAGE_SAVE;
-	descriptor->my_ref = message.my_ref;
+	dataxfer_set_descriptor_ref(descriptor, message.my_ref);
 
 	return TRUE;
 }
@@ -714,7 +895,7 @@ static osbool dataxfer_message_datarequest(wimp_message *message)
 	/* Complete the message descriptor information. */
 
 	descriptor->type = DATAXFER_MESSAGE_SAVE;
-	descriptor->my_ref = xferblock->my_ref;
+	dataxfer_set_descriptor_ref(descriptor, xferblock->my_ref);
 
 	return TRUE;
 }
@@ -735,25 +916,54 @@ static osbool dataxfer_message_ram_fetch(wimp_message *message)
 	os_error			*error;
 	int				bytes_to_send, send_this_time;
 	wimp_event_no			message_type;
+	byte				*block, *source;
 
 
-	/* See if we recognise the message, and if we're sending the clipboard.
-	 * If either are false, let the message go.
+	/* See if we recognise the message, and if we're sending the clipboard
+	 * or a file which can be serialised into memory. If not, let the
+	 * message go so that it bounces and the recipient uses disc instead.
 	 */
 
 	descriptor = dataxfer_find_descriptor(message->your_ref, DATAXFER_MESSAGE_SAVE | DATAXFER_MESSAGE_RAMRX);
-	if (descriptor == NULL || descriptor->purpose != DATAXFER_CLIPBOARD_SEND)
+	if (descriptor == NULL || (descriptor->purpose != DATAXFER_CLIPBOARD_SEND &&
+			(descriptor->purpose != DATAXFER_FILE_SAVE || descriptor->serialise_callback == NULL)))
 		return FALSE;
 
-	/* See how many bytes are left to go, and how many we can send in this
-	 * transfer -- then send the data and update the sent byte count.
+	if (descriptor->purpose == DATAXFER_FILE_SAVE) {
+		/* Make sure that the local buffer can hold the block requested,
+		 * then ask the client to fill it with the next part of the data.
+		 */
+
+		if (descriptor->ram_allocation < ramfetch->xfer_size) {
+			block = realloc(descriptor->ram_data, ramfetch->xfer_size);
+			if (block == NULL) {
+				error_msgs_report_error("NoRAMforXFer:No RAM for data transfer.");
+				dataxfer_delete_descriptor(descriptor);
+				return TRUE;
+			}
+
+			descriptor->ram_data = block;
+			descriptor->ram_allocation = ramfetch->xfer_size;
+
+			dataxfer_statistics.ram_allocations++;
+		}
+
+		bytes_to_send = descriptor->serialise_callback(descriptor->ram_data, ramfetch->xfer_size, descriptor->ram_used, descriptor->callback_data);
+		source = descriptor->ram_data;
+	} else {
+		/* See how many bytes are left to go in the clipboard data. */
+
+		bytes_to_send = descriptor->ram_size - descriptor->ram_used;
+		source = (byte *) descriptor->ram_data + descriptor->ram_used;
+	}
+
+	/* Work out how many bytes we can send in this transfer -- then send
+	 * the data and update the sent byte count.
 	 */
 
-	bytes_to_send = descriptor->ram_size - descriptor->ram_used;
 	send_this_time = (bytes_to_send > ramfetch->xfer_size) ? ramfetch->xfer_size : bytes_to_send;
 
-	error = xwimp_transfer_block(dataxfer_task_handle, (byte *) descriptor->ram_data + descriptor->ram_used,
-			ramfetch->sender, ramfetch->addr, send_this_time);
+	error = xwimp_transfer_block(dataxfer_task_handle, source, ramfetch->sender, ramfetch->addr, send_this_time);
 	if (error != NULL) {
 		error_report_os_error(error, wimp_ERROR_BOX_CANCEL_ICON);
 		dataxfer_delete_descriptor(descriptor);
@@ -762,6 +972,9 @@ static osbool dataxfer_message_ram_fetch(wimp_message *message)
 
 	descriptor->ram_used += send_this_time;
 
+	dataxfer_statistics.ram_messages++;
+	dataxfer_statistics.ram_bytes += send_this_time;
+
 	/* Update the message block and send the reply. If there's still data
 	 * to go, it must be sent Recorded.
 	 */
@@ -782,10 +995,17 @@ static osbool dataxfer_message_ram_fetch(wimp_message *message)
 		return TRUE;
 	}
 
+	/* If that was the last block, the transfer is complete. */
+
+	if (message_type == wimp_USER_MESSAGE) {
+		dataxfer_delete_descriptor(descriptor);
+		return TRUE;
+	}
+
 	/* Complete the message descriptor information. */
 
 	descriptor->type = DATAXFER_MESSAGE_RAMRX;
-	descriptor->my_ref = ramfetch->my_ref;
+	dataxfer_set_descriptor_ref(descriptor, ramfetch->my_ref);
 
 	return TRUE;
 }
@@ -857,7 +1077,7 @@ static osbool dataxfer_message_data_save_ack(wimp_message *message)
 		return TRUE;
 	}
 
-	descriptor->my_ref = datasaveack->my_ref;
+	dataxfer_set_descriptor_ref(descriptor, datasaveack->my_ref);
 
 	return TRUE;
 }
@@ -899,7 +1119,6 @@ static osbool dataxfer_message_data_load_ack(wimp_message *message)
 static osbool dataxfer_message_data_save(wimp_message *message)
 {
 	wimp_full_message_data_xfer	*datasave = (wimp_full_message_data_xfer *) message;
-	wimp_full_message_ram_xfer	ramfetch;
 	struct dataxfer_descriptor	*descriptor;
 	os_error			*error;
 	struct dataxfer_incoming_target	*target;
@@ -922,45 +1141,17 @@ static osbool dataxfer_message_data_save(wimp_message *message)
 		if (descriptor == NULL || descriptor->purpose != DATAXFER_CLIPBOARD_RECEIVE)
 			return FALSE;
 
-		if (dataxfer_memory_handlers != NULL) {
-			descriptor->ram_allocation = datasave->est_size + 1;
-			descriptor->ram_data = dataxfer_memory_handlers->alloc(descriptor->ram_allocation);
-			descriptor->saved_message = malloc(sizeof(wimp_full_message_data_xfer));
-
-			/* Both the above blocks are freed when the descriptor is deleted, so while
-			 * this is a short-term memory leak it isn't fatal.
-			 */
-
-			if (descriptor->ram_data != NULL && descriptor->saved_message != NULL) {
-				descriptor->ram_size = descriptor->ram_allocation;
-
-				memcpy(descriptor->saved_message, message, sizeof(wimp_full_message_data_xfer));
-
-				ramfetch.size = 28;
-				ramfetch.your_ref = datasave->my_ref;
-				ramfetch.action = message_RAM_FETCH;
-
-				ramfetch.addr = (byte *) descriptor->ram_data;
-				ramfetch.xfer_size = descriptor->ram_size;
-
-				error = xwimp_send_message(wimp_USER_MESSAGE_RECORDED, (wimp_message *) &ramfetch, datasave->sender);
-				if (error != NULL) {
-					error_report_os_error(error, wimp_ERROR_BOX_CANCEL_ICON);
-					dataxfer_delete_descriptor(descriptor);
-					return TRUE;
-				}
-
-				descriptor->type = DATAXFER_MESSAGE_RAMRX;
-				descriptor->my_ref = ramfetch.my_ref;
+		/* Try to start a RAM transfer; if this isn't possible, fall back
+		 * to the disc-based protocol.
+		 */
 
-				return TRUE;
-			}
-		}
+		if (dataxfer_start_ram_receive(descriptor, datasave))
+			return TRUE;
 	} else {
 		/* See if the window is one of the registered targets. */
 
 		target = dataxfer_find_incoming_target(DATAXFER_TARGET_SAVE, datasave->w, datasave->i, datasave->file_type);
-		if (target == NULL || target->callback == NULL)
+		if (target == NULL || (target->callback == NULL && target->stream_callback == NULL))
 			return FALSE;
 
 		/* If we've got a target, get a descriptor to track the message exchange. */
@@ -973,7 +1164,8 @@ static osbool dataxfer_message_data_save(wimp_message *message)
 
 		descriptor->save_callback = NULL;
 		descriptor->receive_callback = NULL;
-		descriptor->callback_data = target;
+		descriptor->callback_data = target->callback_data;
+		descriptor->incoming = target;
 		if (target->intermediate_filename != NULL) {
 			descriptor->intermediate_filename = target->intermediate_filename;
 			/* If an intermediate file has been supplied, assume that the client
@@ -982,6 +1174,19 @@ static osbool dataxfer_message_data_save(wimp_message *message)
 			data_unsafe = FALSE;
 		}
 
+		/* If the target can take the data in memory, try to start a RAM
+		 * transfer before falling back to the disc-based protocol.
+		 */
+
+		if (target->receive_callback != NULL || target->stream_callback != NULL) {
+			descriptor->receive_callback = target->receive_callback;
+			descriptor->stream_callback = target->stream_callback;
+			descriptor->stream_chunk = target->stream_chunk;
+
+			if (dataxfer_start_ram_receive(descriptor, datasave))
+				return TRUE;
+		}
+
 		/* Update the message block and send an acknowledgement. */
 	}
 
@@ -1001,12 +1206,170 @@ static osbool dataxfer_message_data_save(wimp_message *message)
 	}
 
 	descriptor->type = DATAXFER_MESSAGE_LOAD;
-	descriptor->my_ref = datasave->my_ref;
+	dataxfer_set_descriptor_ref(descriptor, datasave->my_ref);
 
 	return TRUE;
 }
 
 
+/**
+ * Try to start a RAM transfer in response to a Message_DataSave, by claiming
+ * a buffer and sending a Message_RAMFetch to the sender.
+ *
+ * \param *descriptor		The descriptor for the transfer.
+ * \param *datasave		The incoming Message_DataSave block.
+ * \return			TRUE if the message was handled; FALSE if the
+ *				disc-based protocol should be used instead.
+ */
+
+static osbool dataxfer_start_ram_receive(struct dataxfer_descriptor *descriptor, wimp_full_message_data_xfer *datasave)
+{
+	wimp_full_message_ram_xfer	ramfetch;
+	os_error			*error;
+
+
+	if (descriptor == NULL || datasave == NULL)
+		return FALSE;
+
+	/* Streamed transfers use a fixed buffer which is re-used for each
+	 * block; otherwise size the buffer from the estimate in the
+	 * Message_DataSave, allowing a spare byte so that an accurate estimate
+	 * completes the transfer in a single Message_RAMTransmit.
+	 */
+
+	if (descriptor->stream_callback != NULL) {
+		descriptor->ram_allocation = descriptor->stream_chunk;
+		descriptor->ram_data = malloc(descriptor->ram_allocation);
+		descriptor->ram_local = TRUE;
+	} else if (dataxfer_memory_handlers != NULL) {
+		if (datasave->est_size >= DATAXFER_RAM_MINIMUM)
+			descriptor->ram_allocation = datasave->est_size + 1;
+		else
+			descriptor->ram_allocation = DATAXFER_RAM_MINIMUM;
+
+		descriptor->ram_data = dataxfer_memory_handlers->alloc(descriptor->ram_allocation);
+	} else {
+		return FALSE;
+	}
+
+	descriptor->saved_message = malloc(sizeof(wimp_full_message_data_xfer));
+
+	dataxfer_statistics.ram_allocations++;
+
+	if (descriptor->ram_data == NULL || descriptor->saved_message == NULL) {
+		dataxfer_free_ram_buffer(descriptor);
+
+		if (descriptor->saved_message != NULL) {
+			free(descriptor->saved_message);
+			descriptor->saved_message = NULL;
+		}
+
+		return FALSE;
+	}
+
+	descriptor->ram_size = descriptor->ram_allocation;
+
+	memcpy(descriptor->saved_message, datasave, sizeof(wimp_full_message_data_xfer));
+
+	ramfetch.size = 28;
+	ramfetch.your_ref = datasave->my_ref;
+	ramfetch.action = message_RAM_FETCH;
+
+	ramfetch.addr = (byte *) descriptor->ram_data;
+	ramfetch.xfer_size = descriptor->ram_size;
+
+	error = xwimp_send_message(wimp_USER_MESSAGE_RECORDED, (wimp_message *) &ramfetch, datasave->sender);
+	if (error != NULL) {
+		error_report_os_error(error, wimp_ERROR_BOX_CANCEL_ICON);
+		dataxfer_delete_descriptor(descriptor);
+		return TRUE;
+	}
+
+	descriptor->type = DATAXFER_MESSAGE_RAMRX;
+	dataxfer_set_descriptor_ref(descriptor, ramfetch.my_ref);
+
+	return TRUE;
+}
+
+
+/**
+ * Free any RAM transfer buffer held by a descriptor, using the appropriate
+ * memory handler.
+ *
+ * \param *descriptor		The descriptor holding the buffer.
+ */
+
+static void dataxfer_free_ram_buffer(struct dataxfer_descriptor *descriptor)
+{
+	if (descriptor == NULL)
+		return;
+
+	if (descriptor->ram_data != NULL) {
+		if (descriptor->ram_local)
+			free(descriptor->ram_data);
+		else if (dataxfer_memory_handlers != NULL)
+			dataxfer_memory_handlers->free(descriptor->ram_data);
+	}
+
+	descriptor->ram_data = NULL;
+	descriptor->ram_size = 0;
+	descriptor->ram_allocation = 0;
+}
+
+
+/**
+ * Pass the contents of a file to a stream callback, one block at a time.
+ *
+ * \param *filename		The name of the file to be streamed.
+ * \param type			The filetype to report to the callback.
+ * \param chunk			The size of the buffer to use.
+ * \param *stream_callback	The function to receive the data.
+ * \param *data			Data to be passed to the callback function.
+ * \return			TRUE if the file was streamed; FALSE on failure
+ *				or if the client abandoned the transfer.
+ */
+
+static osbool dataxfer_stream_file(char *filename, bits type, size_t chunk,
+		osbool (*stream_callback)(void *content, size_t size, bits type, osbool complete, void *data), void *data)
+{
+	FILE	*in;
+	byte	*buffer;
+	size_t	length;
+	osbool	complete = FALSE, result = TRUE;
+
+
+	if (filename == NULL || stream_callback == NULL || chunk == 0)
+		return FALSE;
+
+	buffer = malloc(chunk);
+	if (buffer == NULL)
+		return FALSE;
+
+	in = fopen(filename, "rb");
+	if (in == NULL) {
+		free(buffer);
+		return FALSE;
+	}
+
+	while (result && !complete) {
+		length = fread(buffer, sizeof(byte), chunk, in);
+
+		if (ferror(in)) {
+			result = FALSE;
+			break;
+		}
+
+		complete = (length < chunk) ? TRUE : FALSE;
+		result = stream_callback(buffer, length, type, complete, data);
+	}
+
+	fclose(in);
+	free(buffer);
+
+	return result;
+}
+
+
 /**
  * Handle bounces of Message_RAMFetch, which tells us that the application
  * trying to send us data can't handle RAM transfers.
@@ -1027,16 +1390,20 @@ static osbool dataxfer_message_ram_fetch_bounced(wimp_message *message)
 
 	// \TODO -- Bounces of the non-first message should be handled differently.
 
-	/* Free any memory that's claimed for the transfer. */
+	/* If a streamed transfer has already passed data to the client, it
+	 * can't be restarted on disc, so abandon it.
+	 */
 
-	if (descriptor->ram_data != NULL) {
-		if (dataxfer_memory_handlers != NULL)
-			dataxfer_memory_handlers->free(descriptor->ram_data);
-		descriptor->ram_data = NULL;
-		descriptor->ram_size = 0;
-		descriptor->ram_allocation = 0;
+	if (descriptor->stream_callback != NULL && descriptor->ram_used > 0) {
+		error_msgs_report_error("XferFail:Data transfer failed.");
+		dataxfer_delete_descriptor(descriptor);
+		return TRUE;
 	}
 
+	/* Free any memory that's claimed for the transfer. */
+
+	dataxfer_free_ram_buffer(descriptor);
+
 	/* Send a Message_DataSaveAck to start a disc-based transfer. */
 
 	descriptor->saved_message->your_ref = descriptor->saved_message->my_ref;
@@ -1054,7 +1421,7 @@ static osbool dataxfer_message_ram_fetch_bounced(wimp_message *message)
 	}
 
 	descriptor->type = DATAXFER_MESSAGE_LOAD;
-	descriptor->my_ref = descriptor->saved_message->my_ref;
+	dataxfer_set_descriptor_ref(descriptor, descriptor->saved_message->my_ref);
 
 	/* We don't need the saved message any more. */
 
@@ -1078,26 +1445,72 @@ static osbool dataxfer_message_ram_transmit(wimp_message *message)
 	struct dataxfer_descriptor	*descriptor;
 	os_error			*error;
 	byte				*block;
+	osbool				complete;
 
 
 	descriptor = dataxfer_find_descriptor(message->your_ref, DATAXFER_MESSAGE_RAMRX);
-	if (descriptor == NULL || descriptor->purpose != DATAXFER_CLIPBOARD_RECEIVE)
+	if (descriptor == NULL || (descriptor->receive_callback == NULL && descriptor->stream_callback == NULL))
 		return FALSE;
 
-	if (ramtransmit->xfer_size == descriptor->ram_allocation) {
-		block = dataxfer_memory_handlers->realloc(descriptor->ram_data, descriptor->ram_size + descriptor->ram_allocation);
+	dataxfer_statistics.ram_messages++;
+	dataxfer_statistics.ram_bytes += ramtransmit->xfer_size;
+
+	if (descriptor->stream_callback != NULL) {
+		/* Pass the block to the client. If this is the last, or the
+		 * client wants to abandon the transfer, then we're done: an
+		 * abandoned transfer isn't acknowledged, so the sender will
+		 * see its Message_RAMTransmit bounce.
+		 */
+
+		complete = (ramtransmit->xfer_size < descriptor->ram_allocation) ? TRUE : FALSE;
+		descriptor->ram_used += ramtransmit->xfer_size;
+
+		if (!descriptor->stream_callback(descriptor->ram_data, ramtransmit->xfer_size, descriptor->saved_message->file_type,
+				complete, descriptor->callback_data) || complete) {
+			dataxfer_delete_descriptor(descriptor);
+			return TRUE;
+		}
+
+		/* Ask for the next block, in the same buffer. */
+
+		ramtransmit->your_ref = ramtransmit->my_ref;
+		ramtransmit->action = message_RAM_FETCH;
+		ramtransmit->addr = descriptor->ram_data;
+		ramtransmit->xfer_size = descriptor->ram_allocation;
+
+		error = xwimp_send_message(wimp_USER_MESSAGE_RECORDED, (wimp_message *) ramtransmit, ramtransmit->sender);
+		if (error != NULL) {
+			error_report_os_error(error, wimp_ERROR_BOX_CANCEL_ICON);
+			dataxfer_delete_descriptor(descriptor);
+			return TRUE;
+		}
+
+		dataxfer_set_descriptor_ref(descriptor, ramtransmit->my_ref);
+	} else if (ramtransmit->xfer_size == descriptor->ram_allocation) {
+		/* The sender filled the block, so there's more to come. Double
+		 * the size of the buffer each time, and ask for all of the new
+		 * space in the next Message_RAMFetch, so that the number of
+		 * reallocations and round trips grows with the log of the size.
+		 */
+
+		descriptor->ram_used += ramtransmit->xfer_size;
+		descriptor->ram_allocation = descriptor->ram_used;
+
+		block = dataxfer_memory_handlers->realloc(descriptor->ram_data, descriptor->ram_used + descriptor->ram_allocation);
 		if (block == NULL) {
 			error_msgs_report_error("NoRAMforXFer:No RAM for data transfer.");
 			dataxfer_delete_descriptor(descriptor);
 			return TRUE;
 		}
 		descriptor->ram_data = block;
-		descriptor->ram_used = descriptor->ram_size;
-		descriptor->ram_size += descriptor->ram_allocation;
+		descriptor->ram_size = descriptor->ram_used + descriptor->ram_allocation;
+
+		dataxfer_statistics.ram_allocations++;
 
 		ramtransmit->your_ref = ramtransmit->my_ref;
 		ramtransmit->action = message_RAM_FETCH;
 		ramtransmit->addr = descriptor->ram_data + descriptor->ram_used;
+		ramtransmit->xfer_size = descriptor->ram_allocation;
 
 		error = xwimp_send_message(wimp_USER_MESSAGE_RECORDED, (wimp_message *) ramtransmit, ramtransmit->sender);
 		if (error != NULL) {
@@ -1106,12 +1519,13 @@ static osbool dataxfer_message_ram_transmit(wimp_message *message)
 			return TRUE;
 		}
 
-		descriptor->my_ref = ramtransmit->my_ref;
+		dataxfer_set_descriptor_ref(descriptor, ramtransmit->my_ref);
 	} else {
 		/* That's it; so return the data to the client. */
 
 		if (descriptor->receive_callback != NULL)
-			descriptor->receive_callback(descriptor->ram_data, descriptor->ram_used + ramtransmit->xfer_size, 0xfff, descriptor->callback_data);
+			descriptor->receive_callback(descriptor->ram_data, descriptor->ram_used + ramtransmit->xfer_size,
+					descriptor->saved_message->file_type, descriptor->callback_data);
 
 		/* We don't want the descriptor deletion to free the data block,
 		 * as the client might want to keep it.
@@ -1139,6 +1553,7 @@ static osbool dataxfer_message_data_load(wimp_message *message)
 	struct dataxfer_descriptor	*descriptor = NULL;
 	os_error			*error;
 	struct dataxfer_incoming_target	*target = NULL;
+	osbool				streamed;
 
 
 	/* We don't want to respond to our own save requests. */
@@ -1157,8 +1572,24 @@ static osbool dataxfer_message_data_load(wimp_message *message)
 
 		target = dataxfer_find_incoming_target(DATAXFER_TARGET_LOAD, dataload->w, dataload->i, dataload->file_type);
 
-		if (target == NULL || target->callback == NULL)
+		if (target == NULL || (target->callback == NULL && target->stream_callback == NULL))
 			return FALSE;
+	} else if (descriptor->stream_callback != NULL) {
+		/* This is the end of a streamed transfer which fell back to
+		 * the disc-based protocol, so pass the file contents to the
+		 * client and tidy up. If the stream failed, abandon the transfer
+		 * here without acknowledging the message, as is done for the
+		 * registered targets below.
+		 */
+
+		streamed = dataxfer_stream_file(dataload->file_name, dataload->file_type, descriptor->stream_chunk,
+				descriptor->stream_callback, descriptor->callback_data);
+
+		xosfscontrol_wipe(dataload->file_name, NONE, 0, 0, 0, 0);
+		dataxfer_delete_descriptor(descriptor);
+
+		if (!streamed)
+			return TRUE;
 	} else if (descriptor->purpose == DATAXFER_CLIPBOARD_RECEIVE && descriptor->receive_callback != NULL) {
 		/* This is the end of a clipboard data request, so we need to
 		 * load the file contents and present it to the client as a
@@ -1185,14 +1616,22 @@ static osbool dataxfer_message_data_load(wimp_message *message)
 	} else {
 		/* This is someone saving data to us. */
 
-		target = descriptor->callback_data;
+		target = descriptor->incoming;
 	}
 
 	/* If this wasn't a clipboard transfer, we just pass the filename to the
 	 * client and let them load it.
 	 */
 
-	if (target != NULL && (descriptor == NULL || (descriptor != NULL && descriptor->purpose == DATAXFER_FILE_LOAD))) {
+	if (target != NULL && descriptor == NULL && target->stream_callback != NULL) {
+		/* If the target wants the data streamed, pass it the file
+		 * contents; if this fails, abandon the transfer here.
+		 */
+
+		if (!dataxfer_stream_file(dataload->file_name, dataload->file_type, target->stream_chunk,
+				target->stream_callback, target->callback_data))
+			return TRUE;
+	} else if (target != NULL && (descriptor == NULL || (descriptor != NULL && descriptor->purpose == DATAXFER_FILE_LOAD))) {
 		/* If there's no load callback function, abandon the transfer here. */
 
 		if (target->callback == NULL)
@@ -1318,7 +1757,58 @@ static osbool dataxfer_message_bounced(wimp_message *message)
 
 osbool dataxfer_set_drop_target(unsigned filetype, wimp_w w, wimp_i i, char *intermediate, osbool (*callback)(wimp_w w, wimp_i i, unsigned filetype, char *filename, void *data), void *data)
 {
-	return dataxfer_set_load_target(DATAXFER_TARGET_DRAG, filetype, w, i, intermediate, callback, data);
+	return dataxfer_set_load_target(DATAXFER_TARGET_DRAG, filetype, w, i, intermediate, callback, NULL, NULL, 0, data);
+}
+
+
+/**
+ * Specify a handler for files which are dragged into a window, which can
+ * receive the file contents in memory if the sender supports RAM transfers.
+ *
+ * \param filetype		The filetype to register as a target.
+ * \param w			The target window, or NULL.
+ * \param i			The target icon, or -1.
+ * \param *intermediate		Pointer to the intermediate filename to use for the Data
+ *				Transfer Protocol, or NULL for default <Wimp$Scrap>.
+ * \param *callback		The load callback function.
+ * \param *receive_callback	The RAM load callback function.
+ * \param *data			Data to be passed to load functions, or NULL.
+ * \return			TRUE if successfully registered; else FALSE.
+ */
+
+osbool dataxfer_set_drop_ram_target(unsigned filetype, wimp_w w, wimp_i i, char *intermediate,
+		osbool (*callback)(wimp_w w, wimp_i i, unsigned filetype, char *filename, void *data),
+		osbool (*receive_callback)(void *content, size_t size, bits type, void *data), void *data)
+{
+	if (callback == NULL || receive_callback == NULL)
+		return FALSE;
+
+	return dataxfer_set_load_target(DATAXFER_TARGET_DRAG, filetype, w, i, intermediate, callback, receive_callback, NULL, 0, data);
+}
+
+
+/**
+ * Specify a handler for files which are dragged into a window, which will
+ * receive the file contents as a stream of data blocks.
+ *
+ * \param filetype		The filetype to register as a target.
+ * \param w			The target window, or NULL.
+ * \param i			The target icon, or -1.
+ * \param chunk			The size of the buffer to use, or 0 for a default.
+ * \param *stream_callback	The function to be called when each block of
+ *				data has been received.
+ * \param *data			Data to be passed to the callback function, or NULL.
+ * \return			TRUE if successfully registered; else FALSE.
+ */
+
+osbool dataxfer_set_drop_stream_target(unsigned filetype, wimp_w w, wimp_i i, size_t chunk,
+		osbool (*stream_callback)(void *content, size_t size, bits type, osbool complete, void *data), void *data)
+{
+	if (stream_callback == NULL)
+		return FALSE;
+
+	return dataxfer_set_load_target(DATAXFER_TARGET_DRAG, filetype, w, i, NULL, NULL, NULL, stream_callback,
+			(chunk > 0) ? chunk : DATAXFER_STREAM_CHUNK, data);
 }
 
 
@@ -1334,7 +1824,7 @@ osbool dataxfer_set_drop_target(unsigned filetype, wimp_w w, wimp_i i, char *int
 
 osbool dataxfer_set_load_type(unsigned filetype, osbool (*callback)(wimp_w w, wimp_i i, unsigned filetype, char *filename, void *data), void *data)
 {
-	return dataxfer_set_load_target(DATAXFER_TARGET_OPEN, filetype, NULL, -1, NULL, callback, data);
+	return dataxfer_set_load_target(DATAXFER_TARGET_OPEN, filetype, NULL, -1, NULL, callback, NULL, NULL, 0, data);
 }
 
 
@@ -1354,13 +1844,18 @@ osbool dataxfer_set_load_type(unsigned filetype, osbool (*callback)(wimp_w w, wi
  * \param w			The target window, or NULL.
  * \param i			The target icon, or -1.
  * \param *intermediate		Pointer to the intermediate filename to use, or NULL for default.
- * \param *callback		The load callback function.
+ * \param *callback		The load callback function, or NULL.
+ * \param *receive_callback	The RAM load callback function, or NULL.
+ * \param *stream_callback	The stream callback function, or NULL.
+ * \param chunk			The buffer size to use for streamed data.
  * \param *data			Data to be passed to load functions, or NULL.
  * \return			TRUE if successfully registered; else FALSE.
  */
 
 static osbool dataxfer_set_load_target(enum dataxfer_target_type target, unsigned filetype, wimp_w w, wimp_i i, char *intermediate,
-		osbool (*callback)(wimp_w w, wimp_i i, unsigned filetype, char *filename, void *data), void *data)
+		osbool (*callback)(wimp_w w, wimp_i i, unsigned filetype, char *filename, void *data),
+		osbool (*receive_callback)(void *content, size_t size, bits type, void *data),
+		osbool (*stream_callback)(void *content, size_t size, bits type, osbool complete, void *data), size_t chunk, void *data)
 {
 	struct dataxfer_incoming_target		*type, *window, *icon;
 
@@ -1371,10 +1866,16 @@ static osbool dataxfer_set_load_target(enum dataxfer_target_type target, unsigne
 
 	/* Set up the top-level filetype target. */
 
-	type = dataxfer_incoming_targets;
+	if (dataxfer_incoming_types == NULL) {
+		dataxfer_incoming_types = hash_create(0);
+		if (dataxfer_incoming_types == NULL)
+			return FALSE;
+	}
+
+	type = hash_find(dataxfer_incoming_types, filetype);
 
-	while (type != NULL && (type->filetype != filetype || (type->target & target) != target))
-		type = type->next;
+	while (type != NULL && (type->target & target) != target)
+		type = type->chain;
 
 	if (type == NULL) {
 		type = malloc(sizeof(struct dataxfer_incoming_target));
@@ -1387,11 +1888,21 @@ static osbool dataxfer_set_load_target(enum dataxfer_target_type target, unsigne
 		type->icon = 0;
 
 		type->callback = NULL;
+		type->receive_callback = NULL;
+		type->stream_callback = NULL;
+		type->stream_chunk = 0;
 		type->callback_data = NULL;
 
 		type->intermediate_filename = (intermediate != NULL) ? strdup(intermediate) : NULL;
 
 		type->children = NULL;
+		type->index = NULL;
+		type->chain = hash_find(dataxfer_incoming_types, filetype);
+
+		if (!hash_add(dataxfer_incoming_types, filetype, type)) {
+			dataxfer_free_incoming_target(type);
+			return FALSE;
+		}
 
 		type->next = dataxfer_incoming_targets;
 		dataxfer_incoming_targets = type;
@@ -1399,18 +1910,24 @@ static osbool dataxfer_set_load_target(enum dataxfer_target_type target, unsigne
 
 	if (w == NULL) {
 		type->callback = callback;
+		type->receive_callback = receive_callback;
+		type->stream_callback = stream_callback;
+		type->stream_chunk = chunk;
 		type->callback_data = data;
 		return TRUE;
 	}
 
 	/* Set up the window target. */
 
-	window = type->children;
-
-	while (window != NULL && window->window != w)
-		window = window->next;
+	window = hash_find(type->index, (unsigned int) w);
 
 	if (window == NULL) {
+		if (type->index == NULL) {
+			type->index = hash_create(0);
+			if (type->index == NULL)
+				return FALSE;
+		}
+
 		window = malloc(sizeof(struct dataxfer_incoming_target));
 		if (window == NULL)
 			return FALSE;
@@ -1421,11 +1938,21 @@ static osbool dataxfer_set_load_target(enum dataxfer_target_type target, unsigne
 		window->icon = 0;
 
 		window->callback = NULL;
+		window->receive_callback = NULL;
+		window->stream_callback = NULL;
+		window->stream_chunk = 0;
 		window->callback_data = NULL;
 
 		window->intermediate_filename = (intermediate != NULL) ? strdup(intermediate) : NULL;
 
 		window->children = NULL;
+		window->index = NULL;
+		window->chain = NULL;
+
+		if (!hash_add(type->index, (unsigned int) w, window)) {
+			dataxfer_free_incoming_target(window);
+			return FALSE;
+		}
 
 		window->next = type->children;
 		type->children = window;
@@ -1433,18 +1960,24 @@ static osbool dataxfer_set_load_target(enum dataxfer_target_type target, unsigne
 
 	if (i == -1) {
 		window->callback = callback;
+		window->receive_callback = receive_callback;
+		window->stream_callback = stream_callback;
+		window->stream_chunk = chunk;
 		window->callback_data = data;
 		return TRUE;
 	}
 
 	/* Set up the icon target. */
 
-	icon = window->children;
-
-	while (icon != NULL && icon->icon != i)
-		icon = icon->next;
+	icon = hash_find(window->index, (unsigned int) i);
 
 	if (icon == NULL) {
+		if (window->index == NULL) {
+			window->index = hash_create(0);
+			if (window->index == NULL)
+				return FALSE;
+		}
+
 		icon = malloc(sizeof(struct dataxfer_incoming_target));
 		if (icon == NULL)
 			return FALSE;
@@ -1455,17 +1988,30 @@ static osbool dataxfer_set_load_target(enum dataxfer_target_type target, unsigne
 		icon->icon = i;
 
 		icon->callback = NULL;
+		icon->receive_callback = NULL;
+		icon->stream_callback = NULL;
+		icon->stream_chunk = 0;
 		icon->callback_data = NULL;
 
 		icon->intermediate_filename = (intermediate != NULL) ? strdup(intermediate) : NULL;
 
 		icon->children = NULL;
+		icon->index = NULL;
+		icon->chain = NULL;
+
+		if (!hash_add(window->index, (unsigned int) i, icon)) {
+			dataxfer_free_incoming_target(icon);
+			return FALSE;
+		}
 
 		icon->next = window->children;
 		window->children = icon;
 	}
 
 	icon->callback = callback;
+	icon->receive_callback = receive_callback;
+	icon->stream_callback = stream_callback;
+	icon->stream_chunk = chunk;
 	icon->callback_data = data;
 
 	return TRUE;
@@ -1532,6 +2078,8 @@ static void dataxfer_delete_load_target(enum dataxfer_target_type target, unsign
 
 			if (w == NULL && i == -1) {
 				type->callback = NULL;
+				type->receive_callback = NULL;
+				type->stream_callback = NULL;
 				type->callback_data = NULL;
 			}
 
@@ -1544,6 +2092,8 @@ static void dataxfer_delete_load_target(enum dataxfer_target_type target, unsign
 
 					if (i == -1) {
 						window->callback = NULL;
+						window->receive_callback = NULL;
+						window->stream_callback = NULL;
 						window->callback_data = NULL;
 					}
 
@@ -1554,19 +2104,20 @@ static void dataxfer_delete_load_target(enum dataxfer_target_type target, unsign
 						if ((filetype == -1 || icon->filetype == filetype) && (w == NULL || icon->window == w) && (i == -1 || icon->icon == i) &&
 								((icon->target & target) != DATAXFER_TARGET_NONE)) {
 							icon->callback = NULL;
+							icon->receive_callback = NULL;
+							icon->stream_callback = NULL;
 							icon->callback_data = NULL;
 						}
 
-						if (icon->callback == NULL && icon->children == NULL) {
+						if (icon->callback == NULL && icon->stream_callback == NULL && icon->children == NULL) {
 							if (parent_icon == NULL)
 								window->children = icon->next;
 							else
 								parent_icon->next = icon->next;
 							delete = icon;
 							icon = icon->next;
-							if (delete->intermediate_filename != NULL)
-								free(delete->intermediate_filename);
-							free(delete);
+							hash_remove(window->index, (unsigned int) delete->icon);
+							dataxfer_free_incoming_target(delete);
 						} else {
 							parent_icon = icon;
 							icon = icon->next;
@@ -1574,16 +2125,15 @@ static void dataxfer_delete_load_target(enum dataxfer_target_type target, unsign
 					}
 				}
 
-				if (window->callback == NULL && window->children == NULL) {
+				if (window->callback == NULL && window->stream_callback == NULL && window->children == NULL) {
 					if (parent_window == NULL)
 						type->children = window->next;
 					else
 						parent_window->next = window->next;
 					delete = window;
 					window = window->next;
-					if (delete->intermediate_filename != NULL)
-						free(delete->intermediate_filename);
-					free(delete);
+					hash_remove(type->index, (unsigned int) delete->window);
+					dataxfer_free_incoming_target(delete);
 				} else {
 					parent_window = window;
 					window = window->next;
@@ -1591,16 +2141,15 @@ static void dataxfer_delete_load_target(enum dataxfer_target_type target, unsign
 			}
 		}
 
-		if (type->callback == NULL && type->children == NULL) {
+		if (type->callback == NULL && type->stream_callback == NULL && type->children == NULL) {
 			if (parent_type == NULL)
 				dataxfer_incoming_targets = type->next;
 			else
 				parent_type->next = type->next;
 			delete = type;
 			type = type->next;
-			if (delete->intermediate_filename != NULL)
-				free(delete->intermediate_filename);
-			free(delete);
+			dataxfer_unlink_incoming_type(delete);
+			dataxfer_free_incoming_target(delete);
 		} else {
 			parent_type = type;
 			type = type->next;
@@ -1626,38 +2175,91 @@ static struct dataxfer_incoming_target *dataxfer_find_incoming_target(enum datax
 
 	/* Search for a filetype. */
 
-	type = dataxfer_incoming_targets;
+	type = hash_find(dataxfer_incoming_types, filetype);
 
-	while (type != NULL && (type->filetype != filetype || (type->target & target) == DATAXFER_TARGET_NONE))
-		type = type->next;
+	while (type != NULL && (type->target & target) == DATAXFER_TARGET_NONE)
+		type = type->chain;
 
 	if (type == NULL)
 		return NULL;
 
 	/* Now search for a window. */
 
-	window = type->children;
+	if (w == NULL)
+		return type;
 
-	while (w != NULL && window != NULL && (window->window != w || (window->target & target) == DATAXFER_TARGET_NONE))
-		window = window->next;
+	window = hash_find(type->index, (unsigned int) w);
 
-	if (window == NULL)
+	if (window == NULL || (window->target & target) == DATAXFER_TARGET_NONE)
 		return type;
 
 	/* Now search for an icon. */
 
-	icon = window->children;
+	if (i == -1)
+		return window;
 
-	while (i != -1 && icon != NULL && (icon->icon != i || (icon->target & target) == DATAXFER_TARGET_NONE))
-		icon = icon->next;
+	icon = hash_find(window->index, (unsigned int) i);
 
-	if (icon == NULL)
+	if (icon == NULL || (icon->target & target) == DATAXFER_TARGET_NONE)
 		return window;
 
 	return icon;
 }
 
 
+/**
+ * Remove a top-level filetype target from the index of filetypes.
+ *
+ * \param *type			The target to be removed.
+ */
+
+static void dataxfer_unlink_incoming_type(struct dataxfer_incoming_target *type)
+{
+	struct dataxfer_incoming_target		*list;
+
+	if (type == NULL)
+		return;
+
+	list = hash_find(dataxfer_incoming_types, type->filetype);
+
+	if (list == type) {
+		if (type->chain != NULL)
+			hash_add(dataxfer_incoming_types, type->filetype, type->chain);
+		else
+			hash_remove(dataxfer_incoming_types, type->filetype);
+		return;
+	}
+
+	while (list != NULL && list->chain != type)
+		list = list->chain;
+
+	if (list != NULL)
+		list->chain = type->chain;
+}
+
+
+/**
+ * Free the memory used by an incoming target, which must already have been
+ * removed from its parent's lists and indexes.
+ *
+ * \param *target		The target to be freed.
+ */
+
+static void dataxfer_free_incoming_target(struct dataxfer_incoming_target *target)
+{
+	if (target == NULL)
+		return;
+
+	if (target->intermediate_filename != NULL)
+		free(target->intermediate_filename);
+
+	if (target->index != NULL)
+		hash_destroy(target->index);
+
+	free(target);
+}
+
+
 /**
  * Create a new message descriptor with no data and return a pointer.
  *
@@ -1668,17 +2270,33 @@ static struct dataxfer_descriptor *dataxfer_new_descriptor(void)
 {
 	struct dataxfer_descriptor		*new;
 
+	if (dataxfer_descriptor_refs == NULL) {
+		dataxfer_descriptor_refs = hash_create(0);
+		if (dataxfer_descriptor_refs == NULL)
+			return NULL;
+	}
+
 	new = malloc(sizeof(struct dataxfer_descriptor));
 	if (new != NULL) {
+		dataxfer_statistics.transfers++;
+
 		new->type = DATAXFER_MESSAGE_NONE;
 		new->purpose = DATAXFER_UNKNOWN;
 
+		new->my_ref = 0;
+
 		new->intermediate_filename = "<Wimp$Scrap>";
 
+		new->serialise_callback = NULL;
+		new->stream_callback = NULL;
+		new->stream_chunk = 0;
+		new->incoming = NULL;
+
 		new->ram_data = NULL;
 		new->ram_allocation = 0;
 		new->ram_size = 0;
 		new->ram_used = 0;
+		new->ram_local = FALSE;
 
 		new->saved_message = NULL;
 
@@ -1700,12 +2318,39 @@ static struct dataxfer_descriptor *dataxfer_new_descriptor(void)
 
 static struct dataxfer_descriptor *dataxfer_find_descriptor(int ref, enum dataxfer_message_type type)
 {
-	struct dataxfer_descriptor		*list = dataxfer_descriptors;
+	struct dataxfer_descriptor		*descriptor;
 
-	while (list != NULL && ((list->type & type) == 0 || list->my_ref != ref))
-		list = list->next;
+	if (ref == 0)
+		return NULL;
 
-	return list;
+	descriptor = hash_find(dataxfer_descriptor_refs, (unsigned int) ref);
+	if (descriptor == NULL || (descriptor->type & type) == 0)
+		return NULL;
+
+	return descriptor;
+}
+
+
+/**
+ * Update the MyRef of the last message sent for a descriptor, re-indexing
+ * the descriptor so that it can be found from replies to the new message.
+ *
+ * \param *descriptor		The descriptor to be updated.
+ * \param ref			The new MyRef for the descriptor.
+ */
+
+static void dataxfer_set_descriptor_ref(struct dataxfer_descriptor *descriptor, int ref)
+{
+	if (descriptor == NULL)
+		return;
+
+	if (descriptor->my_ref != 0 && hash_find(dataxfer_descriptor_refs, (unsigned int) descriptor->my_ref) == descriptor)
+		hash_remove(dataxfer_descriptor_refs, (unsigned int) descriptor->my_ref);
+
+	descriptor->my_ref = ref;
+
+	if (ref != 0)
+		hash_add(dataxfer_descriptor_refs, (unsigned int) ref, descriptor);
 }
 
 
@@ -1729,8 +2374,11 @@ static void dataxfer_delete_descriptor(struct dataxfer_descriptor *message)
 
 	/* If there's any RAM transfer memory, free it. */
 
-	if (message->ram_data != NULL && dataxfer_memory_handlers != NULL)
-		dataxfer_memory_handlers->free(message->ram_data);
+	dataxfer_free_ram_buffer(message);
+
+	/* Remove the message from the reference index. */
+
+	dataxfer_set_descriptor_ref(message, 0);
 
 	/* If the message is at the head of the list, delink and free it. */
 
@@ -58,6 +58,17 @@ struct dataxfer_memory {
 	void (*free)(void *ptr);			/**< eg. free().	*/
 };
 
+/**
+ * Datatransfer activity counters.
+ */
+
+struct dataxfer_statistics {
+	unsigned int	transfers;			/**< The number of transfers started.				*/
+	unsigned int	ram_messages;			/**< The number of RAM transfer blocks sent or received.	*/
+	size_t		ram_bytes;			/**< The number of bytes sent or received by RAM transfer.	*/
+	unsigned int	ram_allocations;		/**< The number of RAM transfer buffer claims and resizes.	*/
+};
+
 
 /**
  * Initialise the data transfer system.
@@ -69,6 +80,18 @@ struct dataxfer_memory {
 void dataxfer_initialise(wimp_t task_handle, struct dataxfer_memory *handlers);
 
 
+/**
+ * Read the counters recording the data transfer activity since the system
+ * was initialised, or since the counters were last reset, so that clients
+ * can measure how efficiently transfers are being carried out.
+ *
+ * \param *statistics	Pointer to a block to take the counter values.
+ * \param reset		TRUE to reset the counters after reading them.
+ */
+
+void dataxfer_read_statistics(struct dataxfer_statistics *statistics, osbool reset);
+
+
 /**
  * Start dragging from a window work area, creating a sprite to drag and starting
  * a drag action.  When the action completes, a callback will be made to the
@@ -115,6 +138,32 @@ void dataxfer_save_window_drag(wimp_w w, wimp_i i, void (* drag_end_callback)(wi
 osbool dataxfer_request_clipboard(wimp_w w, wimp_i i, os_coord pos, bits types[], osbool (*receive_callback)(void *content, size_t size, bits type, void *data), void *data);
 
 
+/**
+ * Start a clipboard data request operation, streaming the data to the client
+ * as it arrives: the data transfer protocol will be started and, as each block
+ * of data is received, the callback will be called with details of where it
+ * can be found. The blocks are passed in a single buffer of the given size
+ * which is re-used for every call, so the client must copy out anything that
+ * it wishes to keep before returning.
+ *
+ * The final call to the callback will have complete set to TRUE, and may
+ * contain no data. If the callback returns FALSE, the transfer is abandoned.
+ *
+ * \param w			The window to which the data will be targetted.
+ * \param i			The icon to which the data will be targetted.
+ * \param pos			The position of the caret.
+ * \param types[]		A list of acceptable filetypes, terminated by -1.
+ * \param chunk			The size of the buffer to use, or 0 for a default.
+ * \param *stream_callback	The function to be called when each block of
+ *				data has been received.
+ * \param *data			Data to be passed to the callback function.
+ * \return			TRUE on success; FALSE on failure.
+ */
+
+osbool dataxfer_request_clipboard_stream(wimp_w w, wimp_i i, os_coord pos, bits types[], size_t chunk,
+		osbool (*stream_callback)(void *content, size_t size, bits type, osbool complete, void *data), void *data);
+
+
 /**
  * Start a data save action by sending a message to another task.  The data
  * transfer protocol will be started, and at an appropriate time a callback
@@ -134,6 +183,36 @@ osbool dataxfer_request_clipboard(wimp_w w, wimp_i i, os_coord pos, bits types[]
 osbool dataxfer_start_save(wimp_pointer *pointer, char *name, int size, bits type, int your_ref, osbool (*save_callback)(char *filename, void *data), void *data);
 
 
+/**
+ * Start a data save action by sending a message to another task, offering
+ * to transfer the data by RAM if the recipient can accept it.  The data
+ * transfer protocol will be started, and at an appropriate time a callback
+ * will be made either to save the data to disc, or to serialise it into
+ * memory.
+ *
+ * The serialise callback is passed a buffer, its size and the offset into
+ * the data of the first byte required; it should copy as much data as will
+ * fit into the buffer and return the number of bytes copied. Returning less
+ * than the size of the buffer indicates that the end of the data has been
+ * reached.
+ *
+ * \param *pointer		The Wimp pointer details of the save target.
+ * \param *name			The proposed file leafname.
+ * \param size			The estimated file size.
+ * \param type			The proposed file type.
+ * \param your_ref		The "your ref" to use for the opening message, or 0.
+ * \param *save_callback	The function to be called with the full pathname
+ *				to save the file.
+ * \param *serialise_callback	The function to be called to copy the data
+ *				into a buffer for a RAM transfer.
+ * \param *data			Data to be passed to the callback functions.
+ * \return			TRUE on success; FALSE on failure.
+ */
+
+osbool dataxfer_start_ram_save(wimp_pointer *pointer, char *name, int size, bits type, int your_ref, osbool (*save_callback)(char *filename, void *data),
+		size_t (*serialise_callback)(void *buffer, size_t size, size_t offset, void *data), void *data);
+
+
 /**
  * Start a data load action for another task by sending it a message containing
  * the name of the file that it should take.
@@ -184,6 +263,55 @@ osbool dataxfer_set_drop_target(unsigned filetype, wimp_w w, wimp_i i, char *int
 		osbool (*callback)(wimp_w w, wimp_i i, unsigned filetype, char *filename, void *data), void *data);
 
 
+/**
+ * Specify a handler for files which are dragged into a window, which can
+ * receive the file contents in memory if the sending task supports RAM
+ * transfers. Files which match on type, window handle and icon are passed
+ * to the receive callback in a block claimed using the memory handlers
+ * passed to dataxfer_initialise(), which then belongs to the client; if a
+ * RAM transfer isn't possible, the filename is passed to the load callback
+ * as for dataxfer_set_drop_target().
+ *
+ * \param filetype		The filetype to register as a target.
+ * \param w			The target window, or NULL.
+ * \param i			The target icon, or -1.
+ * \param *intermediate		Pointer to the intermediate filename to use for the Data
+ *				Transfer Protocol, or NULL for default <Wimp$Scrap>.
+ * \param *callback		The load callback function.
+ * \param *receive_callback	The RAM load callback function.
+ * \param *data			Data to be passed to load functions, or NULL.
+ * \return			TRUE if successfully registered; else FALSE.
+ */
+
+osbool dataxfer_set_drop_ram_target(unsigned filetype, wimp_w w, wimp_i i, char *intermediate,
+		osbool (*callback)(wimp_w w, wimp_i i, unsigned filetype, char *filename, void *data),
+		osbool (*receive_callback)(void *content, size_t size, bits type, void *data), void *data);
+
+
+/**
+ * Specify a handler for files which are dragged into a window, which will
+ * receive the file contents as a stream of data blocks instead of a filename.
+ * Files which match on type, window handle and icon are passed to the handler
+ * in a single buffer of the given size which is re-used for every block, so
+ * the client must copy out anything that it wishes to keep before returning.
+ *
+ * The final call to the callback will have complete set to TRUE, and may
+ * contain no data. If the callback returns FALSE, the transfer is abandoned.
+ *
+ * \param filetype		The filetype to register as a target.
+ * \param w			The target window, or NULL.
+ * \param i			The target icon, or -1.
+ * \param chunk			The size of the buffer to use, or 0 for a default.
+ * \param *stream_callback	The function to be called when each block of
+ *				data has been received.
+ * \param *data			Data to be passed to the callback function, or NULL.
+ * \return			TRUE if successfully registered; else FALSE.
+ */
+
+osbool dataxfer_set_drop_stream_target(unsigned filetype, wimp_w w, wimp_i i, size_t chunk,
+		osbool (*stream_callback)(void *content, size_t size, bits type, osbool complete, void *data), void *data);
+
+
 /**
  * Specify a handler for files which are double-clicked. Files which match
  * on type, are passed to the appropriate handler for attention.
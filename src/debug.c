@@ -24,7 +24,8 @@
 /**
  * \file: debug.c
  *
- * Debug support for writing data to Reporter.
+ * Debug support for writing data to Reporter, either directly or via an
+ * in-memory trace buffer.
  */
 
 /* OS-Lib header files. */
@@ -42,6 +43,38 @@
 #include "debug.h"
 
 #define DEBUG_MAX_LINE_LENGTH 256
+#define DEBUG_TRACE_SIZE 256								/**< The number of events in the trace buffer; must be a power of 2.	*/
+
+/**
+ * The possible states of the Reporter module.
+ */
+
+enum debug_reporter {
+	DEBUG_REPORTER_UNKNOWN,								/**< Reporter hasn't been looked for yet.				*/
+	DEBUG_REPORTER_PRESENT,								/**< Reporter is loaded.						*/
+	DEBUG_REPORTER_ABSENT								/**< Reporter is not loaded.						*/
+};
+
+/**
+ * An event recorded in the trace buffer.
+ */
+
+struct debug_trace_event {
+	os_t		time;								/**< The time at which the event was recorded.				*/
+	char		*format;							/**< The printf() format string for the event.				*/
+	int		args[DEBUG_TRACE_ARGS];						/**< The parameters for the format string.				*/
+};
+
+static enum debug_reporter	debug_reporter_state = DEBUG_REPORTER_UNKNOWN;		/**< The state of the Reporter module.					*/
+
+static osbool			debug_trace_enabled = FALSE;				/**< TRUE if tracing is enabled; else FALSE.				*/
+static struct debug_trace_event	debug_trace_buffer[DEBUG_TRACE_SIZE];			/**< The trace buffer.							*/
+static unsigned int		debug_trace_next = 0;					/**< The total number of events recorded.				*/
+static unsigned int		debug_trace_flushed = 0;				/**< The number of events which have been flushed or discarded.		*/
+
+
+static osbool debug_test_reporter(void);
+
 
 /* Print a string to Reporter, using the standard printf() syntax and
  * functionality.  Expanded text is limited to 256 characters including
@@ -57,7 +90,7 @@ int debug_printf(char *cntrl_string, ...)
 	int		ret;
 	va_list		ap;
 
-	if (xos_swi_number_from_string("Report_Text0", NULL) != NULL)
+	if (!debug_test_reporter())
 		return 0;
 
 	va_start(ap, cntrl_string);
@@ -70,3 +103,98 @@ int debug_printf(char *cntrl_string, ...)
 	return ret;
 }
 
+
+/* Enable or disable the recording of events into the trace buffer.
+ *
+ * This function is an external interface, documented in debug.h.
+ */
+
+void debug_trace_set_enabled(osbool enabled)
+{
+	debug_trace_enabled = enabled;
+}
+
+
+/* Record an event into the trace buffer, without formatting it.
+ *
+ * This function is an external interface, documented in debug.h.
+ */
+
+void debug_trace(char *format, int a, int b, int c, int d)
+{
+	struct debug_trace_event	*event;
+
+	if (!debug_trace_enabled || format == NULL)
+		return;
+
+	event = debug_trace_buffer + (debug_trace_next++ & (DEBUG_TRACE_SIZE - 1));
+
+	if (xos_read_monotonic_time(&(event->time)) != NULL)
+		event->time = 0;
+
+	event->format = format;
+	event->args[0] = a;
+	event->args[1] = b;
+	event->args[2] = c;
+	event->args[3] = d;
+}
+
+
+/* Format the events held in the trace buffer and write them to Reporter,
+ * then empty the buffer.
+ *
+ * This function is an external interface, documented in debug.h.
+ */
+
+void debug_trace_flush(void)
+{
+	struct debug_trace_event	*event;
+	char				s[DEBUG_MAX_LINE_LENGTH];
+	int				length;
+
+	/* If the buffer has wrapped, skip the events that were overwritten. */
+
+	if (debug_trace_next - debug_trace_flushed > DEBUG_TRACE_SIZE) {
+		if (debug_test_reporter()) {
+			snprintf(s, DEBUG_MAX_LINE_LENGTH, "Trace: %u events lost", debug_trace_next - debug_trace_flushed - DEBUG_TRACE_SIZE);
+			report_text0(s);
+		}
+
+		debug_trace_flushed = debug_trace_next - DEBUG_TRACE_SIZE;
+	}
+
+	if (!debug_test_reporter()) {
+		debug_trace_flushed = debug_trace_next;
+		return;
+	}
+
+	while (debug_trace_flushed != debug_trace_next) {
+		event = debug_trace_buffer + (debug_trace_flushed++ & (DEBUG_TRACE_SIZE - 1));
+
+		length = snprintf(s, DEBUG_MAX_LINE_LENGTH, "%10u: ", (unsigned int) event->time);
+		if (length < 0 || length >= DEBUG_MAX_LINE_LENGTH)
+			length = 0;
+
+		snprintf(s + length, DEBUG_MAX_LINE_LENGTH - length, event->format,
+				event->args[0], event->args[1], event->args[2], event->args[3]);
+
+		s[DEBUG_MAX_LINE_LENGTH - 1] = '\0';
+		report_text0(s);
+	}
+}
+
+
+/**
+ * Test whether Reporter is available. The SWI is only looked up once, so
+ * Reporter must be loaded before the first debug output is produced.
+ *
+ * \return			TRUE if Reporter is available; else FALSE.
+ */
+
+static osbool debug_test_reporter(void)
+{
+	if (debug_reporter_state == DEBUG_REPORTER_UNKNOWN)
+		debug_reporter_state = (xos_swi_number_from_string("Report_Text0", NULL) == NULL) ? DEBUG_REPORTER_PRESENT : DEBUG_REPORTER_ABSENT;
+
+	return (debug_reporter_state == DEBUG_REPORTER_PRESENT) ? TRUE : FALSE;
+}
@@ -24,12 +24,21 @@
 /**
  * \file: debug.h
  *
- * Debug support for writing data to Reporter.
+ * Debug support for writing data to Reporter, either directly or via an
+ * in-memory trace buffer.
  */
 
 #ifndef SFLIB_DEBUG
 #define SFLIB_DEBUG
 
+#include "oslib/types.h"
+
+/**
+ * The number of parameters which can be recorded with a trace event.
+ */
+
+#define DEBUG_TRACE_ARGS 4
+
 
 /**
  * Print a string to Reporter, using the standard printf() syntax and
@@ -44,5 +53,40 @@
 
 int debug_printf(char *cntrl_string, ...);
 
-#endif
 
+/**
+ * Enable or disable the recording of events into the trace buffer. Tracing
+ * is disabled by default.
+ *
+ * \param enabled		TRUE to enable tracing; FALSE to disable it.
+ */
+
+void debug_trace_set_enabled(osbool enabled);
+
+
+/**
+ * Record an event into the trace buffer, along with the current time. The
+ * event is not formatted until the buffer is flushed, so the format string
+ * must remain valid until then (a string literal is ideal) and should only
+ * use integer conversions. Once the buffer is full, the oldest events are
+ * overwritten.
+ *
+ * \param *format		The printf() format string for the event.
+ * \param a			The first format parameter, or 0 if unused.
+ * \param b			The second format parameter, or 0 if unused.
+ * \param c			The third format parameter, or 0 if unused.
+ * \param d			The fourth format parameter, or 0 if unused.
+ */
+
+void debug_trace(char *format, int a, int b, int c, int d);
+
+
+/**
+ * Format the events held in the trace buffer and write them to Reporter,
+ * oldest first, then empty the buffer. This is called automatically by
+ * error_report_program() before the application exits.
+ */
+
+void debug_trace_flush(void);
+
+#endif
@@ -35,6 +35,7 @@
 
 /* SF-Lib header files. */
 
+#include "debug.h"
 #include "errors.h"
 #include "msgs.h"
 #include "string.h"
@@ -386,6 +387,8 @@ void error_report_program(os_error *error)
 	if (error == NULL)
 		return;
 
+	debug_trace_flush();
+
 	error_wimp_os_report(error, wimp_ERROR_BOX_CATEGORY_PROGRAM, wimp_ERROR_BOX_CANCEL_ICON, NULL);
 	exit(1);
 }
@@ -224,7 +224,8 @@ void error_report_fatal(char *message);
 
 /**
  * Open a Wimp error box of type wimp_ERROR_BOX_CATEGORY_PROGRAM, containg
- * details of the error in an Error Block and a Cancel button.
+ * details of the error in an Error Block and a Cancel button. Any events
+ * held in the debug trace buffer are flushed to Reporter first.
  *
  * This function never returns.
  *
@@ -35,9 +35,16 @@
 /* SFLib Header Files. */
 
 #include "event.h"
+#include "hash.h"
 #include "icons.h"
 #include "menus.h"
+#include "pool.h"
 #include "string.h"
+#include "windows.h"
+
+#ifdef SFLIB_PROFILE
+#include "debug.h"
+#endif
 
 /* ANSII C header files. */
 
@@ -47,6 +54,25 @@
 #include <stdio.h>
 
 #define EVENT_TOKEN_INDEX_LEN 12											/**< The number of digits in a message token index.			*/
+#define EVENT_CALLBACK_QUEUE_SIZE 16										/**< The initial number of entries allocated for the callback queue.	*/
+#define EVENT_POOL_SMALL_SLAB 8											/**< The number of blocks in each slab for pools of large blocks.	*/
+
+/**
+ * Profiling wrappers for calls to client handlers. In profiling builds,
+ * EVENT_PROFILE() records the time spent in a call against a profile
+ * record, while EVENT_PROFILE_WINDOW() records it against one of the
+ * profile records of a window; the window is looked up again after the
+ * call, in case the handler has deleted it. In other builds, both simply
+ * make the call.
+ */
+
+#ifdef SFLIB_PROFILE
+#define EVENT_PROFILE(record, call) do {os_t event_profile_start = event_profile_get_time(); call; event_profile_record(&(record), event_profile_start);} while (0)
+#define EVENT_PROFILE_WINDOW(w, type, call) do {wimp_w event_profile_w = (w); os_t event_profile_start = event_profile_get_time(); call; event_profile_record_window(event_profile_w, (type), event_profile_start);} while (0)
+#else
+#define EVENT_PROFILE(record, call) call
+#define EVENT_PROFILE_WINDOW(w, type, call) call
+#endif
 
 /**
  * Menu types, to identify which type of menu handler needs to be called
@@ -60,6 +86,20 @@ enum event_menu_type {
 	EVENT_MENU_POPUP_MANUAL												/**< Popup Manual menu: popup menus handled via client events.		*/
 };
 
+/**
+ * Pools from which the event blocks are allocated.
+ */
+
+enum event_pool_type {
+	EVENT_POOL_WINDOW = 0,												/**< Pool for struct event_window.					*/
+	EVENT_POOL_ICON,												/**< Pool for struct event_icon.					*/
+	EVENT_POOL_ICON_ACTION,												/**< Pool for struct event_icon_action.					*/
+	EVENT_POOL_MESSAGE,												/**< Pool for struct event_message.					*/
+	EVENT_POOL_MESSAGE_ACTION,											/**< Pool for struct event_message_action.				*/
+	EVENT_POOL_CALLBACK,												/**< Pool for struct event_callback.					*/
+	EVENT_POOLS													/**< The number of pools; must be last.					*/
+};
+
 /**
  * Icon types, to identify which type of icon handler needs to be called
  * to process incoming icon events.
@@ -126,6 +166,18 @@ struct event_icon_bump {
 	int				step;										/**< The bump step size.						*/
 };
 
+#ifdef SFLIB_PROFILE
+/**
+ * Profiling details for a client handler, or a group of handlers.
+ */
+
+struct event_profile {
+	unsigned int			calls;										/**< The number of calls made to the handler.				*/
+	os_t				total;										/**< The total time spent in the handler.				*/
+	os_t				max;										/**< The longest time spent in a single call to the handler.		*/
+};
+#endif
+
 /**
  * Details of an icon click action: one or more of these can be chained to
  * a struct event_icon, and each will be actioned when a click event
@@ -183,8 +235,14 @@ struct event_window {
 	void				(*menu_warning)(wimp_w w, wimp_menu *m, wimp_message_menu_warning *warning);	/**< Callback handler for Menu Warning events, or NULL.			*/
 
 	struct event_icon		*icons;										/**< Pointer to the chain of icons in the window, or NULL.		*/
+	struct hash_table		*icon_index;									/**< Hashed index of the icon chain, or NULL if not in use.		*/
 
 	void				*data;										/**< Client data pointer.						*/
+
+#ifdef SFLIB_PROFILE
+	struct event_profile		profile[EVENT_PROFILE_TYPES];							/**< Profiling details for the window's handlers.			*/
+#endif
+
 	struct event_window		*next;										/**< Pointer to the next window in the chain, or NULL.			*/
 };
 
@@ -199,6 +257,13 @@ struct event_message_action {
 	enum event_message_type		type;										/**< The type of action: Standard, Recorded, Acknowledge, etc.		*/
 	osbool				(*action)(wimp_message *message);						/**< Callback handler to be called when the requirements are met.	*/
 
+	unsigned int			calls;										/**< The number of messages passed to the handler.			*/
+	unsigned int			claims;										/**< The number of messages claimed by the handler.			*/
+
+#ifdef SFLIB_PROFILE
+	struct event_profile		profile;									/**< Profiling details for the handler.					*/
+#endif
+
 	struct event_message_action	*next;										/**< Pointer to the next handler in the chain, or NULL.			*/
 };
 
@@ -219,22 +284,41 @@ struct event_message {
  */
 
 struct event_callback {
+	unsigned int			handle;										/**< The handle used by clients to refer to the callback.		*/
 	os_t				time;										/**< The time of the next callback.					*/
 	os_t				interval;									/**< The interval between callbacks for regular callbacks, or zero.	*/
 	osbool				(*callback)(os_t time, void *data);						/**< Callback handler to be called when the time arrives.		*/
 	void				*data;										/**< Data to be passed to the callback handler.				*/
 	struct event_window		*window;									/**< The associated window, or NULL.					*/
 
-	struct event_callback		*next;										/**< Pointer to the next callback in the chain, or NULL.		*/
+	unsigned int			sequence;									/**< Queue sequence number, to keep callbacks due together in order.	*/
+	unsigned int			index;										/**< The position of the callback in the queue.				*/
 };
 
 /**
  * Global Variables for the module.
  */
 
+static struct pool		*event_pools[EVENT_POOLS];			/**< The pools from which event blocks are allocated.			*/
+static osbool			event_pools_shared = FALSE;			/**< TRUE if all event blocks come from a single shared pool.		*/
+static osbool			event_pools_used = FALSE;			/**< TRUE once any event blocks have been allocated.			*/
+
 static struct event_message	*event_message_list = NULL;
+static struct hash_table	*event_message_index = NULL;			/**< Hashed index of the message list, or NULL if not available.	*/
+static unsigned int		event_messages_received = 0;			/**< The number of user messages received.				*/
+static unsigned int		event_messages_rejected = 0;			/**< The number of user messages received with no handlers registered.	*/
 static struct event_window	*event_window_list = NULL;
-static struct event_callback	*event_callback_list = NULL;
+static struct hash_table	*event_window_index = NULL;			/**< Hashed index of the window list, or NULL if not in use.		*/
+
+static struct event_callback	**event_callback_queue = NULL;			/**< The callback queue, held as a binary min-heap on callback time.	*/
+static unsigned int		event_callback_count = 0;			/**< The number of callbacks in the queue.				*/
+static unsigned int		event_callback_allocation = 0;			/**< The number of entries allocated for the queue.			*/
+static struct hash_table	*event_callback_handles = NULL;			/**< Index of callbacks by client handle.				*/
+static unsigned int		event_callback_next_handle = 1;			/**< The next client handle to be allocated.				*/
+static unsigned int		event_callback_sequence = 0;			/**< The next queue sequence number to be allocated.			*/
+static struct event_callback	*event_callback_running = NULL;			/**< The callback whose handler is currently being executed, or NULL.	*/
+static osbool			event_callback_cancelled = FALSE;		/**< TRUE if the running callback was cancelled by its handler.		*/
+static os_t			event_callback_budget = 0;			/**< The time allowed for draining due callbacks on each Null Poll, or 0.	*/
 
 static struct event_window	*current_menu = NULL;
 static enum event_menu_type	current_menu_type = EVENT_MENU_NONE;
@@ -251,6 +335,18 @@ static void (*event_drag_end)(wimp_dragged *dragged, void *data) = NULL;
 static osbool (*event_drag_null_poll)(void *data) = NULL;
 static void *event_drag_data = NULL;
 
+#ifdef SFLIB_PROFILE
+
+/* Profiling Data */
+
+static struct event_profile	event_profile_callbacks;			/**< Profiling details for callback handlers.				*/
+static struct event_profile	event_profile_drags;				/**< Profiling details for drag handlers.				*/
+
+static char			*event_profile_names[] = {			/**< Names for the window profile types, for reporting.			*/
+	"Redraw", "Open", "Close", "Leaving", "Entering", "Pointer", "Icon", "Key", "Scroll", "Caret", "Menu"
+};
+#endif
+
 /**
  * Function prototypes for internal functions.
  */
@@ -272,17 +368,36 @@ static osbool event_process_gain_caret(wimp_caret *caret);
 static osbool event_process_user_message(wimp_event_no event, wimp_message *message);
 static void event_prepare_auto_menu(struct event_window *window, struct event_icon_action *action);
 static void event_set_auto_menu_selection(struct event_window *window, struct event_icon_action *action, unsigned selection);
+static void *event_alloc_block(enum event_pool_type type);
+static void event_free_block(enum event_pool_type type, void *block);
+static size_t event_get_block_size(enum event_pool_type type);
 static struct event_window *event_find_window(wimp_w w);
 static struct event_window *event_create_window(wimp_w w);
 static void event_delete_icon_block(struct event_window *window, struct event_icon *icon);
 static struct event_icon *event_find_icon(struct event_window *window, wimp_i i);
 static struct event_icon *event_create_icon(struct event_window *window, wimp_i i);
+static void event_build_icon_index(struct event_window *window);
 static struct event_icon_action *event_find_action(struct event_icon *icon, enum event_icon_type type);
 static struct event_icon_action *event_create_action(struct event_icon *icon, enum event_icon_type type);
 static struct event_message *event_find_message(int message);
-static void event_insert_callback(struct event_callback *callback);
+static void event_build_message_index(void);
+static struct event_message_action *event_find_message_action(struct event_message *message, osbool (*action)(wimp_message *message));
+static osbool event_callback_is_before(struct event_callback *a, struct event_callback *b);
+static osbool event_insert_callback(struct event_callback *callback);
+static void event_remove_callback(struct event_callback *callback);
+static void event_move_callback_up(unsigned int index);
+static void event_move_callback_down(unsigned int index);
+static void event_purge_callbacks(struct event_window *window, osbool (*callback)(os_t time, void *data));
+static void event_free_callback(struct event_callback *callback);
 static void event_delete_window_callbacks(struct event_window *window);
 static osbool event_process_callbacks(os_t time);
+#ifdef SFLIB_PROFILE
+static os_t event_profile_get_time(void);
+static void event_profile_clear(struct event_profile *record);
+static void event_profile_record(struct event_profile *record, os_t start);
+static void event_profile_record_window(wimp_w w, enum event_profile_type type, os_t start);
+static void event_profile_report(char *name, unsigned int id, struct event_profile *record);
+#endif
 
 
 /* Accept and process a wimp event.
@@ -363,6 +478,12 @@ osbool event_process_event(wimp_event_no event, wimp_block *block, int pollword,
 		break;
 	}
 
+	/* Redraw any areas which were invalidated while handling the event,
+	 * before control returns to Wimp_Poll.
+	 */
+
+	windows_flush_redraws();
+
 	/* Return the time for the next poll, if required. Note that we avoid
 	 * returning zero unless the client should disable Null Events, and so
 	 * delay by 1 centisecond in the unlikely event that the poll falls
@@ -372,10 +493,10 @@ osbool event_process_event(wimp_event_no event, wimp_block *block, int pollword,
 	if (next != NULL) {
 		if (event_drag_null_poll != NULL)
 			*next = (time != 0) ? time : 1;
-		else if (event_callback_list == NULL)
+		else if (event_callback_count == 0)
 			*next = 0;
 		else
-			*next = (event_callback_list->time != 0) ? event_callback_list->time : 1;
+			*next = (event_callback_queue[0]->time != 0) ? event_callback_queue[0]->time : 1;
 	}
 
 	return result;
@@ -391,10 +512,28 @@ osbool event_process_event(wimp_event_no event, wimp_block *block, int pollword,
 
 static osbool event_process_null_reason_code(os_t time)
 {
-	if (event_drag_null_poll != NULL)
-		return (event_drag_null_poll)(event_drag_data);
+	osbool	result = FALSE;
+	os_t	now;
+
+	if (event_drag_null_poll != NULL) {
+		EVENT_PROFILE(event_profile_drags, result = (event_drag_null_poll)(event_drag_data));
+		return result;
+	}
 
-	return event_process_callbacks(time);
+	if (event_callback_budget == 0)
+		return event_process_callbacks(time);
+
+	/* Run every callback which was due at the time of the poll, until
+	 * the queue empties or the time budget has been used up.
+	 */
+
+	do {
+		if (event_process_callbacks(time))
+			result = TRUE;
+	} while (event_callback_count > 0 && (int) (event_callback_queue[0]->time - time) <= 0 &&
+			xos_read_monotonic_time(&now) == NULL && (int) (now - time) < (int) event_callback_budget);
+
+	return result;
 }
 
 
@@ -417,7 +556,7 @@ static osbool event_process_redraw_window_request(wimp_draw *draw)
 	if (win == NULL || win->redraw == NULL)
 		return FALSE;
 
-	(win->redraw)(draw);
+	EVENT_PROFILE_WINDOW(draw->w, EVENT_PROFILE_REDRAW, (win->redraw)(draw));
 
 	return TRUE;
 }
@@ -442,7 +581,7 @@ static osbool event_process_open_window_request(wimp_open *open)
 	if (win == NULL || win->open == NULL)
 		return FALSE;
 
-	(win->open)(open);
+	EVENT_PROFILE_WINDOW(open->w, EVENT_PROFILE_OPEN, (win->open)(open));
 
 	return TRUE;
 }
@@ -467,7 +606,7 @@ static osbool event_process_close_window_request(wimp_close *close)
 	if (win == NULL || win->close == NULL)
 		return FALSE;
 
-	(win->close)(close);
+	EVENT_PROFILE_WINDOW(close->w, EVENT_PROFILE_CLOSE, (win->close)(close));
 
 	return TRUE;
 }
@@ -492,7 +631,7 @@ static osbool event_process_pointer_leaving_window(wimp_leaving *leaving)
 	if (win == NULL || win->leaving == NULL)
 		return FALSE;
 
-	(win->leaving)(leaving);
+	EVENT_PROFILE_WINDOW(leaving->w, EVENT_PROFILE_LEAVING, (win->leaving)(leaving));
 	return TRUE;
 }
 
@@ -516,7 +655,7 @@ static osbool event_process_pointer_entering_window(wimp_entering *entering)
 	if (win == NULL || win->entering == NULL)
 		return FALSE;
 
-	(win->entering)(entering);
+	EVENT_PROFILE_WINDOW(entering->w, EVENT_PROFILE_ENTERING, (win->entering)(entering));
 	return TRUE;
 }
 
@@ -546,7 +685,7 @@ static osbool event_process_mouse_click(wimp_pointer *pointer)
 	if (pointer->buttons == wimp_CLICK_MENU && win->menu != NULL) {
 		new_client_menu = NULL;
 		if (win->menu_prepare != NULL)
-			(win->menu_prepare)(win->w, win->menu, pointer);
+			EVENT_PROFILE_WINDOW(win->w, EVENT_PROFILE_MENU, (win->menu_prepare)(win->w, win->menu, pointer));
 		if (new_client_menu != NULL)
 			win->menu = new_client_menu;
 		if (win->w == wimp_ICON_BAR)
@@ -573,7 +712,7 @@ static osbool event_process_mouse_click(wimp_pointer *pointer)
 	if (win->pointer == NULL)
 		return FALSE;
 
-	(win->pointer)(pointer);
+	EVENT_PROFILE_WINDOW(pointer->w, EVENT_PROFILE_POINTER, (win->pointer)(pointer));
 
 	return TRUE;
 }
@@ -601,7 +740,7 @@ static osbool event_process_icon(struct event_window *window, struct event_icon
 		switch (action->type) {
 		case EVENT_ICON_CLICK:
 			if (action->data.click.callback != NULL)
-				handled = action->data.click.callback(pointer);
+				EVENT_PROFILE_WINDOW(pointer->w, EVENT_PROFILE_ICON, handled = action->data.click.callback(pointer));
 			break;
 
 		case EVENT_ICON_RADIO:
@@ -614,7 +753,7 @@ static osbool event_process_icon(struct event_window *window, struct event_icon
 		case EVENT_ICON_POPUP_MANUAL:
 			new_client_menu = NULL;
 			if (window->menu_prepare != NULL && action->type != EVENT_ICON_POPUP_AUTO)
-				(window->menu_prepare)(window->w, action->data.popup.menu, pointer);
+				EVENT_PROFILE_WINDOW(window->w, EVENT_PROFILE_MENU, (window->menu_prepare)(window->w, action->data.popup.menu, pointer));
 			if (new_client_menu != NULL)
 				action->data.popup.menu = new_client_menu;
 			if (action->type == EVENT_ICON_POPUP_AUTO)
@@ -678,7 +817,7 @@ static osbool event_process_user_drag_box(wimp_dragged *dragged)
 	if (event_drag_end == NULL)
 		return FALSE;
 
-	(event_drag_end)(dragged, event_drag_data);
+	EVENT_PROFILE(event_profile_drags, (event_drag_end)(dragged, event_drag_data));
 
 	/* One-shot, so clear the function pointer. */
 
@@ -700,6 +839,7 @@ static osbool event_process_user_drag_box(wimp_dragged *dragged)
 static osbool event_process_key_pressed(wimp_key *key)
 {
 	struct event_window	*win = NULL;
+	osbool			handled;
 
 	if (key->w == NULL)
 		return FALSE;
@@ -709,7 +849,9 @@ static osbool event_process_key_pressed(wimp_key *key)
 	if (win == NULL || win->key == NULL)
 		return FALSE;
 
-	return (win->key)(key);
+	EVENT_PROFILE_WINDOW(key->w, EVENT_PROFILE_KEY, handled = (win->key)(key));
+
+	return handled;
 }
 
 
@@ -758,8 +900,9 @@ static osbool event_process_menu_selection(wimp_selection *selection)
 		event_set_auto_menu_selection(current_menu, current_menu_action, selection->items[0]);
 
 		if (current_menu_action->data.popup.callback != NULL)
-			complete = (current_menu_action->data.popup.callback)(current_menu->w, menu,
-					current_menu_action->data.popup.selection);
+			EVENT_PROFILE_WINDOW(current_menu->w, EVENT_PROFILE_MENU,
+					complete = (current_menu_action->data.popup.callback)(current_menu->w, menu,
+					current_menu_action->data.popup.selection));
 		else
 			complete = current_menu_action->data.popup.complete;
 	}
@@ -767,7 +910,7 @@ static osbool event_process_menu_selection(wimp_selection *selection)
 	/* Process the window-level callback if required. */
 
 	if (current_menu->menu_selection != NULL && complete == FALSE)
-		(current_menu->menu_selection)(current_menu->w, menu, selection);
+		EVENT_PROFILE_WINDOW(current_menu->w, EVENT_PROFILE_MENU, (current_menu->menu_selection)(current_menu->w, menu, selection));
 
 	/* If the client deletes itself as part of the menu_selection() callback,
 	 * there isn't anything else to be done as current_menu is no longer valid.
@@ -779,7 +922,7 @@ static osbool event_process_menu_selection(wimp_selection *selection)
 	if (pointer.buttons == wimp_CLICK_ADJUST) {
 		new_client_menu = NULL;
 		if (current_menu->menu_prepare != NULL && current_menu_type != EVENT_MENU_POPUP_AUTO)
-			(current_menu->menu_prepare)(current_menu->w, menu, NULL);
+			EVENT_PROFILE_WINDOW(current_menu->w, EVENT_PROFILE_MENU, (current_menu->menu_prepare)(current_menu->w, menu, NULL));
 		if (new_client_menu != NULL) {
 			switch (current_menu_type) {
 			case EVENT_MENU_WINDOW:
@@ -804,7 +947,7 @@ static osbool event_process_menu_selection(wimp_selection *selection)
 		}
 	} else {
 		if (current_menu->menu_close != NULL && current_menu_type != EVENT_MENU_POPUP_AUTO)
-			(current_menu->menu_close)(current_menu->w, menu);
+			EVENT_PROFILE_WINDOW(current_menu->w, EVENT_PROFILE_MENU, (current_menu->menu_close)(current_menu->w, menu));
 		current_menu = NULL;
 		current_menu_type = EVENT_MENU_NONE;
 		current_menu_icon = NULL;
@@ -835,7 +978,7 @@ static osbool event_process_scroll_request(wimp_scroll *scroll)
 	if (win == NULL || win->scroll == NULL)
 		return FALSE;
 
-	(win->scroll)(scroll);
+	EVENT_PROFILE_WINDOW(scroll->w, EVENT_PROFILE_SCROLL, (win->scroll)(scroll));
 		return TRUE;
 }
 
@@ -859,7 +1002,7 @@ static osbool event_process_lose_caret(wimp_caret *caret)
 	if (win == NULL || win->lose_caret == NULL)
 		return FALSE;
 
-	(win->lose_caret)(caret);
+	EVENT_PROFILE_WINDOW(caret->w, EVENT_PROFILE_CARET, (win->lose_caret)(caret));
 
 	return TRUE;
 }
@@ -884,7 +1027,7 @@ static osbool event_process_gain_caret(wimp_caret *caret)
 	if (win == NULL || win->gain_caret == NULL)
 		return FALSE;
 
-	(win->gain_caret)(caret);
+	EVENT_PROFILE_WINDOW(caret->w, EVENT_PROFILE_CARET, (win->gain_caret)(caret));
 
 	return TRUE;
 }
@@ -903,7 +1046,7 @@ static osbool event_process_user_message(wimp_event_no event, wimp_message *mess
 	struct event_message			*msg = NULL;
 	struct event_message_action		*action = NULL;
 	enum event_message_type			type;
-	osbool					special = FALSE;
+	osbool					special = FALSE, claimed;
 	wimp_full_message_menus_deleted		*menus_deleted;
 
 	if (event != wimp_USER_MESSAGE_ACKNOWLEDGE) {
@@ -914,7 +1057,7 @@ static osbool event_process_user_message(wimp_event_no event, wimp_message *mess
 					((current_menu_type == EVENT_MENU_POPUP_MANUAL || current_menu_type == EVENT_MENU_POPUP_MANUAL) &&
 							current_menu_action->data.popup.menu == menus_deleted->menu))  ) {
 				if (current_menu->menu_close != NULL && current_menu_type != EVENT_MENU_POPUP_AUTO)
-					(current_menu->menu_close)(current_menu->w, menus_deleted->menu);
+					EVENT_PROFILE_WINDOW(current_menu->w, EVENT_PROFILE_MENU, (current_menu->menu_close)(current_menu->w, menus_deleted->menu));
 				current_menu = NULL;
 				current_menu_type = EVENT_MENU_NONE;
 				current_menu_icon = NULL;
@@ -927,7 +1070,8 @@ static osbool event_process_user_message(wimp_event_no event, wimp_message *mess
 		case message_MENU_WARNING:
 			if (current_menu != NULL) {
 				if (current_menu->menu_warning != NULL && current_menu_type != EVENT_MENU_POPUP_AUTO)
-					(current_menu->menu_warning)(current_menu->w, current_menu->menu, (wimp_message_menu_warning *) &(message->data));
+					EVENT_PROFILE_WINDOW(current_menu->w, EVENT_PROFILE_MENU,
+							(current_menu->menu_warning)(current_menu->w, current_menu->menu, (wimp_message_menu_warning *) &(message->data)));
 				special = TRUE;
 			}
 			break;
@@ -954,15 +1098,27 @@ static osbool event_process_user_message(wimp_event_no event, wimp_message *mess
 		break;
 	}
 
+	event_messages_received++;
+
 	msg = event_find_message(message->action);
 
+	if (msg == NULL || msg->actions == NULL)
+		event_messages_rejected++;
+
 	if (msg != NULL && msg->actions != NULL) {
 		action = msg->actions;
 
 		while (action != NULL) {
-			if ((action->type & type) != 0 && action->action != NULL)
-				if (action->action(message))
+			if ((action->type & type) != 0 && action->action != NULL) {
+				action->calls++;
+
+				EVENT_PROFILE(action->profile, claimed = action->action(message));
+
+				if (claimed) {
+					action->claims++;
 					return TRUE;
+				}
+			}
 
 			action = action->next;
 		}
@@ -1692,6 +1848,113 @@ void *event_get_window_user_data(wimp_w w)
 }
 
 
+/* Choose whether event blocks are allocated from a single shared pool.
+ *
+ * This function is an external interface, documented in event.h.
+ */
+
+osbool event_set_shared_pool(osbool shared)
+{
+	if (event_pools_used)
+		return FALSE;
+
+	event_pools_shared = shared;
+
+	return TRUE;
+}
+
+
+/**
+ * Allocate an event block from the appropriate pool, creating the pool
+ * if it doesn't yet exist.
+ *
+ * \param type		The type of block to allocate.
+ * \return		Pointer to the new block, or NULL on failure.
+ */
+
+static void *event_alloc_block(enum event_pool_type type)
+{
+	enum event_pool_type	t;
+	size_t			size;
+
+	if (type < 0 || type >= EVENT_POOLS)
+		return NULL;
+
+	/* In shared mode, all of the blocks come from the first pool, which
+	 * is sized to hold the largest of them.
+	 */
+
+	if (event_pools_shared)
+		type = EVENT_POOL_WINDOW;
+
+	if (event_pools[type] == NULL) {
+		size = event_get_block_size(type);
+
+		if (event_pools_shared) {
+			for (t = 0; t < EVENT_POOLS; t++) {
+				if (event_get_block_size(t) > size)
+					size = event_get_block_size(t);
+			}
+		}
+
+		event_pools[type] = pool_create(size, (type == EVENT_POOL_WINDOW || type == EVENT_POOL_MESSAGE) ? EVENT_POOL_SMALL_SLAB : 0);
+		if (event_pools[type] == NULL)
+			return NULL;
+	}
+
+	event_pools_used = TRUE;
+
+	return pool_alloc(event_pools[type]);
+}
+
+
+/**
+ * Return an event block to the pool that it was allocated from.
+ *
+ * \param type		The type of block to free.
+ * \param *block		The block to be freed.
+ */
+
+static void event_free_block(enum event_pool_type type, void *block)
+{
+	if (block == NULL || type < 0 || type >= EVENT_POOLS)
+		return;
+
+	if (event_pools_shared)
+		type = EVENT_POOL_WINDOW;
+
+	pool_free(event_pools[type], block);
+}
+
+
+/**
+ * Return the size of an event block.
+ *
+ * \param type		The type of block of interest.
+ * \return		The size of the block, in bytes.
+ */
+
+static size_t event_get_block_size(enum event_pool_type type)
+{
+	switch (type) {
+	case EVENT_POOL_WINDOW:
+		return sizeof(struct event_window);
+	case EVENT_POOL_ICON:
+		return sizeof(struct event_icon);
+	case EVENT_POOL_ICON_ACTION:
+		return sizeof(struct event_icon_action);
+	case EVENT_POOL_MESSAGE:
+		return sizeof(struct event_message);
+	case EVENT_POOL_MESSAGE_ACTION:
+		return sizeof(struct event_message_action);
+	case EVENT_POOL_CALLBACK:
+		return sizeof(struct event_callback);
+	default:
+		return 0;
+	}
+}
+
+
 /* Remove a window and its associated event details from the records.
  *
  * This function is an external interface, documented in event.h.
@@ -1701,6 +1964,9 @@ void event_delete_window(wimp_w w)
 {
 	struct event_window		*block, *parent;
 
+	icons_invalidate_window_cache(w);
+	windows_cancel_redraws(w);
+
 	block = event_find_window(w);
 
 	if (block != NULL) {
@@ -1713,8 +1979,14 @@ void event_delete_window(wimp_w w)
 		while (block->icons != NULL)
 			event_delete_icon_block(block, block->icons);
 
+		if (block->icon_index != NULL)
+			hash_destroy(block->icon_index);
+
 		/* Delete the window itself. */
 
+		if (event_window_index != NULL)
+			hash_remove(event_window_index, (unsigned int) w);
+
 		if (event_window_list == block) {
 			event_window_list = block->next;
 		} else {
@@ -1732,8 +2004,62 @@ void event_delete_window(wimp_w w)
 			event_clear_current_menu(current_menu->menu);
 		}
 
-		free(block);
+		event_free_block(EVENT_POOL_WINDOW, block);
+	}
+}
+
+
+/* Enable or disable the hashed indexes used to look up windows and icons
+ * when dispatching events.
+ *
+ * This function is an external interface, documented in event.h.
+ */
+
+osbool event_set_hashed_lookup(osbool enable)
+{
+	struct event_window	*window;
+	unsigned int		count = 0;
+
+	/* Disabling the indexes, or resetting them after a failure. */
+
+	if (!enable) {
+		for (window = event_window_list; window != NULL; window = window->next) {
+			if (window->icon_index != NULL) {
+				hash_destroy(window->icon_index);
+				window->icon_index = NULL;
+			}
+		}
+
+		if (event_window_index != NULL) {
+			hash_destroy(event_window_index);
+			event_window_index = NULL;
+		}
+
+		return TRUE;
+	}
+
+	if (event_window_index != NULL)
+		return TRUE;
+
+	/* Build the window index from the existing window list. */
+
+	for (window = event_window_list; window != NULL; window = window->next)
+		count++;
+
+	event_window_index = hash_create(count);
+	if (event_window_index == NULL)
+		return FALSE;
+
+	for (window = event_window_list; window != NULL; window = window->next) {
+		if (!hash_add(event_window_index, (unsigned int) window->w, window)) {
+			event_set_hashed_lookup(FALSE);
+			return FALSE;
+		}
+
+		event_build_icon_index(window);
 	}
+
+	return TRUE;
 }
 
 
@@ -1748,6 +2074,9 @@ static struct event_window *event_find_window(wimp_w w)
 {
 	struct event_window	*block = NULL;
 
+	if (w != NULL && event_window_index != NULL)
+		return hash_find(event_window_index, (unsigned int) w);
+
 	if (w != NULL) {
 		block = event_window_list;
 
@@ -1769,6 +2098,9 @@ static struct event_window *event_find_window(wimp_w w)
 static struct event_window *event_create_window(wimp_w w)
 {
 	struct event_window	*block;
+#ifdef SFLIB_PROFILE
+	int			i;
+#endif
 
 	/* Just in case we try and create a new block for an existing window. */
 
@@ -1779,7 +2111,7 @@ static struct event_window *event_create_window(wimp_w w)
 
 	/* There isn't a block in the list, so create and link a new one. */
 
-	block = (struct event_window *) malloc(sizeof(struct event_window));
+	block = (struct event_window *) event_alloc_block(EVENT_POOL_WINDOW);
 
 	if (block != NULL) {
 		block->w = w;
@@ -1805,9 +2137,20 @@ static struct event_window *event_create_window(wimp_w w)
 		block->data = NULL;
 
 		block->icons = NULL;
+		block->icon_index = NULL;
+
+#ifdef SFLIB_PROFILE
+		for (i = 0; i < EVENT_PROFILE_TYPES; i++)
+			event_profile_clear(&(block->profile[i]));
+#endif
 
 		block->next = event_window_list;
 		event_window_list = block;
+
+		/* If the window index can't be extended, fall back to the list. */
+
+		if (event_window_index != NULL && !hash_add(event_window_index, (unsigned int) w, block))
+			event_set_hashed_lookup(FALSE);
 	}
 
 	return block;
@@ -1824,6 +2167,8 @@ void event_delete_icon(wimp_w w, wimp_i i)
 	struct event_window		*window;
 	struct event_icon		*icon;
 
+	icons_invalidate_window_cache(w);
+
 	window = event_find_window(w);
 
 	if (window == NULL)
@@ -1854,6 +2199,9 @@ static void event_delete_icon_block(struct event_window *window, struct event_ic
 
 	/* Link the icon out of the window's chain. */
 
+	if (window->icon_index != NULL)
+		hash_remove(window->icon_index, (unsigned int) icon->i);
+
 	if (window->icons == icon) {
 		window->icons = icon->next;
 	} else {
@@ -1872,10 +2220,10 @@ static void event_delete_icon_block(struct event_window *window, struct event_ic
 		if ((action->type == EVENT_ICON_POPUP_AUTO || action->type == EVENT_ICON_POPUP_MANUAL) &&
 				action->data.popup.token != NULL)
 			free(action->data.popup.token);
-		free(action);
+		event_free_block(EVENT_POOL_ICON_ACTION, action);
 	}
 
-	free(icon);
+	event_free_block(EVENT_POOL_ICON, icon);
 }
 
 
@@ -1891,6 +2239,9 @@ static struct event_icon *event_find_icon(struct event_window *window, wimp_i i)
 {
 	struct event_icon	*block = NULL;
 
+	if (window != NULL && i >= 0 && window->icon_index != NULL)
+		return hash_find(window->icon_index, (unsigned int) i);
+
 	if (window != NULL && i >= 0) {
 		block = window->icons;
 
@@ -1923,7 +2274,7 @@ static struct event_icon *event_create_icon(struct event_window *window, wimp_i
 	if (block != NULL)
 		return block;
 
-	block = (struct event_icon *) malloc(sizeof(struct event_icon));
+	block = (struct event_icon *) event_alloc_block(EVENT_POOL_ICON);
 
 	if (block != NULL) {
 		block->i = i;
@@ -1932,6 +2283,16 @@ static struct event_icon *event_create_icon(struct event_window *window, wimp_i
 
 		block->next = window->icons;
 		window->icons = block;
+
+		/* If the icon index can't be extended, fall back to the list. */
+
+		if (window->icon_index != NULL && !hash_add(window->icon_index, (unsigned int) i, block)) {
+			hash_destroy(window->icon_index);
+			window->icon_index = NULL;
+		}
+
+		if (window->icon_index == NULL && event_window_index != NULL)
+			event_build_icon_index(window);
 	}
 
 	return block;
@@ -1939,6 +2300,35 @@ static struct event_icon *event_create_icon(struct event_window *window, wimp_i
 }
 
 
+/**
+ * Build a hashed index of the icons in a window, if one doesn't already
+ * exist. If there isn't enough memory, the window is left without an index
+ * and icon lookups will fall back to searching the chain.
+ *
+ * \param *window	The window to build the icon index for.
+ */
+
+static void event_build_icon_index(struct event_window *window)
+{
+	struct event_icon	*icon;
+
+	if (window == NULL || window->icon_index != NULL)
+		return;
+
+	window->icon_index = hash_create(0);
+	if (window->icon_index == NULL)
+		return;
+
+	for (icon = window->icons; icon != NULL; icon = icon->next) {
+		if (!hash_add(window->icon_index, (unsigned int) icon->i, icon)) {
+			hash_destroy(window->icon_index);
+			window->icon_index = NULL;
+			return;
+		}
+	}
+}
+
+
 /**
  * Find the action data block for the given action in the specified icon.
  *
@@ -1983,7 +2373,7 @@ static struct event_icon_action *event_create_action(struct event_icon *icon, en
 	if (block != NULL)
 		return block;
 
-	block = malloc(sizeof(struct event_icon_action));
+	block = event_alloc_block(EVENT_POOL_ICON_ACTION);
 
 	if (block != NULL) {
 		block->type = type;
@@ -2053,7 +2443,7 @@ osbool event_add_message_handler(unsigned int message, enum event_message_type t
 	block = event_find_message(message);
 
 	if (block == NULL) {
-		block = malloc(sizeof(struct event_message));
+		block = event_alloc_block(EVENT_POOL_MESSAGE);
 
 		if (block == NULL)
 			return FALSE;
@@ -2063,6 +2453,18 @@ osbool event_add_message_handler(unsigned int message, enum event_message_type t
 		block->next = event_message_list;
 		event_message_list = block;
 
+		/* Index the new message, or try to build the index from scratch
+		 * if it doesn't exist. Failure leaves messages to be found from
+		 * the list.
+		 */
+
+		if (event_message_index == NULL) {
+			event_build_message_index();
+		} else if (!hash_add(event_message_index, message, block)) {
+			hash_destroy(event_message_index);
+			event_message_index = NULL;
+		}
+
 		if (message != message_QUIT) {
 			message_list.messages[0]=message;
 			message_list.messages[1]=message_QUIT;
@@ -2075,19 +2477,60 @@ osbool event_add_message_handler(unsigned int message, enum event_message_type t
 
 	/* Create a new action for the message. */
 
-	action = malloc(sizeof(struct event_message_action));
+	action = event_alloc_block(EVENT_POOL_MESSAGE_ACTION);
 
 	if (action == NULL)
 		return FALSE;
 
 	action->type = type;
 	action->action = message_action;
+	action->calls = 0;
+	action->claims = 0;
+#ifdef SFLIB_PROFILE
+	event_profile_clear(&(action->profile));
+#endif
 	action->next = block->actions;
 	block->actions = action;
 
 	return TRUE;
 }
 
+
+/* Read the dispatch statistics for a message handler.
+ *
+ * This function is an external interface, documented in event.h.
+ */
+
+osbool event_get_message_handler_stats(unsigned int message, osbool (*message_action)(wimp_message *message), unsigned int *calls, unsigned int *claims)
+{
+	struct event_message_action	*action;
+
+	action = event_find_message_action(event_find_message(message), message_action);
+
+	if (calls != NULL)
+		*calls = (action != NULL) ? action->calls : 0;
+
+	if (claims != NULL)
+		*claims = (action != NULL) ? action->claims : 0;
+
+	return (action != NULL) ? TRUE : FALSE;
+}
+
+
+/* Read the overall user message statistics.
+ *
+ * This function is an external interface, documented in event.h.
+ */
+
+void event_get_message_stats(unsigned int *received, unsigned int *rejected)
+{
+	if (received != NULL)
+		*received = event_messages_received;
+
+	if (rejected != NULL)
+		*rejected = event_messages_rejected;
+}
+
 /**
  * Find the message block for the given message.
  *
@@ -2099,6 +2542,9 @@ static struct event_message *event_find_message(int message)
 {
 	struct event_message	*block = NULL;
 
+	if (event_message_index != NULL)
+		return hash_find(event_message_index, message);
+
 	block = event_message_list;
 
 	while (block != NULL && block->message != message)
@@ -2108,6 +2554,56 @@ static struct event_message *event_find_message(int message)
 }
 
 
+/**
+ * Build a hashed index of the registered messages from the message list.
+ * If there isn't enough memory, the index is left unavailable and messages
+ * will be found by searching the list.
+ */
+
+static void event_build_message_index(void)
+{
+	struct event_message	*block;
+
+	if (event_message_index != NULL)
+		return;
+
+	event_message_index = hash_create(0);
+	if (event_message_index == NULL)
+		return;
+
+	for (block = event_message_list; block != NULL; block = block->next) {
+		if (!hash_add(event_message_index, block->message, block)) {
+			hash_destroy(event_message_index);
+			event_message_index = NULL;
+			return;
+		}
+	}
+}
+
+
+/**
+ * Find the action for a given handler function attached to a message.
+ *
+ * \param *message	The message block to search, or NULL.
+ * \param *action	The handler function to find.
+ * \return		A pointer to the action structure, or NULL.
+ */
+
+static struct event_message_action *event_find_message_action(struct event_message *message, osbool (*action)(wimp_message *message))
+{
+	struct event_message_action	*block = NULL;
+
+	if (message != NULL) {
+		block = message->actions;
+
+		while (block != NULL && block->action != action)
+			block = block->next;
+	}
+
+	return block;
+}
+
+
 /* Set a handler for the next drag box event and any Null Polls in between.
  * If either handler is NULL it will not be called; both will be cancelled on
  * the next User_Drag_Box event to be received.
@@ -2197,7 +2693,7 @@ void event_set_menu_block(wimp_menu *menu)
 
 osbool event_add_single_callback(wimp_w w, os_t delay, osbool (*callback)(os_t time, void *data), void *data)
 {
-	return event_add_regular_callback(w, delay, 0, callback, data);
+	return (event_add_callback(w, delay, 0, callback, data) != 0) ? TRUE : FALSE;
 }
 
 
@@ -2208,6 +2704,19 @@ osbool event_add_single_callback(wimp_w w, os_t delay, osbool (*callback)(os_t t
  */
 
 osbool event_add_regular_callback(wimp_w w, os_t delay, os_t interval, osbool (*callback)(os_t time, void *data), void *data)
+{
+	return (event_add_callback(w, delay, interval, callback, data) != 0) ? TRUE : FALSE;
+}
+
+
+/**
+ * Add a new callback to the callback queue, returning a handle by which
+ * it can be cancelled.
+ *
+ * This function is an external interface, documented in event.h.
+ */
+
+unsigned int event_add_callback(wimp_w w, os_t delay, os_t interval, osbool (*callback)(os_t time, void *data), void *data)
 {
 	struct event_callback	*new;
 	struct event_window	*window = NULL;
@@ -2216,52 +2725,240 @@ osbool event_add_regular_callback(wimp_w w, os_t delay, os_t interval, osbool (*
 	/* Find the current time, to act as a base for the delay. */
 
 	if (xos_read_monotonic_time(&time) != NULL)
-		return FALSE;
+		return 0;
+
+	/* Create the handle index, if it doesn't already exist. */
+
+	if (event_callback_handles == NULL) {
+		event_callback_handles = hash_create(0);
+		if (event_callback_handles == NULL)
+			return 0;
+	}
 
 	/* Create a new callback block. */
 
-	new = (struct event_callback *) malloc(sizeof(struct event_callback));
+	new = (struct event_callback *) event_alloc_block(EVENT_POOL_CALLBACK);
 	if (new == NULL)
-		return FALSE;
+		return 0;
 
 	/* Find the associated window block, if required. */
 
 	if (w != NULL)
 		window = event_create_window(w);
 
-	/* Fill in the callback data. */
+	/* Fill in the callback data, allocating a handle which isn't zero. */
+
+	new->handle = event_callback_next_handle++;
+	if (event_callback_next_handle == 0)
+		event_callback_next_handle = 1;
 
 	new->time = time + delay;
 	new->interval = interval;
 	new->callback = callback;
 	new->data = data;
 	new->window = window;
-	new->next = NULL;
 
-	/* Add the callback to the list. */
+	/* Add the callback to the handle index and the queue. */
+
+	if (!hash_add(event_callback_handles, new->handle, new)) {
+		event_free_block(EVENT_POOL_CALLBACK, new);
+		return 0;
+	}
+
+	if (!event_insert_callback(new)) {
+		event_free_callback(new);
+		return 0;
+	}
+
+	return new->handle;
+}
 
-	event_insert_callback(new);
+
+/**
+ * Cancel a callback, using the handle returned when it was added.
+ *
+ * This function is an external interface, documented in event.h.
+ */
+
+osbool event_cancel_callback(unsigned int handle)
+{
+	struct event_callback	*callback;
+
+	callback = hash_find(event_callback_handles, handle);
+	if (callback == NULL)
+		return FALSE;
+
+	/* A callback can't be freed while its handler is running, so flag it
+	 * for deletion once the handler returns.
+	 */
+
+	if (callback == event_callback_running) {
+		event_callback_cancelled = TRUE;
+		return TRUE;
+	}
+
+	event_remove_callback(callback);
+	event_free_callback(callback);
 
 	return TRUE;
 }
 
 
+/**
+ * Set the time budget available for processing callbacks on each Null Poll.
+ *
+ * This function is an external interface, documented in event.h.
+ */
+
+void event_set_callback_budget(os_t budget)
+{
+	event_callback_budget = budget;
+}
+
+
+/**
+ * Test whether one callback falls due before another. Callbacks which fall
+ * due at the same time are taken in the order that they were queued.
+ *
+ * \param *a			The first callback to be compared.
+ * \param *b			The second callback to be compared.
+ * \return			TRUE if a falls due before b; else FALSE.
+ */
+
+static osbool event_callback_is_before(struct event_callback *a, struct event_callback *b)
+{
+	if (a->time != b->time)
+		return ((int) (a->time - b->time) < 0) ? TRUE : FALSE;
+
+	return ((int) (a->sequence - b->sequence) < 0) ? TRUE : FALSE;
+}
+
+
 /**
  * Insert a callback into the callback queue, at the correct location
  * based on its next time.
  *
  * \param *callback		The callback to be inserted.
+ * \return			TRUE if successful; FALSE if there was no memory.
  */
 
-static void event_insert_callback(struct event_callback *callback)
+static osbool event_insert_callback(struct event_callback *callback)
 {
-	struct event_callback **list = &event_callback_list;
+	struct event_callback	**queue;
+	unsigned int		allocation;
+
+	if (event_callback_count >= event_callback_allocation) {
+		allocation = (event_callback_allocation == 0) ? EVENT_CALLBACK_QUEUE_SIZE : event_callback_allocation * 2;
+
+		queue = realloc(event_callback_queue, allocation * sizeof(struct event_callback *));
+		if (queue == NULL)
+			return FALSE;
+
+		event_callback_queue = queue;
+		event_callback_allocation = allocation;
+	}
+
+	callback->sequence = event_callback_sequence++;
+	callback->index = event_callback_count++;
+	event_callback_queue[callback->index] = callback;
 
-	while ((*list != NULL) && (callback->time - (((*list)->time)) >= 0))
-		list = &((*list)->next);
+	event_move_callback_up(callback->index);
 
-	callback->next = *list;
-	*list = callback;
+	return TRUE;
+}
+
+
+/**
+ * Remove a callback from the callback queue, without freeing it.
+ *
+ * \param *callback		The callback to be removed.
+ */
+
+static void event_remove_callback(struct event_callback *callback)
+{
+	unsigned int	index;
+
+	index = callback->index;
+
+	if (index >= event_callback_count || event_callback_queue[index] != callback)
+		return;
+
+	/* Move the last entry in the queue into the gap, then let it find its
+	 * correct place.
+	 */
+
+	event_callback_count--;
+
+	if (index == event_callback_count)
+		return;
+
+	event_callback_queue[index] = event_callback_queue[event_callback_count];
+	event_callback_queue[index]->index = index;
+
+	event_move_callback_up(index);
+	event_move_callback_down(event_callback_queue[index]->index);
+}
+
+
+/**
+ * Move a callback up the queue towards the head, until it is in the correct
+ * position relative to its parents.
+ *
+ * \param index			The index of the callback to move.
+ */
+
+static void event_move_callback_up(unsigned int index)
+{
+	struct event_callback	*callback;
+	unsigned int		parent;
+
+	callback = event_callback_queue[index];
+
+	while (index > 0) {
+		parent = (index - 1) / 2;
+
+		if (!event_callback_is_before(callback, event_callback_queue[parent]))
+			break;
+
+		event_callback_queue[index] = event_callback_queue[parent];
+		event_callback_queue[index]->index = index;
+		index = parent;
+	}
+
+	event_callback_queue[index] = callback;
+	callback->index = index;
+}
+
+
+/**
+ * Move a callback down the queue away from the head, until it is in the
+ * correct position relative to its children.
+ *
+ * \param index			The index of the callback to move.
+ */
+
+static void event_move_callback_down(unsigned int index)
+{
+	struct event_callback	*callback;
+	unsigned int		child;
+
+	callback = event_callback_queue[index];
+
+	while ((child = (2 * index) + 1) < event_callback_count) {
+		if (child + 1 < event_callback_count &&
+				event_callback_is_before(event_callback_queue[child + 1], event_callback_queue[child]))
+			child++;
+
+		if (!event_callback_is_before(event_callback_queue[child], callback))
+			break;
+
+		event_callback_queue[index] = event_callback_queue[child];
+		event_callback_queue[index]->index = index;
+		index = child;
+	}
+
+	event_callback_queue[index] = callback;
+	callback->index = index;
 }
 
 
@@ -2273,17 +2970,8 @@ static void event_insert_callback(struct event_callback *callback)
 
 void event_delete_callback(osbool (*callback)(os_t time, void *data))
 {
-	struct event_callback **list = &event_callback_list, *delete;
-
-	while (*list != NULL) {
-		if ((*list)->callback == callback) {
-			delete = *list;
-			*list = (*list)->next;
-			free(delete);
-		} else {
-			list = &((*list)->next);
-		}
-	}
+	if (callback != NULL)
+		event_purge_callbacks(NULL, callback);
 }
 
 
@@ -2295,17 +2983,70 @@ void event_delete_callback(osbool (*callback)(os_t time, void *data))
 
 static void event_delete_window_callbacks(struct event_window *window)
 {
-	struct event_callback **list = &event_callback_list, *delete;
+	if (window != NULL)
+		event_purge_callbacks(window, NULL);
+}
+
+
+/**
+ * Delete all the callbacks in the queue which match either a window or a
+ * callback function, then rebuild the queue from those which remain.
+ *
+ * \param *window		The window to match, or NULL.
+ * \param *callback		The callback function to match, or NULL.
+ */
+
+static void event_purge_callbacks(struct event_window *window, osbool (*callback)(os_t time, void *data))
+{
+	struct event_callback	*entry;
+	unsigned int		i, count = 0;
+
+	/* If the running callback matches, flag it for deletion on return. */
+
+	entry = event_callback_running;
+
+	if (entry != NULL && ((window != NULL && entry->window == window) || (callback != NULL && entry->callback == callback)))
+		event_callback_cancelled = TRUE;
+
+	/* Free the matching callbacks from the queue, closing up the gaps. */
 
-	while (*list != NULL) {
-		if ((*list)->window == window) {
-			delete = *list;
-			*list = (*list)->next;
-			free(delete);
+	for (i = 0; i < event_callback_count; i++) {
+		entry = event_callback_queue[i];
+
+		if ((window != NULL && entry->window == window) || (callback != NULL && entry->callback == callback)) {
+			event_free_callback(entry);
 		} else {
-			list = &((*list)->next);
+			entry->index = count;
+			event_callback_queue[count++] = entry;
 		}
 	}
+
+	if (count == event_callback_count)
+		return;
+
+	event_callback_count = count;
+
+	/* Restore the heap order, working back from the last parent. */
+
+	for (i = count / 2; i > 0; i--)
+		event_move_callback_down(i - 1);
+}
+
+
+/**
+ * Free a callback block and remove its handle from the index. The callback
+ * must already have been removed from the queue.
+ *
+ * \param *callback		The callback to be freed.
+ */
+
+static void event_free_callback(struct event_callback *callback)
+{
+	if (callback == NULL)
+		return;
+
+	hash_remove(event_callback_handles, callback->handle);
+	event_free_block(EVENT_POOL_CALLBACK, callback);
 }
 
 
@@ -2319,25 +3060,37 @@ static void event_delete_window_callbacks(struct event_window *window)
 
 static osbool event_process_callbacks(os_t time)
 {
-	struct event_callback	*callback = event_callback_list;
+	struct event_callback	*callback;
 	osbool			result = FALSE;
 
 	/* If there's no callback waiting, or the next one isn't due, return. */
 
-	if ((callback == NULL) || (callback->time - time) > 0)
+	if (event_callback_count == 0)
+		return FALSE;
+
+	callback = event_callback_queue[0];
+
+	if ((int) (callback->time - time) > 0)
 		return FALSE;
 
-	/* Remove the event to be processed from the list, and call its callback. */
+	/* Remove the event to be processed from the queue, and call its callback. */
+
+	event_remove_callback(callback);
 
-	event_callback_list = callback->next;
+	event_callback_running = callback;
+	event_callback_cancelled = FALSE;
 
 	if (callback->callback != NULL)
-		result = callback->callback(time, callback->data);
+		EVENT_PROFILE(event_profile_callbacks, result = callback->callback(time, callback->data));
 
-	/* If this is a one-shot, free the memory and return. */
+	event_callback_running = NULL;
+
+	/* If this is a one-shot, or it was cancelled by its handler, free the
+	 * memory and return.
+	 */
 
-	if (callback->interval == 0) {
-		free(callback);
+	if (callback->interval == 0 || event_callback_cancelled) {
+		event_free_callback(callback);
 		return result;
 	}
 
@@ -2346,10 +3099,212 @@ static osbool event_process_callbacks(os_t time)
 	 * period.
 	 */
 
-	while ((callback->time - time) <= 0)
+	while ((int) (callback->time - time) <= 0)
 		callback->time += callback->interval;
 
-	event_insert_callback(callback);
+	if (!event_insert_callback(callback))
+		event_free_callback(callback);
 
 	return result;
 }
+
+#ifdef SFLIB_PROFILE
+
+/* Read the profiling details for one of a window's handler types.
+ *
+ * This function is an external interface, documented in event.h.
+ */
+
+osbool event_profile_read_window(wimp_w w, enum event_profile_type type, unsigned int *calls, os_t *total, os_t *max)
+{
+	struct event_window	*window;
+	struct event_profile	*record = NULL;
+
+	window = event_find_window(w);
+
+	if (window != NULL && type >= 0 && type < EVENT_PROFILE_TYPES)
+		record = &(window->profile[type]);
+
+	if (calls != NULL)
+		*calls = (record != NULL) ? record->calls : 0;
+
+	if (total != NULL)
+		*total = (record != NULL) ? record->total : 0;
+
+	if (max != NULL)
+		*max = (record != NULL) ? record->max : 0;
+
+	return (record != NULL) ? TRUE : FALSE;
+}
+
+
+/* Read the profiling details for a message handler.
+ *
+ * This function is an external interface, documented in event.h.
+ */
+
+osbool event_profile_read_message_handler(unsigned int message, osbool (*message_action)(wimp_message *message), unsigned int *calls, os_t *total, os_t *max)
+{
+	struct event_message_action	*action;
+
+	action = event_find_message_action(event_find_message(message), message_action);
+
+	if (calls != NULL)
+		*calls = (action != NULL) ? action->profile.calls : 0;
+
+	if (total != NULL)
+		*total = (action != NULL) ? action->profile.total : 0;
+
+	if (max != NULL)
+		*max = (action != NULL) ? action->profile.max : 0;
+
+	return (action != NULL) ? TRUE : FALSE;
+}
+
+
+/* Write a report of all the profiling details to Reporter.
+ *
+ * This function is an external interface, documented in event.h.
+ */
+
+void event_profile_dump(void)
+{
+	struct event_window		*window;
+	struct event_message		*message;
+	struct event_message_action	*action;
+	int				i;
+
+	debug_printf("Event profile: %u messages received, %u rejected", event_messages_received, event_messages_rejected);
+
+	event_profile_report("Callbacks", 0, &event_profile_callbacks);
+	event_profile_report("Drags", 0, &event_profile_drags);
+
+	for (window = event_window_list; window != NULL; window = window->next) {
+		for (i = 0; i < EVENT_PROFILE_TYPES; i++) {
+			if (window->profile[i].calls > 0)
+				event_profile_report(event_profile_names[i], (unsigned int) window->w, &(window->profile[i]));
+		}
+	}
+
+	for (message = event_message_list; message != NULL; message = message->next) {
+		for (action = message->actions; action != NULL; action = action->next) {
+			if (action->profile.calls > 0)
+				event_profile_report("Message", message->message, &(action->profile));
+		}
+	}
+}
+
+
+/* Reset all of the profiling details.
+ *
+ * This function is an external interface, documented in event.h.
+ */
+
+void event_profile_reset(void)
+{
+	struct event_window		*window;
+	struct event_message		*message;
+	struct event_message_action	*action;
+	int				i;
+
+	event_profile_clear(&event_profile_callbacks);
+	event_profile_clear(&event_profile_drags);
+
+	for (window = event_window_list; window != NULL; window = window->next) {
+		for (i = 0; i < EVENT_PROFILE_TYPES; i++)
+			event_profile_clear(&(window->profile[i]));
+	}
+
+	for (message = event_message_list; message != NULL; message = message->next) {
+		for (action = message->actions; action != NULL; action = action->next)
+			event_profile_clear(&(action->profile));
+	}
+}
+
+
+/**
+ * Read the current time for profiling purposes.
+ *
+ * \return			The current monotonic time, or 0 on failure.
+ */
+
+static os_t event_profile_get_time(void)
+{
+	os_t	time = 0;
+
+	xos_read_monotonic_time(&time);
+
+	return time;
+}
+
+
+/**
+ * Clear a profile record.
+ *
+ * \param *record		The record to clear.
+ */
+
+static void event_profile_clear(struct event_profile *record)
+{
+	record->calls = 0;
+	record->total = 0;
+	record->max = 0;
+}
+
+
+/**
+ * Update a profile record following a call to a handler.
+ *
+ * \param *record		The record to update.
+ * \param start			The time at which the handler was called.
+ */
+
+static void event_profile_record(struct event_profile *record, os_t start)
+{
+	os_t	elapsed;
+
+	elapsed = event_profile_get_time() - start;
+
+	record->calls++;
+	record->total += elapsed;
+
+	if (elapsed > record->max)
+		record->max = elapsed;
+}
+
+
+/**
+ * Update one of a window's profile records following a call to a handler,
+ * so long as the window still exists.
+ *
+ * \param w			The window whose handler was called.
+ * \param type			The type of handler which was called.
+ * \param start			The time at which the handler was called.
+ */
+
+static void event_profile_record_window(wimp_w w, enum event_profile_type type, os_t start)
+{
+	struct event_window	*window;
+
+	window = event_find_window(w);
+
+	if (window != NULL)
+		event_profile_record(&(window->profile[type]), start);
+}
+
+
+/**
+ * Write a profile record to Reporter.
+ *
+ * \param *name			The name of the record.
+ * \param id			A window handle or message number to identify
+ *				the record, or 0 for none.
+ * \param *record		The record to report.
+ */
+
+static void event_profile_report(char *name, unsigned int id, struct event_profile *record)
+{
+	debug_printf("%s 0x%x: %u calls, %u cs total, %u cs max", name, id,
+			record->calls, (unsigned int) record->total, (unsigned int) record->max);
+}
+#endif
@@ -147,6 +147,28 @@ enum event_message_type {
 	EVENT_MESSAGE_ACKNOWLEDGE = 4						/**< Handle only Wimp Message Acknowledge (19).				*/
 };
 
+#ifdef SFLIB_PROFILE
+/**
+ * Types of window handler for which profiling details are collected, when
+ * SFLib is built with SFLIB_PROFILE defined.
+ */
+
+enum event_profile_type {
+	EVENT_PROFILE_REDRAW = 0,						/**< Window Redraw handlers.						*/
+	EVENT_PROFILE_OPEN,							/**< Window Open handlers.						*/
+	EVENT_PROFILE_CLOSE,							/**< Window Close handlers.						*/
+	EVENT_PROFILE_LEAVING,							/**< Pointer Leaving handlers.						*/
+	EVENT_PROFILE_ENTERING,							/**< Pointer Entering handlers.						*/
+	EVENT_PROFILE_POINTER,							/**< Mouse Click handlers.						*/
+	EVENT_PROFILE_ICON,							/**< Icon Click handlers.						*/
+	EVENT_PROFILE_KEY,							/**< Key Pressed handlers.						*/
+	EVENT_PROFILE_SCROLL,							/**< Scroll Request handlers.						*/
+	EVENT_PROFILE_CARET,							/**< Lose Caret and Gain Caret handlers.				*/
+	EVENT_PROFILE_MENU,							/**< Menu Prepare, Selection, Close and Warning handlers.		*/
+	EVENT_PROFILE_TYPES							/**< The number of profile types; must be last.				*/
+};
+#endif
+
 
 /**
  * Accept and process a wimp event.
@@ -516,6 +538,43 @@ void event_delete_window(wimp_w w);
 void event_delete_icon(wimp_w w, wimp_i i);
 
 
+/**
+ * Enable or disable the hashed indexes used to find window and icon details
+ * when dispatching events. By default, windows and icons are found by
+ * searching linked lists, which is fine for a handful of windows but slows
+ * dispatch down as the number of registered windows grows; enabling the
+ * indexes keeps the cost of each lookup constant. Indexes are built from
+ * any windows already registered, and maintained automatically after that.
+ *
+ * If memory runs out while an index is being maintained, it is dropped
+ * and lookups revert to the linked lists.
+ *
+ * \param enable		TRUE to enable the indexes; FALSE to disable them.
+ * \return			TRUE if successful; FALSE if the indexes could not
+ *				be built.
+ */
+
+osbool event_set_hashed_lookup(osbool enable);
+
+
+/**
+ * Choose whether the blocks used to record windows, icons, messages and
+ * callbacks are allocated from one shared pool, or from a separate pool
+ * for each type of block. Using a shared pool wastes some memory, since
+ * every block is the size of the largest, but keeps the blocks for a window
+ * and its icons together in memory when they are registered together.
+ *
+ * This must be called before any handlers are registered.
+ *
+ * \param shared		TRUE to use a single shared pool; FALSE to use
+ *				separate pools.
+ * \return			TRUE if successful; FALSE if blocks have already
+ *				been allocated.
+ */
+
+osbool event_set_shared_pool(osbool shared);
+
+
 /**
  * Add a message handler for the given user message, and add the message to
  * the list of messages required from the Wimp if it isn't already on it.
@@ -534,6 +593,35 @@ void event_delete_icon(wimp_w w, wimp_i i);
 osbool event_add_message_handler(unsigned int message, enum event_message_type type, osbool (*message_action)(wimp_message *message));
 
 
+/**
+ * Read the dispatch statistics for a message handler registered with
+ * event_add_message_handler().
+ *
+ * \param message		The message number.
+ * \param *message_action	The callback function handling the message.
+ * \param *calls			Pointer to a variable to take the number of times
+ *				that the handler has been called, or NULL.
+ * \param *claims		Pointer to a variable to take the number of messages
+ *				claimed by the handler, or NULL.
+ * \return			TRUE if the handler was found; else FALSE.
+ */
+
+osbool event_get_message_handler_stats(unsigned int message, osbool (*message_action)(wimp_message *message), unsigned int *calls, unsigned int *claims);
+
+
+/**
+ * Read the overall statistics for user messages passed to event_process_event().
+ *
+ * \param *received		Pointer to a variable to take the number of user
+ *				messages received, or NULL.
+ * \param *rejected		Pointer to a variable to take the number of user
+ *				messages for which no handlers were registered,
+ *				or NULL.
+ */
+
+void event_get_message_stats(unsigned int *received, unsigned int *rejected);
+
+
 /**
  * Set a handler for the next drag box event and any Null Polls in between.
  * If either handler is NULL it will not be called; both will be cancelled on
@@ -629,6 +717,113 @@ osbool event_add_single_callback(wimp_w w, os_t delay, osbool (*callback)(int ti
 osbool event_add_regular_callback(wimp_w w, os_t delay, os_t interval, osbool (*callback)(int time, void *data), void *data);
 
 
+/**
+ * Add a new callback to the callback queue, returning a handle which can
+ * later be passed to event_cancel_callback().  If interval is zero, the
+ * callback is a one-shot; otherwise it will repeat until cancelled.
+ *
+ * \param w			A window to associate the callback with, or NULL.
+ * \param delay			The time until the first callback, in centiseconds.
+ * \param interval		The time between repeating callbacks, in centiseconds,
+ *				or zero for a one-shot callback.
+ * \param *callback		The callback function to be called.
+ * \param *data			A data pointer to be passed to the callback function.
+ * \return			A handle for the callback, or zero on failure.
+ */
+
+unsigned int event_add_callback(wimp_w w, os_t delay, os_t interval, osbool (*callback)(os_t time, void *data), void *data);
+
+
+/**
+ * Cancel a single callback, using the handle returned by event_add_callback().
+ * Handles for one-shot callbacks which have already been called are safely
+ * ignored.
+ *
+ * \param handle			The handle of the callback to be cancelled.
+ * \return			TRUE if the callback was found and cancelled; else FALSE.
+ */
+
+osbool event_cancel_callback(unsigned int handle);
+
+
+/**
+ * Set the time available for processing callbacks on each Null Poll.  By
+ * default, a single callback is called on each Null Poll passed in to
+ * event_process_event(); if a budget is set, then all of the callbacks
+ * which have fallen due are called in turn, until either none remain or
+ * the time spent exceeds the budget.  In both cases, the time of the next
+ * callback is returned through the *next parameter.
+ *
+ * \param budget			The time available, in centiseconds, or zero to
+ *				call only one callback per Null Poll.
+ */
+
+void event_set_callback_budget(os_t budget);
+
+
+#ifdef SFLIB_PROFILE
+
+/**
+ * Read the profiling details for one type of a window's handlers. Only
+ * available if SFLib is built with SFLIB_PROFILE defined. Times are read
+ * via OS_ReadMonotonicTime, so handlers taking less than a centisecond will
+ * only show up through their cumulative totals.
+ *
+ * \param w			The window of interest.
+ * \param type			The type of handler of interest.
+ * \param *calls			Pointer to a variable to take the number of calls
+ *				made to the handler, or NULL.
+ * \param *total			Pointer to a variable to take the total time spent
+ *				in the handler, or NULL.
+ * \param *max			Pointer to a variable to take the longest time
+ *				spent in a single call to the handler, or NULL.
+ * \return			TRUE if the details were found; else FALSE.
+ */
+
+osbool event_profile_read_window(wimp_w w, enum event_profile_type type, unsigned int *calls, os_t *total, os_t *max);
+
+
+/**
+ * Read the profiling details for a message handler. Only available if SFLib
+ * is built with SFLIB_PROFILE defined.
+ *
+ * \param message		The message number.
+ * \param *message_action	The callback function handling the message.
+ * \param *calls			Pointer to a variable to take the number of calls
+ *				made to the handler, or NULL.
+ * \param *total			Pointer to a variable to take the total time spent
+ *				in the handler, or NULL.
+ * \param *max			Pointer to a variable to take the longest time
+ *				spent in a single call to the handler, or NULL.
+ * \return			TRUE if the details were found; else FALSE.
+ */
+
+osbool event_profile_read_message_handler(unsigned int message, osbool (*message_action)(wimp_message *message), unsigned int *calls, os_t *total, os_t *max);
+
+
+/**
+ * Write a report of all of the profiling details collected for window,
+ * message, callback and drag handlers to Reporter via debug_printf(). If
+ * SFLib is not built with SFLIB_PROFILE defined, this does nothing.
+ */
+
+void event_profile_dump(void);
+
+
+/**
+ * Reset all of the profiling details collected for window, message, callback
+ * and drag handlers. If SFLib is not built with SFLIB_PROFILE defined, this
+ * does nothing.
+ */
+
+void event_profile_reset(void);
+
+#else
+#define event_profile_dump()
+#define event_profile_reset()
+#endif
+
+
 /**
  * Delete all references to a callback from the callback queue.
  * 
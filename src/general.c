@@ -30,16 +30,29 @@
 /* OS-Lib header files. */
 
 #include "oslib/os.h"
+#include "oslib/wimp.h"
+#include "oslib/wimpreadsysinfo.h"
 
 /* SF-Lib header files. */
 
 #include "general.h"
 
+#include "event.h"
+#include "string.h"
+
 /* ANSII C header files. */
 
 #include <ctype.h>
 
 
+static struct general_mode_info	general_mode;					/**< The cached details of the current screen mode.		*/
+static osbool			general_mode_valid = FALSE;			/**< TRUE if the cached mode details are valid.			*/
+static osbool			general_mode_handler_registered = FALSE;	/**< TRUE if the Message_ModeChange handler is registered.	*/
+
+
+static osbool		general_message_mode_change(wimp_message *message);
+
+
 /* Return the width in OS units of the current screen mode.
  *
  * This is an external interface, documented in general.h
@@ -47,12 +60,7 @@
 
 int general_mode_width(void)
 {
-	int	width, shift;
-
-	os_read_mode_variable(os_CURRENT_MODE, os_MODEVAR_XWIND_LIMIT, &width);
-	os_read_mode_variable(os_CURRENT_MODE, os_MODEVAR_XEIG_FACTOR, &shift);
-
-	return ((width + 1) << shift);
+	return general_get_mode_info()->width;
 }
 
 /* Return the height in OS units of the current screen mode.
@@ -62,11 +70,64 @@ int general_mode_width(void)
 
 int general_mode_height(void)
 {
-	int	height, shift;
+	return general_get_mode_info()->height;
+}
+
+
+/* Return details of the current screen mode.
+ *
+ * This is an external interface, documented in general.h
+ */
+
+struct general_mode_info *general_get_mode_info(void)
+{
+	int	x_limit, y_limit;
+
+	if (general_mode_valid)
+		return &general_mode;
+
+	/* Only cache the details if we will hear about mode changes. */
+
+	if (!general_mode_handler_registered)
+		general_mode_handler_registered = event_add_message_handler(message_MODE_CHANGE, EVENT_MESSAGE_INCOMING, general_message_mode_change);
+
+	os_read_mode_variable(os_CURRENT_MODE, os_MODEVAR_XWIND_LIMIT, &x_limit);
+	os_read_mode_variable(os_CURRENT_MODE, os_MODEVAR_YWIND_LIMIT, &y_limit);
+	os_read_mode_variable(os_CURRENT_MODE, os_MODEVAR_XEIG_FACTOR, &(general_mode.x_eig));
+	os_read_mode_variable(os_CURRENT_MODE, os_MODEVAR_YEIG_FACTOR, &(general_mode.y_eig));
 
-	os_read_mode_variable(os_CURRENT_MODE, os_MODEVAR_YWIND_LIMIT, &height);
-	os_read_mode_variable(os_CURRENT_MODE, os_MODEVAR_YEIG_FACTOR, &shift);
+	general_mode.width = (x_limit + 1) << general_mode.x_eig;
+	general_mode.height = (y_limit + 1) << general_mode.y_eig;
 
-	return ((height + 1) << shift);
+	string_copy(general_mode.sprite_suffix, wimpreadsysinfo_sprite_suffix(), GENERAL_SPRITE_SUFFIX_LEN);
+
+	general_mode_valid = general_mode_handler_registered;
+
+	return &general_mode;
+}
+
+
+/* Discard the cached details of the current screen mode.
+ *
+ * This is an external interface, documented in general.h
+ */
+
+void general_invalidate_mode_info(void)
+{
+	general_mode_valid = FALSE;
 }
 
+
+/**
+ * Handle Message_ModeChange, by discarding the cached mode details.
+ *
+ * \param *message		The associated Wimp message block.
+ * \return			FALSE to pass the message on to other handlers.
+ */
+
+static osbool general_message_mode_change(wimp_message *message)
+{
+	general_invalidate_mode_info();
+
+	return FALSE;
+}
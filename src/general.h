@@ -38,6 +38,49 @@
 #define WORDALIGN(x) ( (x+3) & ~3 )
 
 
+/**
+ * The maximum length of a mode sprite suffix, including the terminator.
+ */
+
+#define GENERAL_SPRITE_SUFFIX_LEN 16
+
+
+/**
+ * Details of the current screen mode.
+ */
+
+struct general_mode_info {
+	int		width;							/**< The width of the screen, in OS units.			*/
+	int		height;							/**< The height of the screen, in OS units.			*/
+	int		x_eig;							/**< The X eigen factor of the mode.				*/
+	int		y_eig;							/**< The Y eigen factor of the mode.				*/
+	char		sprite_suffix[GENERAL_SPRITE_SUFFIX_LEN];		/**< The Wimp's sprite suffix for the mode.			*/
+};
+
+
+/**
+ * Return details of the current screen mode. The details are cached, and
+ * refreshed automatically when Message_ModeChange is received via the
+ * event module; if the message handler can't be registered, the details
+ * are read afresh on every call.
+ *
+ * \return		Pointer to the mode details, which must not be
+ *			modified by the caller.
+ */
+
+struct general_mode_info *general_get_mode_info(void);
+
+
+/**
+ * Discard the cached details of the current screen mode, so that they are
+ * read again on the next request. This is done automatically on receipt of
+ * Message_ModeChange, but can be called by other Message_ModeChange handlers
+ * which need to see the new mode's details before the cache is refreshed.
+ */
+
+void general_invalidate_mode_info(void);
+
+
 /**
  * Return the width in OS units of the current screen mode.
  *
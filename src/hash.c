@@ -0,0 +1,315 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of SFLib:
+ *
+ *   http://www.stevefryatt.org.uk/software/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file: hash.c
+ *
+ * Open-addressed hash tables, mapping integer keys (such as window, icon
+ * or task handles) on to client data pointers.
+ *
+ * Collisions are resolved by linear probing, and deletions close up the
+ * probe sequence by shifting entries back so that no tombstones are needed.
+ */
+
+/* OS-Lib header files. */
+
+#include "oslib/types.h"
+
+/* SF-Lib header files. */
+
+#include "hash.h"
+
+/* ANSII C header files. */
+
+#include <stdlib.h>
+
+#define HASH_MINIMUM_SIZE 16							/**< The smallest number of slots in a table; must be a power of 2.	*/
+
+/**
+ * A slot in a hash table; the slot is empty if value is NULL.
+ */
+
+struct hash_entry {
+	unsigned int		key;						/**< The key stored in the slot.					*/
+	void			*value;						/**< The value stored in the slot, or NULL if empty.			*/
+};
+
+/**
+ * A hash table instance.
+ */
+
+struct hash_table {
+	unsigned int		size;						/**< The number of slots in the table; always a power of 2.		*/
+	unsigned int		count;						/**< The number of slots in use.					*/
+	struct hash_entry	*entries;					/**< The array of slots.						*/
+};
+
+
+static unsigned int	hash_get_slot(struct hash_table *table, unsigned int key);
+static osbool		hash_resize(struct hash_table *table, unsigned int size);
+
+
+/* Create a new, empty hash table.
+ *
+ * This is an external interface, documented in hash.h
+ */
+
+struct hash_table *hash_create(unsigned int size)
+{
+	struct hash_table	*table;
+	unsigned int		slots = HASH_MINIMUM_SIZE;
+
+	/* Size the table so that the expected entries fit below 75% load. */
+
+	while (slots < size + (size / 3) + 1)
+		slots <<= 1;
+
+	table = malloc(sizeof(struct hash_table));
+	if (table == NULL)
+		return NULL;
+
+	table->size = 0;
+	table->count = 0;
+	table->entries = NULL;
+
+	if (!hash_resize(table, slots)) {
+		free(table);
+		return NULL;
+	}
+
+	return table;
+}
+
+
+/* Destroy a hash table, freeing the memory that it uses.
+ *
+ * This is an external interface, documented in hash.h
+ */
+
+void hash_destroy(struct hash_table *table)
+{
+	if (table == NULL)
+		return;
+
+	if (table->entries != NULL)
+		free(table->entries);
+
+	free(table);
+}
+
+
+/* Add a value to a hash table, replacing any existing value.
+ *
+ * This is an external interface, documented in hash.h
+ */
+
+osbool hash_add(struct hash_table *table, unsigned int key, void *value)
+{
+	unsigned int	slot, mask;
+
+	if (table == NULL || value == NULL)
+		return FALSE;
+
+	/* Grow the table if adding an entry would take it above 75% load. */
+
+	if (((table->count + 1) * 4) > (table->size * 3) && !hash_resize(table, table->size * 2))
+		return FALSE;
+
+	mask = table->size - 1;
+
+	for (slot = hash_get_slot(table, key); table->entries[slot].value != NULL; slot = (slot + 1) & mask) {
+		if (table->entries[slot].key == key) {
+			table->entries[slot].value = value;
+			return TRUE;
+		}
+	}
+
+	table->entries[slot].key = key;
+	table->entries[slot].value = value;
+	table->count++;
+
+	return TRUE;
+}
+
+
+/* Find the value stored against a key in a hash table.
+ *
+ * This is an external interface, documented in hash.h
+ */
+
+void *hash_find(struct hash_table *table, unsigned int key)
+{
+	unsigned int	slot, mask;
+
+	if (table == NULL)
+		return NULL;
+
+	mask = table->size - 1;
+
+	for (slot = hash_get_slot(table, key); table->entries[slot].value != NULL; slot = (slot + 1) & mask) {
+		if (table->entries[slot].key == key)
+			return table->entries[slot].value;
+	}
+
+	return NULL;
+}
+
+
+/* Remove a key and its value from a hash table.
+ *
+ * This is an external interface, documented in hash.h
+ */
+
+void *hash_remove(struct hash_table *table, unsigned int key)
+{
+	unsigned int	slot, next, home, mask;
+	void		*value;
+
+	if (table == NULL)
+		return NULL;
+
+	mask = table->size - 1;
+
+	for (slot = hash_get_slot(table, key); table->entries[slot].value != NULL; slot = (slot + 1) & mask) {
+		if (table->entries[slot].key == key)
+			break;
+	}
+
+	value = table->entries[slot].value;
+	if (value == NULL)
+		return NULL;
+
+	table->entries[slot].value = NULL;
+	table->count--;
+
+	/* Shift any following entries in the probe sequence back into the
+	 * gap, if doing so moves them closer to (or on to) their home slot.
+	 */
+
+	for (next = (slot + 1) & mask; table->entries[next].value != NULL; next = (next + 1) & mask) {
+		home = hash_get_slot(table, table->entries[next].key);
+
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			table->entries[slot] = table->entries[next];
+			table->entries[next].value = NULL;
+			slot = next;
+		}
+	}
+
+	return value;
+}
+
+
+/* Return the number of entries held in a hash table.
+ *
+ * This is an external interface, documented in hash.h
+ */
+
+unsigned int hash_count(struct hash_table *table)
+{
+	return (table != NULL) ? table->count : 0;
+}
+
+
+/* Calculate a hash key for a string, using the FNV-1a algorithm.
+ *
+ * This is an external interface, documented in hash.h
+ */
+
+unsigned int hash_string(char *string)
+{
+	unsigned int	key = 2166136261u;
+
+	if (string == NULL)
+		return key;
+
+	while (*string != '\0') {
+		key ^= (unsigned char) *string++;
+		key *= 16777619u;
+	}
+
+	return key;
+}
+
+
+/**
+ * Return the home slot for a key in a hash table. Handles tend to be
+ * word-aligned addresses or small consecutive integers, so the key is
+ * scrambled by a multiplicative hash before being masked.
+ *
+ * \param *table	The table to calculate the slot for.
+ * \param key		The key to calculate the slot for.
+ * \return		The home slot for the key.
+ */
+
+static unsigned int hash_get_slot(struct hash_table *table, unsigned int key)
+{
+	key *= 2654435769u;
+	key ^= key >> 16;
+
+	return key & (table->size - 1);
+}
+
+
+/**
+ * Change the number of slots in a hash table, rehashing the existing
+ * entries into the new array.
+ *
+ * \param *table	The table to be resized.
+ * \param size		The new number of slots; must be a power of 2.
+ * \return		TRUE if successful; FALSE on failure.
+ */
+
+static osbool hash_resize(struct hash_table *table, unsigned int size)
+{
+	struct hash_entry	*old_entries;
+	unsigned int		old_size, slot, i;
+
+	old_entries = table->entries;
+	old_size = table->size;
+
+	table->entries = malloc(size * sizeof(struct hash_entry));
+	if (table->entries == NULL) {
+		table->entries = old_entries;
+		return FALSE;
+	}
+
+	table->size = size;
+
+	for (i = 0; i < size; i++)
+		table->entries[i].value = NULL;
+
+	for (i = 0; i < old_size; i++) {
+		if (old_entries[i].value == NULL)
+			continue;
+
+		for (slot = hash_get_slot(table, old_entries[i].key); table->entries[slot].value != NULL; slot = (slot + 1) & (size - 1));
+
+		table->entries[slot] = old_entries[i];
+	}
+
+	if (old_entries != NULL)
+		free(old_entries);
+
+	return TRUE;
+}
@@ -0,0 +1,125 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of SFLib:
+ *
+ *   http://www.stevefryatt.org.uk/software/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file: hash.h
+ *
+ * Open-addressed hash tables, mapping integer keys (such as window, icon
+ * or task handles) on to client data pointers.
+ *
+ * Tables grow automatically as entries are added. Values must not be NULL,
+ * as NULL is used to mark an empty slot and is returned to indicate that a
+ * key could not be found.
+ */
+
+#ifndef SFLIB_HASH
+#define SFLIB_HASH
+
+#include "oslib/types.h"
+
+/**
+ * A hash table instance.
+ */
+
+struct hash_table;
+
+
+/**
+ * Create a new, empty hash table.
+ *
+ * \param size		The number of entries expected in the table, or
+ *			zero to use a default.
+ * \return		Pointer to the new table, or NULL on failure.
+ */
+
+struct hash_table *hash_create(unsigned int size);
+
+
+/**
+ * Destroy a hash table, freeing the memory that it uses. The values
+ * stored in the table are not touched.
+ *
+ * \param *table	The table to be destroyed.
+ */
+
+void hash_destroy(struct hash_table *table);
+
+
+/**
+ * Add a value to a hash table, replacing any value already stored against
+ * the same key.
+ *
+ * \param *table	The table to add the value to.
+ * \param key		The key to store the value against.
+ * \param *value	The value to store, which must not be NULL.
+ * \return		TRUE if the value was stored; else FALSE.
+ */
+
+osbool hash_add(struct hash_table *table, unsigned int key, void *value);
+
+
+/**
+ * Find the value stored against a key in a hash table.
+ *
+ * \param *table	The table to search.
+ * \param key		The key to look up.
+ * \return		The value stored against the key, or NULL if none.
+ */
+
+void *hash_find(struct hash_table *table, unsigned int key);
+
+
+/**
+ * Remove a key and its value from a hash table.
+ *
+ * \param *table	The table to remove the key from.
+ * \param key		The key to be removed.
+ * \return		The value which was stored against the key, or NULL
+ *			if the key was not found.
+ */
+
+void *hash_remove(struct hash_table *table, unsigned int key);
+
+
+/**
+ * Return the number of entries held in a hash table.
+ *
+ * \param *table	The table of interest.
+ * \return		The number of entries in the table.
+ */
+
+unsigned int hash_count(struct hash_table *table);
+
+
+/**
+ * Calculate a hash key for a string, so that tables can be used to index
+ * named items. Different strings can produce the same key, so clients must
+ * still compare the names of any items that they find.
+ *
+ * \param *string	The string to calculate a key for.
+ * \return		The key for the string.
+ */
+
+unsigned int hash_string(char *string);
+
+#endif
@@ -49,14 +49,80 @@
 
 #include "debug.h"
 
+/* In debug builds, heap.h redirects these to their debug equivalents. */
+
+#undef heap_alloc
+#undef heap_extend
+#undef heap_strdup
+
 
 #define HEAP_GRANULARITY 1024							/**< The size of standard allocations from flex.			*/
 #define HEAP_BLOCK_OHEAD 16							/**< The amount of memory requuired by OS_Heap to manage a heap block.	*/
+#define HEAP_HEADER_SIZE (sizeof(struct heap_header))				/**< The size of the header which precedes each block.			*/
+
+#define HEAP_CLASSES 5								/**< The number of small block size classes.				*/
+#define HEAP_CLASS_MINIMUM 16							/**< The capacity of the smallest size class, in bytes.			*/
+#define HEAP_CLASS_MAXIMUM (HEAP_CLASS_MINIMUM << (HEAP_CLASSES - 1))		/**< The capacity of the largest size class, in bytes.			*/
+#define HEAP_NO_CLASS (-1)							/**< The class returned for blocks too large for the size classes.	*/
+
+#define HEAP_DEFAULT_GROWTH 50							/**< The default flex growth, as a percentage of the heap size.		*/
+#define HEAP_DEFAULT_SHRINK_THRESHOLD (16 * 1024)				/**< The default memory to be freed before attempting to shrink.	*/
+#define HEAP_DEFAULT_SHRINK_RESERVE (4 * 1024)					/**< The default free space to be retained after shrinking.		*/
+#define HEAP_DEFAULT_CLASS_LIMIT 64						/**< The default number of free blocks to cache in each size class.	*/
+
+
+/**
+ * The header which precedes each block in the heap. In debug builds, this
+ * also records the allocation site and links the block into the list of
+ * live blocks.
+ */
+
+struct heap_header {
+	int			size;						/**< The size of the block, as requested by the client.			*/
+#ifdef SFLIB_HEAP_DEBUG
+	const char		*file;						/**< The source file from which the block was allocated, or NULL.	*/
+	int			line;						/**< The source line from which the block was allocated.		*/
+	unsigned int		sequence;					/**< The allocation sequence number of the block.			*/
+	struct heap_header	*previous;					/**< The previous live block, or NULL.					*/
+	struct heap_header	*next;						/**< The next live block, or NULL.					*/
+#endif
+};
 
 
 static byte	*heap_anchor = NULL;
 static int	heap_block_size = HEAP_GRANULARITY;
 
+static void		*heap_class_free[HEAP_CLASSES];				/**< The free lists for each size class, linked through the blocks.	*/
+static unsigned int	heap_class_count[HEAP_CLASSES];				/**< The number of blocks on each size class free list.			*/
+
+static unsigned int	heap_growth = HEAP_DEFAULT_GROWTH;			/**< The flex growth, as a percentage of the current heap size.		*/
+static size_t		heap_shrink_threshold = HEAP_DEFAULT_SHRINK_THRESHOLD;	/**< The memory to be freed before attempting to shrink.		*/
+static size_t		heap_shrink_reserve = HEAP_DEFAULT_SHRINK_RESERVE;	/**< The free space to be retained after shrinking.			*/
+static unsigned int	heap_class_limit = HEAP_DEFAULT_CLASS_LIMIT;		/**< The number of free blocks to cache in each size class.		*/
+static size_t		heap_freed_since_shrink = 0;				/**< The memory freed since the last attempt to shrink.			*/
+
+static struct heap_counters	heap_counters;					/**< The counters exposed for tuning.					*/
+
+static unsigned int	heap_live_blocks = 0;					/**< The number of blocks currently allocated.				*/
+static size_t		heap_live_bytes = 0;					/**< The memory currently allocated to clients, in bytes.		*/
+static size_t		heap_peak_bytes = 0;					/**< The most memory ever allocated to clients, in bytes.		*/
+
+#ifdef SFLIB_HEAP_DEBUG
+static struct heap_header	*heap_live_list = NULL;				/**< The list of live blocks, most recent first.			*/
+static unsigned int		heap_sequence = 0;				/**< The sequence number of the next block to be allocated.		*/
+#endif
+
+
+static void		*heap_allocate(size_t size, const char *file, int line);
+static void		*heap_resize(void *ptr, size_t new_size, const char *file, int line);
+static void		heap_set_header(struct heap_header *header, size_t size, const char *file, int line);
+static void		heap_clear_header(struct heap_header *header);
+static int		heap_get_class(size_t size);
+static size_t		heap_get_capacity(size_t size);
+static void		*heap_claim_block(size_t capacity);
+static osbool		heap_grow(size_t size);
+static void		heap_shrink(void);
+
 
 /* Initialise the heap.  Flex must have been initialised via flex_init() before
  * this is called.
@@ -67,49 +133,74 @@ static int	heap_block_size = HEAP_GRANULARITY;
 osbool heap_initialise(void)
 {
 	os_error	*error;
+	int		i;
 
 	flex_alloc((flex_ptr) &heap_anchor, heap_block_size);
 
 	error = xosheap_initialise(heap_anchor, heap_block_size);
-	if (error != NULL);
+	if (error != NULL)
 		error_report_program(error);
 
+	for (i = 0; i < HEAP_CLASSES; i++) {
+		heap_class_free[i] = NULL;
+		heap_class_count[i] = 0;
+	}
+
+	memset(&heap_counters, 0, sizeof(struct heap_counters));
+	heap_counters.heap_size = heap_block_size;
+
 	return TRUE;
 }
 
 
-/* Allocate a block of memory from the heap.
+/* Set the parameters used to tune the heap's growth and shrinkage.
  *
  * This is an external interface, documented in heap.h
  */
 
-void *heap_alloc(size_t size)
+void heap_set_tuning(unsigned int growth, size_t shrink_threshold, size_t shrink_reserve, unsigned int class_limit)
 {
-	void		*block;
-	os_error	*error;
+	heap_growth = growth;
+	heap_shrink_threshold = shrink_threshold;
+	heap_shrink_reserve = shrink_reserve;
+	heap_class_limit = class_limit;
+}
 
-	size += sizeof(int);
 
-	error = xosheap_alloc(heap_anchor, size, &block);
-	if (error != NULL) {
-		if (flex_extend ((flex_ptr) &heap_anchor, heap_block_size + size + HEAP_BLOCK_OHEAD)) {
-			osheap_resize(heap_anchor, size + HEAP_BLOCK_OHEAD);
-			heap_block_size += (size + HEAP_BLOCK_OHEAD);
+/* Read the heap's tuning counters.
+ *
+ * This is an external interface, documented in heap.h
+ */
 
-			error = xosheap_alloc(heap_anchor, size, &block);
-			if (error != NULL)
-				error_report_program (error);
-		} else {
-			block = NULL;
-		}
-	}
+void heap_get_counters(struct heap_counters *counters)
+{
+	if (counters == NULL)
+		return;
 
-	if (block != NULL) {
-		*(int *)block = size - sizeof (int);
-		block = (int *) block + 1;
-	}
+	*counters = heap_counters;
+	counters->heap_size = heap_block_size;
+}
 
-	return block;
+
+/* Allocate a block of memory from the heap.
+ *
+ * This is an external interface, documented in heap.h
+ */
+
+void *heap_alloc(size_t size)
+{
+	return heap_allocate(size, NULL, 0);
+}
+
+
+/* Allocate a block of memory from the heap, recording the caller.
+ *
+ * This is an external interface, documented in heap.h
+ */
+
+void *heap_debug_alloc(size_t size, const char *file, int line)
+{
+	return heap_allocate(size, file, line);
 }
 
 
@@ -120,18 +211,38 @@ void *heap_alloc(size_t size)
 
 void heap_free(void *ptr)
 {
-	int	shrink;
+	struct heap_header	*header;
+	int			class;
 
-	ptr = (int *) ptr - 1;
+	if (ptr == NULL)
+		return;
 
-	osheap_free(heap_anchor, ptr);
+	heap_counters.frees++;
 
-	shrink = osheap_resize_no_fail(heap_anchor, 0x80000000);
+	header = (struct heap_header *) ptr - 1;
+	heap_clear_header(header);
 
-	if (shrink < 0) {
-		heap_block_size += shrink;
-		flex_extend((flex_ptr) &heap_anchor, heap_block_size);
+	/* Small blocks are cached on the size class free lists, until the
+	 * lists reach their limit.
+	 */
+
+	class = heap_get_class(header->size);
+
+	if (class != HEAP_NO_CLASS && heap_class_count[class] < heap_class_limit) {
+		*((void **) (header + 1)) = heap_class_free[class];
+		heap_class_free[class] = header;
+		heap_class_count[class]++;
+		return;
 	}
+
+	heap_freed_since_shrink += heap_get_capacity(header->size) + HEAP_HEADER_SIZE;
+
+	osheap_free(heap_anchor, header);
+
+	/* Only try to give memory back once enough has been freed. */
+
+	if (heap_freed_since_shrink >= heap_shrink_threshold)
+		heap_shrink();
 }
 
 
@@ -143,34 +254,19 @@ void heap_free(void *ptr)
 
 void *heap_extend(void *ptr, size_t new_size)
 {
-	int		change;
-	void		*block;
-	os_error	*error;
-
-	new_size += sizeof(int);
-	ptr = (int *) ptr - 1;
-	change = new_size - *(int *)ptr;
-
-	error = xosheap_realloc(heap_anchor, ptr, change, &block);
-	if (error != NULL) {
-		if (flex_extend((flex_ptr) &heap_anchor, heap_block_size + new_size + HEAP_BLOCK_OHEAD)) {
-			osheap_resize(heap_anchor, new_size + HEAP_BLOCK_OHEAD);
-			heap_block_size += (new_size + HEAP_BLOCK_OHEAD);
+	return heap_resize(ptr, new_size, NULL, 0);
+}
 
-			error = xosheap_realloc(heap_anchor, ptr, change, &block);
-			if (error != NULL)
-				error_report_program(error);
-		} else {
-			block = NULL;
-		}
-	}
 
-	if (block != NULL) {
-		*(int *) block = new_size - sizeof(int);
-		block = (int *) block + 1;
-	}
+/* Change the size of a block of memory previously claimed from the heap,
+ * recording the caller.
+ *
+ * This is an external interface, documented in heap.h
+ */
 
-	return block;
+void *heap_debug_extend(void *ptr, size_t new_size, const char *file, int line)
+{
+	return heap_resize(ptr, new_size, file, line);
 }
 
 
@@ -181,7 +277,7 @@ void *heap_extend(void *ptr, size_t new_size)
 
 size_t heap_size(void *ptr)
 {
-	return *((size_t *) ptr - 1);
+	return ((struct heap_header *) ptr - 1)->size;
 }
 
 
@@ -191,9 +287,21 @@ size_t heap_size(void *ptr)
  */
 
 char *heap_strdup(char *string)
+{
+	return heap_debug_strdup(string, NULL, 0);
+}
+
+
+/* Perform a strdup() on a string, using memory claimed by heap_alloc()
+ * and recording the caller.
+ *
+ * This is an external interface, documented in heap.h
+ */
+
+char *heap_debug_strdup(char *string, const char *file, int line)
 {
 	size_t		size = strlen(string) + 1;
-	char		*new = heap_alloc(size);
+	char		*new = heap_allocate(size, file, line);
 
 	if (new != NULL)
 		strncpy(new, string, size);
@@ -202,6 +310,59 @@ char *heap_strdup(char *string)
 }
 
 
+/* Read statistics about the state of the heap.
+ *
+ * This is an external interface, documented in heap.h
+ */
+
+osbool heap_stats(struct heap_stats *stats)
+{
+	int	i;
+
+	if (stats == NULL)
+		return FALSE;
+
+	stats->live_blocks = heap_live_blocks;
+	stats->live_bytes = heap_live_bytes;
+	stats->peak_bytes = heap_peak_bytes;
+	stats->heap_size = heap_block_size;
+
+	stats->cached_bytes = 0;
+
+	for (i = 0; i < HEAP_CLASSES; i++)
+		stats->cached_bytes += heap_class_count[i] * (HEAP_CLASS_MINIMUM << i);
+
+	if (heap_anchor == NULL || xosheap_describe(heap_anchor, &(stats->largest_free), &(stats->total_free)) != NULL) {
+		stats->largest_free = 0;
+		stats->total_free = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+#ifdef SFLIB_HEAP_DEBUG
+
+/* Write details of all of the live blocks in the heap to Reporter.
+ *
+ * This is an external interface, documented in heap.h
+ */
+
+void heap_dump_live(void)
+{
+	struct heap_header	*header;
+
+	debug_printf("Heap: %u live blocks, %u bytes, peak %u bytes",
+			heap_live_blocks, (unsigned int) heap_live_bytes, (unsigned int) heap_peak_bytes);
+
+	for (header = heap_live_list; header != NULL; header = header->next)
+		debug_printf("Block %u: %d bytes at 0x%x, from %s:%d", header->sequence, header->size,
+				(unsigned int) (header + 1), (header->file != NULL) ? header->file : "unknown", header->line);
+}
+#endif
+
+
 /* Return the pointer to the heap base.
  *
  * This is an external interface, documented in heap.h
@@ -211,3 +372,330 @@ byte *heap_base(void)
 {
 	return heap_anchor;
 }
+
+
+/**
+ * Allocate a block of memory from the heap.
+ *
+ * \param size		The amount of memory to claim, in bytes.
+ * \param *file		The source file of the caller, or NULL.
+ * \param line		The source line of the caller.
+ * \return		Pointer to the claimed memory, or NULL on failure.
+ */
+
+static void *heap_allocate(size_t size, const char *file, int line)
+{
+	struct heap_header	*header;
+	int			class;
+
+	heap_counters.allocs++;
+
+	/* Small blocks are taken from the size class free lists if possible. */
+
+	class = heap_get_class(size);
+
+	if (class != HEAP_NO_CLASS && heap_class_free[class] != NULL) {
+		header = heap_class_free[class];
+		heap_class_free[class] = *((void **) (header + 1));
+		heap_class_count[class]--;
+		heap_counters.class_hits++;
+	} else {
+		header = heap_claim_block(heap_get_capacity(size));
+	}
+
+	if (header == NULL) {
+		heap_counters.failures++;
+		return NULL;
+	}
+
+	heap_set_header(header, size, file, line);
+
+	return header + 1;
+}
+
+
+/**
+ * Change the size of a block of memory previously claimed from the heap.
+ *
+ * \param *ptr		Pointer to the block of memory to change.
+ * \param new_size	The new size for the block.
+ * \param *file		The source file of the caller, or NULL.
+ * \param line		The source line of the caller.
+ * \return		Pointer to the block of memory after update.
+ */
+
+static void *heap_resize(void *ptr, size_t new_size, const char *file, int line)
+{
+	struct heap_header	*header;
+	size_t			old_size, old_capacity, new_capacity;
+	void			*block;
+	os_error		*error;
+
+	if (ptr == NULL)
+		return heap_allocate(new_size, file, line);
+
+	header = (struct heap_header *) ptr - 1;
+
+	old_size = header->size;
+	old_capacity = heap_get_capacity(old_size);
+	new_capacity = heap_get_capacity(new_size);
+
+	/* If the block is already the right size, just update its header. */
+
+	if (new_capacity == old_capacity) {
+		heap_clear_header(header);
+		heap_set_header(header, new_size, file, line);
+		return ptr;
+	}
+
+	/* Blocks moving into or out of the size classes are copied, so that
+	 * they keep the capacity expected of their class.
+	 */
+
+	if (heap_get_class(old_size) != HEAP_NO_CLASS || heap_get_class(new_size) != HEAP_NO_CLASS) {
+		block = heap_allocate(new_size, file, line);
+
+		if (block != NULL) {
+			memcpy(block, ptr, (old_size < new_size) ? old_size : new_size);
+			heap_free(ptr);
+		}
+
+		return block;
+	}
+
+	/* Otherwise, ask OS_Heap to resize the block in place if it can. The
+	 * block is taken out of the live records while this happens, as it
+	 * may move.
+	 */
+
+	heap_clear_header(header);
+
+	error = xosheap_realloc(heap_anchor, header, (int) new_capacity - (int) old_capacity, &block);
+	if (error != NULL) {
+		if (heap_grow(new_capacity + HEAP_HEADER_SIZE)) {
+			error = xosheap_realloc(heap_anchor, header, (int) new_capacity - (int) old_capacity, &block);
+			if (error != NULL)
+				error_report_program(error);
+		} else {
+			block = NULL;
+		}
+	}
+
+	if (block == NULL) {
+		heap_set_header(header, old_size, file, line);
+		heap_counters.failures++;
+		return NULL;
+	}
+
+	header = block;
+	heap_set_header(header, new_size, file, line);
+
+	return header + 1;
+}
+
+
+/**
+ * Fill in the header of a newly allocated block, and add it to the
+ * live block records.
+ *
+ * \param *header	The header to fill in.
+ * \param size		The size of the block, as requested by the client.
+ * \param *file		The source file of the caller, or NULL.
+ * \param line		The source line of the caller.
+ */
+
+static void heap_set_header(struct heap_header *header, size_t size, const char *file, int line)
+{
+	header->size = size;
+
+	heap_live_blocks++;
+	heap_live_bytes += size;
+
+	if (heap_live_bytes > heap_peak_bytes)
+		heap_peak_bytes = heap_live_bytes;
+
+#ifdef SFLIB_HEAP_DEBUG
+	header->file = file;
+	header->line = line;
+	header->sequence = heap_sequence++;
+
+	header->previous = NULL;
+	header->next = heap_live_list;
+
+	if (heap_live_list != NULL)
+		heap_live_list->previous = header;
+
+	heap_live_list = header;
+#endif
+}
+
+
+/**
+ * Remove a block from the live block records.
+ *
+ * \param *header	The header of the block to remove.
+ */
+
+static void heap_clear_header(struct heap_header *header)
+{
+	heap_live_blocks--;
+	heap_live_bytes -= header->size;
+
+#ifdef SFLIB_HEAP_DEBUG
+	if (header->previous != NULL)
+		header->previous->next = header->next;
+	else
+		heap_live_list = header->next;
+
+	if (header->next != NULL)
+		header->next->previous = header->previous;
+
+	header->previous = NULL;
+	header->next = NULL;
+#endif
+}
+
+
+/**
+ * Find the size class for a block of a given size.
+ *
+ * \param size		The size of the block, in bytes.
+ * \return		The size class, or HEAP_NO_CLASS if the block is too
+ *			large for the size classes.
+ */
+
+static int heap_get_class(size_t size)
+{
+	size_t	capacity = HEAP_CLASS_MINIMUM;
+	int	class = 0;
+
+	while (capacity < size && class < HEAP_CLASSES) {
+		capacity <<= 1;
+		class++;
+	}
+
+	return (class < HEAP_CLASSES) ? class : HEAP_NO_CLASS;
+}
+
+
+/**
+ * Find the capacity required for a block of a given size: blocks within
+ * the size classes are rounded up to the class capacity.
+ *
+ * \param size		The size of the block, in bytes.
+ * \return		The capacity to be allocated, in bytes.
+ */
+
+static size_t heap_get_capacity(size_t size)
+{
+	int	class;
+
+	class = heap_get_class(size);
+
+	return (class == HEAP_NO_CLASS) ? size : (size_t) (HEAP_CLASS_MINIMUM << class);
+}
+
+
+/**
+ * Claim a block from OS_Heap, growing the flex block if required.  The
+ * block returned includes space for the header.
+ *
+ * \param capacity	The capacity of the block, excluding the header.
+ * \return		Pointer to the block, or NULL on failure.
+ */
+
+static void *heap_claim_block(size_t capacity)
+{
+	void		*block;
+	os_error	*error;
+
+	capacity += HEAP_HEADER_SIZE;
+
+	error = xosheap_alloc(heap_anchor, capacity, &block);
+	if (error == NULL)
+		return block;
+
+	if (!heap_grow(capacity))
+		return NULL;
+
+	error = xosheap_alloc(heap_anchor, capacity, &block);
+	if (error != NULL)
+		error_report_program(error);
+
+	return block;
+}
+
+
+/**
+ * Grow the flex block and the heap within it, by a proportion of the current
+ * size but always by enough to hold a block of the size requested.
+ *
+ * \param size		The size of the block which must fit into the new
+ *			space, in bytes.
+ * \return		TRUE if successful; else FALSE.
+ */
+
+static osbool heap_grow(size_t size)
+{
+	int	change, minimum;
+
+	minimum = size + HEAP_BLOCK_OHEAD;
+
+	change = (heap_block_size / 100) * heap_growth;
+	if (change < minimum)
+		change = minimum;
+
+	change = ((change + HEAP_GRANULARITY - 1) / HEAP_GRANULARITY) * HEAP_GRANULARITY;
+
+	/* If the geometric growth can't be had, fall back to the minimum. */
+
+	if (!flex_extend((flex_ptr) &heap_anchor, heap_block_size + change)) {
+		change = minimum;
+
+		if (!flex_extend((flex_ptr) &heap_anchor, heap_block_size + change))
+			return FALSE;
+	}
+
+	osheap_resize(heap_anchor, change);
+	heap_block_size += change;
+
+	heap_counters.grows++;
+
+	return TRUE;
+}
+
+
+/**
+ * Shrink the heap and the flex block which contains it, retaining some
+ * free space as a reserve against future allocations.
+ */
+
+static void heap_shrink(void)
+{
+	int	shrink, keep;
+
+	heap_freed_since_shrink = 0;
+
+	shrink = osheap_resize_no_fail(heap_anchor, 0x80000000);
+
+	if (shrink >= 0)
+		return;
+
+	/* Give back the reserve: the flex block is still its old size, so the
+	 * memory is still there.
+	 */
+
+	keep = ((size_t) -shrink < heap_shrink_reserve) ? -shrink : (int) heap_shrink_reserve;
+	keep &= ~3;
+
+	if (keep > 0) {
+		osheap_resize(heap_anchor, keep);
+		shrink += keep;
+	}
+
+	if (shrink < 0) {
+		heap_block_size += shrink;
+		flex_extend((flex_ptr) &heap_anchor, heap_block_size);
+		heap_counters.shrinks++;
+	}
+}
@@ -34,6 +34,35 @@
 #include <stdlib.h>
 #include "oslib/types.h"
 
+/**
+ * Counters recording the activity of the heap, for use when tuning.
+ */
+
+struct heap_counters {
+	unsigned int	allocs;								/**< The number of blocks allocated.					*/
+	unsigned int	frees;								/**< The number of blocks freed.					*/
+	unsigned int	class_hits;							/**< The number of allocations satisfied from size class free lists.	*/
+	unsigned int	failures;							/**< The number of allocations which failed.				*/
+	unsigned int	grows;								/**< The number of times that the flex block has been extended.		*/
+	unsigned int	shrinks;							/**< The number of times that the flex block has been shrunk.		*/
+	int		heap_size;							/**< The current size of the flex block holding the heap.		*/
+};
+
+/**
+ * Statistics describing the state of the heap.
+ */
+
+struct heap_stats {
+	unsigned int	live_blocks;							/**< The number of blocks currently allocated.				*/
+	size_t		live_bytes;							/**< The memory currently allocated to clients, in bytes.		*/
+	size_t		peak_bytes;							/**< The most memory ever allocated to clients, in bytes.		*/
+	size_t		cached_bytes;							/**< The memory held on the size class free lists, in bytes.		*/
+	int		heap_size;							/**< The current size of the flex block holding the heap.		*/
+	int		total_free;							/**< The total free space within the heap.				*/
+	int		largest_free;							/**< The largest free block within the heap.				*/
+};
+
+
 /**
  * Initialise the heap.  Flex must have been initialised via flex_init() before
  * this is called.
@@ -44,6 +73,37 @@
 osbool heap_initialise(void);
 
 
+/**
+ * Set the parameters used to tune the heap.
+ *
+ * Small blocks are rounded up to one of a set of size classes, and when freed
+ * are cached on a free list for their class instead of being returned to
+ * OS_Heap. When the heap needs to grow, the flex block is extended by a
+ * proportion of its current size; it is only shrunk again once a threshold
+ * amount of memory has been freed, and even then some free space is kept.
+ *
+ * \param growth		The amount to grow the flex block by, as a percentage
+ *			of its current size.
+ * \param shrink_threshold	The amount of memory, in bytes, to be freed back to
+ *			OS_Heap before an attempt is made to shrink the flex block.
+ * \param shrink_reserve	The amount of free space, in bytes, to keep in the
+ *			heap after shrinking.
+ * \param class_limit	The number of free blocks to cache for each size
+ *			class, or 0 to disable the cache.
+ */
+
+void heap_set_tuning(unsigned int growth, size_t shrink_threshold, size_t shrink_reserve, unsigned int class_limit);
+
+
+/**
+ * Read the heap's activity counters.
+ *
+ * \param *counters	Pointer to a block to take the counters.
+ */
+
+void heap_get_counters(struct heap_counters *counters);
+
+
 /**
  * Allocate a block of memory from the heap.
  *
@@ -103,4 +163,81 @@ char *heap_strdup(char *string);
 
 byte *heap_base(void);
 
+
+/**
+ * Read statistics about the state of the heap. The ratio of the largest free
+ * block to the total free space gives an indication of fragmentation.
+ *
+ * \param *stats		Pointer to a block to take the statistics.
+ * \return		TRUE if successful; FALSE if the free space could not
+ *			be read from OS_Heap.
+ */
+
+osbool heap_stats(struct heap_stats *stats);
+
+
+/**
+ * Allocate a block of memory from the heap, recording the caller's location
+ * in debug builds. This is not usually called directly: if SFLIB_HEAP_DEBUG
+ * is defined, calls to heap_alloc() are redirected here.
+ *
+ * \param size		The amount of memory to claim, in bytes.
+ * \param *file		The source file of the caller, or NULL.
+ * \param line		The source line of the caller.
+ * \return		Pointer to the claimed memory, or NULL on failure.
+ */
+
+void *heap_debug_alloc(size_t size, const char *file, int line);
+
+
+/**
+ * Change the size of a block of memory previously claimed from the heap,
+ * recording the caller's location in debug builds. This is not usually
+ * called directly: if SFLIB_HEAP_DEBUG is defined, calls to heap_extend()
+ * are redirected here.
+ *
+ * \param *ptr		Pointer to the block of memory to change.
+ * \param new_size	The new size for the block.
+ * \param *file		The source file of the caller, or NULL.
+ * \param line		The source line of the caller.
+ * \return		Pointer to the block of memory after update.
+ */
+
+void *heap_debug_extend(void *ptr, size_t new_size, const char *file, int line);
+
+
+/**
+ * Perform a strdup() on a string, using memory claimed by heap_alloc() and
+ * recording the caller's location in debug builds. This is not usually
+ * called directly: if SFLIB_HEAP_DEBUG is defined, calls to heap_strdup()
+ * are redirected here.
+ *
+ * \param *string	Pointer to the string to be duplicated.
+ * \param *file		The source file of the caller, or NULL.
+ * \param line		The source line of the caller.
+ * \return		Pointer to the duplicate string, or NULL on failure.
+ */
+
+char *heap_debug_strdup(char *string, const char *file, int line);
+
+
+#ifdef SFLIB_HEAP_DEBUG
+
+/**
+ * Write details of every live block in the heap to Reporter, including the
+ * allocation site and sequence number of each. Only available if SFLib
+ * and the client are built with SFLIB_HEAP_DEBUG defined; otherwise, this
+ * does nothing.
+ */
+
+void heap_dump_live(void);
+
+#define heap_alloc(size) heap_debug_alloc((size), __FILE__, __LINE__)
+#define heap_extend(ptr, new_size) heap_debug_extend((ptr), (new_size), __FILE__, __LINE__)
+#define heap_strdup(string) heap_debug_strdup((string), __FILE__, __LINE__)
+
+#else
+#define heap_dump_live()
+#endif
+
 #endif
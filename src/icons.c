@@ -36,6 +36,7 @@
 /* SF-Lib header files. */
 
 #include "icons.h"
+#include "hash.h"
 #include "string.h"
 #include "debug.h"
 #include "msgs.h"
@@ -49,6 +50,85 @@
 #include <stdlib.h>
 #include <ctype.h>
 
+/**
+ * The number of entries by which the pending update list is extended.
+ */
+
+#define ICONS_UPDATE_BLOCK_SIZE 16
+
+/**
+ * A pending change to the flags of an icon, held during a batched update.
+ */
+
+struct icons_update {
+	wimp_i			icon;			/**< The icon to be updated.				*/
+	wimp_icon_flags		mask;			/**< The flags which are to be changed.			*/
+	wimp_icon_flags		value;			/**< The required values of the flags being changed.	*/
+};
+
+/**
+ * The window for which a batched update is open, or NULL if none.
+ */
+
+static wimp_w icons_update_window = NULL;
+
+/**
+ * The number of times that the current batched update has been opened.
+ */
+
+static unsigned int icons_update_depth = 0;
+
+/**
+ * The list of pending icon changes in the current batched update.
+ */
+
+static struct icons_update *icons_update_list = NULL;
+
+/**
+ * The number of pending icon changes in the current batched update.
+ */
+
+static unsigned int icons_update_count = 0;
+
+/**
+ * The number of entries allocated in the pending update list.
+ */
+
+static unsigned int icons_update_allocation = 0;
+
+/**
+ * The writable icons in a window, cached for caret relocation.
+ */
+
+struct icons_writable {
+	int			count;			/**< The number of writable icons in the window.	*/
+	wimp_i			icons[1];		/**< The writable icon handles, in ascending order.	*/
+};
+
+/**
+ * The information cached about the icons in a window.
+ */
+
+struct icons_window {
+	wimp_w			w;			/**< The window containing the icons.			*/
+	struct icons_writable	*writable;		/**< The writable icons, or NULL if not cached.		*/
+};
+
+/**
+ * The cached icon information, indexed by window handle.
+ */
+
+static struct hash_table *icons_window_index = NULL;
+
+/* Function Prototypes. */
+
+static void icons_set_flags(wimp_w w, wimp_i i, wimp_icon_flags value, wimp_icon_flags mask);
+static wimp_icon_flags icons_get_flags(wimp_w w, wimp_i i);
+static struct icons_update *icons_find_update(wimp_i i);
+static struct icons_window *icons_find_window(wimp_w w);
+static struct icons_writable *icons_find_writable(wimp_w w);
+static osbool icons_test_caret_target(wimp_w w, wimp_i i);
+
 
 /* Copy the text of an icon (indirected or otherwise) into the supplied buffer.
  *
@@ -147,57 +227,137 @@ size_t icons_get_indirected_text_length(wimp_w w, wimp_i i)
 
 osbool icons_get_validation_command(char *buffer, size_t length, wimp_w w, wimp_i i, char command)
 {
-	char		*validation;
+	struct icons_validation	parsed;
+	char			*validation;
 
 	validation = icons_get_validation_addr(w, i);
 
-	if (validation == NULL)
+	if (validation == NULL || validation == (char *) -1)
 		return FALSE;
 
-	return icons_extract_validation_command(buffer, length, validation, command);
+	/* Parse the validation string on the stack. */
+
+	icons_parse_validation(&parsed, validation);
+
+	return icons_copy_validation_command(buffer, length, &parsed, command);
 }
 
 
 /* Extract a 'command' from an icon validation string.
- * 
+ *
  * This is an external interface, documented in icons.h
- */ 
+ */
 
 osbool icons_extract_validation_command(char *buffer, size_t length, char *validation, char command)
 {
-	size_t		len;
-	char		*copy, *part;
-	osbool		found = FALSE;
+	struct icons_validation	parsed;
 
-	if (buffer == NULL || length == 0)
+	if (buffer == NULL || length == 0 || validation == NULL)
 		return FALSE;
 
-	*buffer = '\0';
-	command = toupper(command);
+	icons_parse_validation(&parsed, validation);
 
-	len = strlen(validation) + 1;
-	copy = malloc(len);
+	return icons_copy_validation_command(buffer, length, &parsed, command);
+}
 
-	if (copy == NULL)
-		return FALSE;
 
-	string_ctrl_strncpy(copy, validation, len);
-	part = strtok(copy, ";");
+/* Parse a validation string into a table of command offsets.
+ *
+ * This is an external interface, documented in icons.h
+ */
+
+void icons_parse_validation(struct icons_validation *parsed, char *validation)
+{
+	size_t		start, end;
+	int		command;
+
+	if (parsed == NULL)
+		return;
+
+	parsed->validation = validation;
+
+	for (command = 0; command < ICONS_VALIDATION_COMMANDS; command++) {
+		parsed->start[command] = 0;
+		parsed->length[command] = 0;
+	}
+
+	if (validation == NULL)
+		return;
+
+	/* Step through the ;-separated commands until a control character is
+	 * found, recording the last instance of each command letter.
+	 */
+
+	start = 0;
+
+	while (validation[start] >= ' ') {
+		for (end = start; validation[end] >= ' ' && validation[end] != ';'; end++);
 
-	while (part != NULL) {
-		if (toupper(*part) == command) {
-			string_ctrl_copy(buffer, part + 1, length);
-			found = TRUE;
+		if (end >= ICONS_VALIDATION_MAX_LEN)
+			break;
+
+		command = toupper(validation[start]) - 'A';
+
+		if (end > start && command >= 0 && command < ICONS_VALIDATION_COMMANDS) {
+			parsed->start[command] = start + 2;
+			parsed->length[command] = end - (start + 1);
 		}
 
-		part = strtok(NULL, ";");
+		start = (validation[end] == ';') ? end + 1 : end;
 	}
+}
+
 
-	free(copy);
+/* Find a command in a parsed validation string.
+ *
+ * This is an external interface, documented in icons.h
+ */
+
+char *icons_find_validation_command(struct icons_validation *parsed, char command, size_t *length)
+{
+	int		index;
+
+	if (parsed == NULL || parsed->validation == NULL)
+		return NULL;
+
+	index = toupper(command) - 'A';
+
+	if (index < 0 || index >= ICONS_VALIDATION_COMMANDS || parsed->start[index] == 0)
+		return NULL;
+
+	if (length != NULL)
+		*length = parsed->length[index];
+
+	return parsed->validation + parsed->start[index] - 1;
+}
+
+
+/* Copy a command from a parsed validation string into a buffer.
+ *
+ * This is an external interface, documented in icons.h
+ */
 
-	buffer[length - 1] = '\0';
+osbool icons_copy_validation_command(char *buffer, size_t length, struct icons_validation *parsed, char command)
+{
+	char		*text;
+	size_t		size;
+
+	if (buffer == NULL || length == 0)
+		return FALSE;
+
+	*buffer = '\0';
+
+	text = icons_find_validation_command(parsed, command, &size);
+	if (text == NULL)
+		return FALSE;
+
+	if (size >= length)
+		size = length - 1;
 
-	return found;
+	memcpy(buffer, text, size);
+	buffer[size] = '\0';
+
+	return TRUE;
 }
 
 
@@ -324,7 +484,7 @@ char *icons_msgs_param_lookup(wimp_w w, wimp_i i, char *token, char *a, char *b,
 
 void icons_set_selected(wimp_w w, wimp_i i, osbool selected)
 {
-	wimp_set_icon_state(w, i, (selected) ? wimp_ICON_SELECTED : 0, wimp_ICON_SELECTED);
+	icons_set_flags(w, i, (selected) ? wimp_ICON_SELECTED : 0, wimp_ICON_SELECTED);
 }
 
 
@@ -335,7 +495,7 @@ void icons_set_selected(wimp_w w, wimp_i i, osbool selected)
 
 void icons_set_shaded(wimp_w w, wimp_i i, osbool shaded)
 {
-	wimp_set_icon_state(w, i, (shaded) ? wimp_ICON_SHADED : 0, wimp_ICON_SHADED);
+	icons_set_flags(w, i, (shaded) ? wimp_ICON_SHADED : 0, wimp_ICON_SHADED);
 }
 
 
@@ -346,7 +506,7 @@ void icons_set_shaded(wimp_w w, wimp_i i, osbool shaded)
 
 void icons_set_deleted(wimp_w w, wimp_i i, osbool deleted)
 {
-	wimp_set_icon_state(w, i, (deleted) ? wimp_ICON_DELETED : 0, wimp_ICON_DELETED);
+	icons_set_flags(w, i, (deleted) ? wimp_ICON_DELETED : 0, wimp_ICON_DELETED);
 }
 
 
@@ -357,13 +517,7 @@ void icons_set_deleted(wimp_w w, wimp_i i, osbool deleted)
 
 osbool icons_get_selected(wimp_w w, wimp_i i)
 {
-	wimp_icon_state		icon;
-
-	icon.w = w;
-	icon.i = i;
-	wimp_get_icon_state(&icon);
-
-	return ((icon.icon.flags & wimp_ICON_SELECTED) != 0) ? TRUE : FALSE;
+	return ((icons_get_flags(w, i) & wimp_ICON_SELECTED) != 0) ? TRUE : FALSE;
 }
 
 
@@ -374,13 +528,61 @@ osbool icons_get_selected(wimp_w w, wimp_i i)
 
 osbool icons_get_shaded(wimp_w w, wimp_i i)
 {
-	wimp_icon_state		icon;
+	return ((icons_get_flags(w, i) & wimp_ICON_SHADED) != 0) ? TRUE : FALSE;
+}
 
-	icon.w = w;
-	icon.i = i;
-	wimp_get_icon_state(&icon);
 
-	return ((icon.icon.flags & wimp_ICON_SHADED) != 0) ? TRUE : FALSE;
+/* Start a batched update of the icon states in a window.
+ *
+ * This is an external interface, documented in icons.h
+ */
+
+osbool icons_begin_update(wimp_w window)
+{
+	if (window == NULL || (icons_update_window != NULL && icons_update_window != window))
+		return FALSE;
+
+	icons_update_window = window;
+	icons_update_depth++;
+
+	return TRUE;
+}
+
+
+/* End a batched update of the icon states in a window, applying any
+ * pending changes if this is the outermost update.
+ *
+ * This is an external interface, documented in icons.h
+ */
+
+void icons_commit_update(void)
+{
+	unsigned int		i;
+	wimp_icon_state		state;
+	struct icons_update	*update;
+
+	if (icons_update_window == NULL || icons_update_depth == 0 || --icons_update_depth > 0)
+		return;
+
+	/* Apply the changes to any icons which aren't already in the
+	 * required state, so that they are only redrawn if necessary.
+	 */
+
+	state.w = icons_update_window;
+
+	for (i = 0; i < icons_update_count; i++) {
+		update = icons_update_list + i;
+
+		state.i = update->icon;
+		if (xwimp_get_icon_state(&state) != NULL)
+			continue;
+
+		if ((state.icon.flags & update->mask) != update->value)
+			wimp_set_icon_state(icons_update_window, update->icon, update->value, update->mask);
+	}
+
+	icons_update_window = NULL;
+	icons_update_count = 0;
 }
 
 
@@ -393,12 +595,18 @@ void icons_set_group_shaded(wimp_w window, osbool shaded, int icons, ...)
 {
 	int		i;
 	va_list		ap;
+	osbool		batch;
 
 	va_start(ap, icons);
 
+	batch = icons_begin_update(window);
+
 	for (i=0; i<icons; i++)
 		icons_set_shaded(window, va_arg(ap, wimp_i), shaded);
 
+	if (batch)
+		icons_commit_update();
+
 	va_end(ap);
 }
 
@@ -414,14 +622,20 @@ void icons_set_group_deleted_when_off(wimp_w window, wimp_i icon, int icons, ...
 {
 	int		i, state;
 	va_list		ap;
+	osbool		batch;
 
 	va_start(ap, icons);
 
+	batch = icons_begin_update(window);
+
 	state = !icons_get_selected(window, icon);
 
 	for (i=0; i<icons; i++)
 		icons_set_deleted(window, va_arg(ap, wimp_i), state);
 
+	if (batch)
+		icons_commit_update();
+
 	va_end(ap);
 }
 
@@ -437,14 +651,20 @@ void icons_set_group_deleted_when_on(wimp_w window, wimp_i icon, int icons, ...)
 {
 	int		i, state;
 	va_list	ap;
+	osbool		batch;
 
 	va_start(ap, icons);
 
+	batch = icons_begin_update(window);
+
 	state = icons_get_selected(window, icon);
 
 	for (i=0; i<icons; i++)
 		icons_set_deleted(window, va_arg(ap, wimp_i), state);
 
+	if (batch)
+		icons_commit_update();
+
 	va_end(ap);
 }
 
@@ -461,14 +681,20 @@ void icons_set_group_shaded_when_off(wimp_w window, wimp_i icon, int icons, ...)
 {
 	int		i, state;
 	va_list		ap;
+	osbool		batch;
 
 	va_start(ap, icons);
 
+	batch = icons_begin_update(window);
+
 	state = !icons_get_selected(window, icon);
 
 	for (i=0; i<icons; i++)
 		icons_set_shaded(window, va_arg(ap, wimp_i), state);
 
+	if (batch)
+		icons_commit_update();
+
 	va_end(ap);
 }
 
@@ -484,14 +710,20 @@ void icons_set_group_shaded_when_on(wimp_w window, wimp_i icon, int icons, ...)
 {
 	int		i, state;
 	va_list	ap;
+	osbool		batch;
 
 	va_start(ap, icons);
 
+	batch = icons_begin_update(window);
+
 	state = icons_get_selected(window, icon);
 
 	for (i=0; i<icons; i++)
 		icons_set_shaded(window, va_arg(ap, wimp_i), state);
 
+	if (batch)
+		icons_commit_update();
+
 	va_end(ap);
 }
 
@@ -506,12 +738,18 @@ void icons_set_radio_group_selected(wimp_w window, int selected, int icons, ...)
 {
 	int		i;
 	va_list		ap;
+	osbool		batch;
 
 	va_start(ap, icons);
 
+	batch = icons_begin_update(window);
+
 	for (i=0; i<icons; i++)
 		icons_set_selected(window, va_arg(ap, wimp_i), selected == i);
 
+	if (batch)
+		icons_commit_update();
+
 	va_end(ap);
 }
 
@@ -633,10 +871,10 @@ void icons_put_caret_in_group(wimp_w window, int icons, ...)
 
 void icons_replace_caret_in_window(wimp_w window)
 {
-	int			i, old_icon, new_icon, type;
+	int			lower, upper;
 	wimp_caret		caret;
 	wimp_icon_state		state;
-	wimp_window_info	*info, *new;
+	struct icons_writable	*writable;
 
 	wimp_get_caret_position(&caret);
 
@@ -647,81 +885,76 @@ void icons_replace_caret_in_window(wimp_w window)
 	state.i = caret.i;
 	wimp_get_icon_state(&state);
 
-	if ((state.icon.flags & (wimp_ICON_SHADED | wimp_ICON_DELETED)) != 0) {
-		/* If the icon where the caret is located is now shaded or deleted, it needs to be moved.  To do this,
-		 * we need to know where the other writable icons are.  This is done by getting the window definition
-		 * and scanning through the icons looking for a writable one to place the caret into.  The numerically
-		 * nearest icon to the original is used.
-		 */
+	if ((state.icon.flags & (wimp_ICON_SHADED | wimp_ICON_DELETED)) == 0) {
+		wimp_set_caret_position(caret.w, caret.i, 0, 0, -1, caret.index);
+		return;
+	}
+
+	/* If the icon where the caret is located is now shaded or deleted, it needs to be moved.  To do this,
+	 * we need to know where the other writable icons are, which are cached from the window definition.
+	 * The numerically nearest icon to the original which isn't shaded or deleted is used, with lower
+	 * icons being preferred at the same distance.
+	 */
 
-		/* First, claim some memory to get the definition into.  This is big enough for the header only info
-		 * (to find out how many icons there are) and may also do for the full definition.
-		 */
+	writable = icons_find_writable(window);
 
-		info = (wimp_window_info *) malloc(4096);
+	if (writable == NULL) {
+		/* If the writable icons couldn't be found, fall back to dumping the caret into the workspace. */
 
-		if (info != NULL) {
-			/* We got some memory, so get the window definitin header and check the number of icons. */
+		icons_put_caret_at_end(caret.w, wimp_ICON_WINDOW);
+		return;
+	}
 
-			info->w = window;
-			wimp_get_window_info_header_only(info);
+	/* Find the first cached icon above the original, then work outwards in both directions. */
 
-			if ((88 + 32 * info->icon_count) > sizeof (info)) {
-				/* If there are too many icons to fit out block, expand it.  If that fails, the original block is freed
-				 * and the pointer set to NULL.
-				 */
+	for (upper = 0; upper < writable->count && writable->icons[upper] < caret.i; upper++);
 
-				new = (wimp_window_info *) realloc(info, (88 + 32 * info->icon_count));
+	lower = upper - 1;
 
-				if (new == NULL)
-					free(info);
-				info = new;
-			}
+	if (upper < writable->count && writable->icons[upper] == caret.i)
+		upper++;
 
-			if (info != NULL) {
-				/* we've got enough memory to take the full window definition, so get that. */
+	while (lower >= 0 || upper < writable->count) {
+		if (lower >= 0 && (upper >= writable->count || (caret.i - writable->icons[lower]) <= (writable->icons[upper] - caret.i))) {
+			if (icons_test_caret_target(window, writable->icons[lower])) {
+				icons_put_caret_at_end(caret.w, writable->icons[lower]);
+				return;
+			}
 
-				info->w = window;
-				wimp_get_window_info(info);
+			lower--;
+		} else {
+			if (icons_test_caret_target(window, writable->icons[upper])) {
+				icons_put_caret_at_end(caret.w, writable->icons[upper]);
+				return;
+			}
 
-				old_icon = caret.i;
-				new_icon = -1;
+			upper++;
+		}
+	}
 
-				/* For each icon, see if it's writable and not shaded or deleted.  If so, check if it's closer to
-				 * the original icon than the current 'new_icon'; if so, update the new icon.
-				 */
+	/* If no suitable new icon was found, dump the caret into the work area. */
 
-				for (i = 0; i < info->icon_count; i++) {
-					type = ((info->icons[i].flags & wimp_ICON_BUTTON_TYPE) >> wimp_ICON_BUTTON_TYPE_SHIFT);
+	icons_put_caret_at_end(caret.w, wimp_ICON_WINDOW);
+}
 
-					if ((type == wimp_BUTTON_WRITE_CLICK_DRAG || type == wimp_BUTTON_WRITABLE) &&
-							((info->icons[i].flags & (wimp_ICON_SHADED | wimp_ICON_DELETED)) == 0)) {
-						if ((abs (old_icon - i) < abs (old_icon - new_icon)) || new_icon == -1)
-							new_icon = i;
-					}
-				}
 
-				/* If we found a suitable new icon, put the caret at the end; if not, dump it into the work area. */
+/* Discard any information cached about the icons in a window.
+ *
+ * This is an external interface, documented in icons.h
+ */
 
-				if (new_icon != -1)
-					icons_put_caret_at_end(caret.w, new_icon);
-				else
-					icons_put_caret_at_end(caret.w, wimp_ICON_WINDOW);
+void icons_invalidate_window_cache(wimp_w window)
+{
+	struct icons_window	*cache;
 
-				free(info);
-			} else {
-				/* If the block expansion failed, fall back to dumping the caret into the workspace. */
+	cache = hash_remove(icons_window_index, (unsigned int) window);
+	if (cache == NULL)
+		return;
 
-				icons_put_caret_at_end(caret.w, wimp_ICON_WINDOW);
-			}
-		} else {
-			/* If the initial memory allocation failed, fall back to dumping the caret into the workspace. */
+	if (cache->writable != NULL)
+		free(cache->writable);
 
-			icons_put_caret_at_end(caret.w, wimp_ICON_WINDOW);
-		}
-	} else {
-		wimp_set_caret_position(caret.w, caret.i, 0, 0, -1, caret.index);
-	}
+	free(cache);
 }
 
 
@@ -769,3 +1002,236 @@ void icons_insert_text(wimp_w w, wimp_i i, int index, char *text, int n)
 	wimp_set_icon_state(w, i, 0, 0);
 }
 
+
+/**
+ * Change the flags of an icon, or record the change if a batched update
+ * is open for the icon's window.
+ *
+ * \param w			The window containing the icon.
+ * \param i			The icon to be updated.
+ * \param value		The required values of the flags being changed.
+ * \param mask			The flags to be changed.
+ */
+
+static void icons_set_flags(wimp_w w, wimp_i i, wimp_icon_flags value, wimp_icon_flags mask)
+{
+	struct icons_update	*update, *list;
+	unsigned int		allocation;
+
+	if (w != icons_update_window) {
+		wimp_set_icon_state(w, i, value, mask);
+		return;
+	}
+
+	/* Find an existing entry for the icon, or add a new one. */
+
+	update = icons_find_update(i);
+
+	if (update == NULL) {
+		if (icons_update_count >= icons_update_allocation) {
+			allocation = icons_update_allocation + ICONS_UPDATE_BLOCK_SIZE;
+
+			list = realloc(icons_update_list, allocation * sizeof(struct icons_update));
+			if (list == NULL) {
+				wimp_set_icon_state(w, i, value, mask);
+				return;
+			}
+
+			icons_update_list = list;
+			icons_update_allocation = allocation;
+		}
+
+		update = icons_update_list + icons_update_count++;
+
+		update->icon = i;
+		update->mask = 0;
+		update->value = 0;
+	}
+
+	/* Merge the new change with any earlier ones. */
+
+	update->mask |= mask;
+	update->value = (update->value & ~mask) | (value & mask);
+}
+
+
+/**
+ * Read the flags of an icon, including any changes pending in a batched
+ * update for the icon's window.
+ *
+ * \param w			The window containing the icon.
+ * \param i			The icon to be read.
+ * \return			The icon's flags.
+ */
+
+static wimp_icon_flags icons_get_flags(wimp_w w, wimp_i i)
+{
+	wimp_icon_state		icon;
+	struct icons_update	*update;
+
+	icon.w = w;
+	icon.i = i;
+	wimp_get_icon_state(&icon);
+
+	if (w != icons_update_window)
+		return icon.icon.flags;
+
+	update = icons_find_update(i);
+	if (update == NULL)
+		return icon.icon.flags;
+
+	return (icon.icon.flags & ~update->mask) | update->value;
+}
+
+
+/**
+ * Find the pending change for an icon in the current batched update.
+ *
+ * \param i			The icon to find.
+ * \return			The pending change, or NULL if none.
+ */
+
+static struct icons_update *icons_find_update(wimp_i i)
+{
+	unsigned int	index;
+
+	for (index = 0; index < icons_update_count; index++) {
+		if (icons_update_list[index].icon == i)
+			return icons_update_list + index;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Find the cached icon information for a window, creating an empty entry
+ * if there isn't one already.
+ *
+ * \param w			The window of interest.
+ * \return			The cached information, or NULL on failure.
+ */
+
+static struct icons_window *icons_find_window(wimp_w w)
+{
+	struct icons_window	*cache;
+
+	cache = hash_find(icons_window_index, (unsigned int) w);
+	if (cache != NULL)
+		return cache;
+
+	if (icons_window_index == NULL) {
+		icons_window_index = hash_create(0);
+		if (icons_window_index == NULL)
+			return NULL;
+	}
+
+	cache = malloc(sizeof(struct icons_window));
+	if (cache == NULL)
+		return NULL;
+
+	cache->w = w;
+	cache->writable = NULL;
+
+	if (!hash_add(icons_window_index, (unsigned int) w, cache)) {
+		free(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+
+/**
+ * Find the cached list of writable icons for a window, reading the window
+ * definition to build it if necessary.
+ *
+ * \param w			The window of interest.
+ * \return			The writable icon list, or NULL on failure.
+ */
+
+static struct icons_writable *icons_find_writable(wimp_w w)
+{
+	struct icons_window	*cache;
+	struct icons_writable	*writable;
+	wimp_window_info	header, *info;
+	int			i, type;
+
+	cache = icons_find_window(w);
+	if (cache == NULL)
+		return NULL;
+
+	if (cache->writable != NULL)
+		return cache->writable;
+
+	/* Get the window definition header, to find out how many icons there are. */
+
+	header.w = w;
+	if (xwimp_get_window_info_header_only(&header) != NULL)
+		return NULL;
+
+	/* Claim enough memory for the full definition, and get that. */
+
+	info = malloc(88 + 32 * header.icon_count);
+	if (info == NULL)
+		return NULL;
+
+	info->w = w;
+	if (xwimp_get_window_info(info) != NULL) {
+		free(info);
+		return NULL;
+	}
+
+	writable = malloc(sizeof(struct icons_writable) + info->icon_count * sizeof(wimp_i));
+	if (writable == NULL) {
+		free(info);
+		return NULL;
+	}
+
+	/* Record each icon which is writable, in ascending order. */
+
+	writable->count = 0;
+
+	for (i = 0; i < info->icon_count; i++) {
+		type = ((info->icons[i].flags & wimp_ICON_BUTTON_TYPE) >> wimp_ICON_BUTTON_TYPE_SHIFT);
+
+		if (type == wimp_BUTTON_WRITE_CLICK_DRAG || type == wimp_BUTTON_WRITABLE)
+			writable->icons[writable->count++] = i;
+	}
+
+	free(info);
+
+	cache->writable = writable;
+
+	return writable;
+}
+
+
+/**
+ * Test whether an icon can take the caret, by checking that it is still
+ * writable and that it isn't shaded or deleted. The button type is checked
+ * again, as the icon may have been replaced since the writable icon list
+ * was cached.
+ *
+ * \param w			The window containing the icon.
+ * \param i			The icon to test.
+ * \return			TRUE if the icon can take the caret; else FALSE.
+ */
+
+static osbool icons_test_caret_target(wimp_w w, wimp_i i)
+{
+	wimp_icon_state		state;
+	int			type;
+
+	state.w = w;
+	state.i = i;
+	if (xwimp_get_icon_state(&state) != NULL)
+		return FALSE;
+
+	if ((state.icon.flags & (wimp_ICON_SHADED | wimp_ICON_DELETED)) != 0)
+		return FALSE;
+
+	type = ((state.icon.flags & wimp_ICON_BUTTON_TYPE) >> wimp_ICON_BUTTON_TYPE_SHIFT);
+
+	return (type == wimp_BUTTON_WRITE_CLICK_DRAG || type == wimp_BUTTON_WRITABLE) ? TRUE : FALSE;
+}
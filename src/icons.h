@@ -34,6 +34,31 @@
 #include <stddef.h>
 #include "oslib/wimp.h"
 
+/**
+ * The number of validation commands which can be held in a parsed
+ * validation string: one for each of the letters A to Z.
+ */
+
+#define ICONS_VALIDATION_COMMANDS 26
+
+/**
+ * The maximum length of validation string which can be parsed; any
+ * commands beyond this are ignored.
+ */
+
+#define ICONS_VALIDATION_MAX_LEN 65535
+
+/**
+ * A parsed validation string, holding the location of each command so
+ * that they can be looked up without scanning the string again.
+ */
+
+struct icons_validation {
+	char			*validation;				/**< The validation string which was parsed.			*/
+	unsigned short		start[ICONS_VALIDATION_COMMANDS];	/**< The offset of each command's text plus one, or 0 if absent.	*/
+	unsigned short		length[ICONS_VALIDATION_COMMANDS];	/**< The length of each command's text.				*/
+};
+
 
 /**
  * Copy the text of an icon (indirected or otherwise) into the supplied buffer.
@@ -109,6 +134,45 @@ osbool icons_get_validation_command(char *buffer, size_t length, wimp_w w, wimp_
 osbool icons_extract_validation_command(char *buffer, size_t length, char *validation, char command);
 
 
+/**
+ * Parse a validation string into a table of command locations. Only the
+ * last instance of each command is recorded. The parsed table refers into
+ * the original string, which must remain in place while it is in use.
+ *
+ * \param *parsed	Pointer to the block to take the parsed string.
+ * \param *validation	Pointer to the validation string to be processed.
+ */
+
+void icons_parse_validation(struct icons_validation *parsed, char *validation);
+
+
+/**
+ * Find a command in a parsed validation string, returning a pointer to
+ * its text within the original string. The text is not terminated.
+ *
+ * \param *parsed	The parsed validation string to search.
+ * \param command	The single character validation command to find.
+ * \param *length	Pointer to a variable to take the length of the
+ *			command's text, or NULL.
+ * \return		Pointer to the command's text, or NULL if not found.
+ */
+
+char *icons_find_validation_command(struct icons_validation *parsed, char command, size_t *length);
+
+
+/**
+ * Copy a command from a parsed validation string into a buffer.
+ *
+ * \param *buffer	Pointer to a buffer to take the returned text.
+ * \param length	The length of the supplied buffer.
+ * \param *parsed	The parsed validation string to search.
+ * \param command	The single character validation command to return.
+ * \return		TRUE if the command code was found; else FALSE.
+ */
+
+osbool icons_copy_validation_command(char *buffer, size_t length, struct icons_validation *parsed, char command);
+
+
 /**
  * Perform an sprintf() into an icon, assuming that it is indirected.  The
  * icon details are trusted, including buffer length.
@@ -221,6 +285,39 @@ osbool icons_get_selected(wimp_w w, wimp_i i);
 osbool icons_get_shaded(wimp_w w, wimp_i i);
 
 
+/**
+ * Start a batched update of the icon states in a window. Until the update
+ * is committed, changes made to icons in the window by icons_set_selected(),
+ * icons_set_shaded(), icons_set_deleted() and the group functions are only
+ * recorded, while icons_get_selected() and icons_get_shaded() report the
+ * pending states.
+ *
+ * Updates can be nested for the same window, with the changes being applied
+ * when the outermost update is committed. Only one window can have an
+ * update open at a time.
+ *
+ * \param window	The window containing the icons to be updated.
+ * \return		TRUE if the update was started; FALSE if an update
+ *			is already open for another window.
+ */
+
+osbool icons_begin_update(wimp_w window);
+
+
+/**
+ * End a batched update of the icon states in a window. If this is the
+ * outermost update, all of the pending changes are applied: each icon is
+ * updated once, and icons which are already in the required state are
+ * left alone so that they are not redrawn.
+ *
+ * Caret handling functions, such as icons_replace_caret_in_window(), read
+ * the icon states directly and should be called after the update has been
+ * committed.
+ */
+
+void icons_commit_update(void);
+
+
 /**
  * Change the shaded state of a group of icons.
  *
@@ -362,6 +459,19 @@ void icons_put_caret_in_group(wimp_w window, int icons, ...);
 void icons_replace_caret_in_window(wimp_w window);
 
 
+/**
+ * Discard any information cached about the icons in a window, such as the
+ * list of writable icons used by icons_replace_caret_in_window(). This must
+ * be called if icons are created in or deleted from a window after the
+ * caret has been replaced within it; event_delete_window() and
+ * event_delete_icon() call it automatically.
+ *
+ * \param window	The window whose icons have changed.
+ */
+
+void icons_invalidate_window_cache(wimp_w window);
+
+
 /**
  * Insert text into an icon, updating the caret position if applicable.
  *
@@ -48,6 +48,7 @@
 #include "errors.h"
 #include "event.h"
 #include "general.h"
+#include "hash.h"
 #include "icons.h"
 #include "string.h"
 #include "msgs.h"
@@ -57,6 +58,7 @@
 #define OBJECT_MODIFIER_LENGTH 13
 #define MENU_TOKEN_LENGTH 64
 #define TOKEN_LENGTH 128
+#define IHELP_CACHE_SIZE 8							/**< The number of help replies to cache.			*/
 
 /* ==================================================================================================================
  * Data structures
@@ -67,33 +69,59 @@ struct ihelp_window {
 	char			name[OBJECT_NAME_LENGTH];
 	char			modifier[OBJECT_MODIFIER_LENGTH];
 	void			(*pointer_location) (char *, wimp_w, wimp_i, os_coord, wimp_mouse_state);
-
-	struct ihelp_window	*next;
 };
 
 
 struct ihelp_menu {
 	wimp_menu		*menu;
 	char			name[OBJECT_NAME_LENGTH];
+};
+
+/**
+ * A cached help reply, which can be re-used for subsequent requests over
+ * the same window and icon, or menu entry. Window replies are also keyed on
+ * the icon name, so that a reply isn't re-used if the icon is deleted and
+ * recreated with a different name.
+ */
 
-	struct ihelp_menu	*next;
+struct ihelp_cache_entry {
+	osbool			valid;						/**< TRUE if the entry holds a reply; else FALSE.		*/
+	unsigned int		last_used;					/**< The value of the cache clock when last used.		*/
+
+	wimp_w			window;						/**< The window handle, or NULL for a menu.			*/
+	wimp_i			icon;						/**< The icon handle.						*/
+	char			name[IHELP_INAME_LEN];				/**< The icon name, or an empty string for a menu.		*/
+	wimp_menu		*menu;						/**< The menu, or NULL for a window.				*/
+	wimp_selection		selection;					/**< The menu selection, for a menu.				*/
+
+	char			reply[IHELP_LENGTH];				/**< The help text to be returned.				*/
 };
 
 /* ==================================================================================================================
  * Global variables.
  */
 
-static struct ihelp_window	*windows = NULL;
-static struct ihelp_menu	*menus = NULL;
+static struct hash_table	*windows = NULL;				/**< The index of windows with help definitions.		*/
+static struct hash_table	*menus = NULL;					/**< The index of menus with help definitions.			*/
 static char			default_menu_help_token[MENU_TOKEN_LENGTH];
 
+static struct ihelp_cache_entry	ihelp_cache[IHELP_CACHE_SIZE];			/**< The cache of recent help replies.				*/
+static unsigned int		ihelp_cache_clock = 0;				/**< A counter used to find the least recently used reply.	*/
+static unsigned int		ihelp_cache_generation = 0;			/**< The messages file generation used by the cache.		*/
+
 
 /* Function prototypes */
 
+static osbool			ihelp_add_window_entry(wimp_w window, char* name, void (*decode) (char *, wimp_w, wimp_i, os_coord, wimp_mouse_state));
 static struct ihelp_window	*ihelp_find_window(wimp_w window);
+static osbool			ihelp_add_menu_entry(wimp_menu *menu, char* name);
 static struct ihelp_menu	*ihelp_find_menu(wimp_menu *menu);
 static osbool			ihelp_send_reply_help_request(wimp_message *message);
 static char			*ihelp_get_text(char *buffer, size_t length, wimp_w window, wimp_i icon, os_coord pos, wimp_mouse_state buttons);
+static osbool			ihelp_find_cached(char *buffer, size_t length, wimp_w window, wimp_i icon, char *name, wimp_menu *menu, wimp_selection *selection);
+static void			ihelp_add_cached(char *buffer, wimp_w window, wimp_i icon, char *name, wimp_menu *menu, wimp_selection *selection);
+static osbool			ihelp_match_selection(wimp_selection *a, wimp_selection *b);
+static void			ihelp_flush_cache(void);
 
 
 /**
@@ -113,24 +141,80 @@ void ihelp_initialise(void)
  */
 
 void ihelp_add_window(wimp_w window, char* name, void (*decode) (char *, wimp_w, wimp_i, os_coord, wimp_mouse_state))
+{
+	if (ihelp_add_window_entry(window, name, decode))
+		ihelp_flush_cache();
+}
+
+
+/**
+ * Add a set of new interactive help window definitions in one go.
+ *
+ * This is an external interface, documented in ihelp.h.
+ */
+
+osbool ihelp_add_windows(struct ihelp_window_definition *definitions, int count)
+{
+	osbool	success = TRUE;
+	int	i;
+
+	if (definitions == NULL || count <= 0)
+		return TRUE;
+
+	/* Size the index for all of the windows at once, if it's new. */
+
+	if (windows == NULL)
+		windows = hash_create(count);
+
+	for (i = 0; i < count; i++) {
+		if (!ihelp_add_window_entry(definitions[i].window, definitions[i].name, definitions[i].decode))
+			success = FALSE;
+	}
+
+	ihelp_flush_cache();
+
+	return success;
+}
+
+
+/**
+ * Add a new interactive help window definition to the window index.
+ *
+ * \param window		The window handle to attach help to.
+ * \param *name			The token name to associate with the window.
+ * \param *decode		A function to use to help decode clicks in the window.
+ * \return			TRUE if the window was added; else FALSE.
+ */
+
+static osbool ihelp_add_window_entry(wimp_w window, char* name, void (*decode) (char *, wimp_w, wimp_i, os_coord, wimp_mouse_state))
 {
 	struct ihelp_window	*new;
 
+	if (windows == NULL) {
+		windows = hash_create(0);
+		if (windows == NULL)
+			return FALSE;
+	}
+
 	if (ihelp_find_window(window) != NULL)
-		return;
+		return FALSE;
 
 	new = malloc(sizeof(struct ihelp_window));
 
 	if (new == NULL)
-		return;
+		return FALSE;
 
 	new->window = window;
 	string_copy(new->name, name, OBJECT_NAME_LENGTH);
 	*(new->modifier) = '\0';
 	new->pointer_location = decode;
 
-	new->next = windows;
-	windows = new;
+	if (!hash_add(windows, (unsigned int) window, new)) {
+		free(new);
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
 
@@ -142,22 +226,16 @@ void ihelp_add_window(wimp_w window, char* name, void (*decode) (char *, wimp_w,
 
 void ihelp_remove_window(wimp_w window)
 {
-	struct ihelp_window	**list, *del;
-
-	/* Delink the block and delete it. */
+	struct ihelp_window	*del;
 
-	list = &windows;
+	del = hash_remove(windows, (unsigned int) window);
 
-	while (*list != NULL && (*list)->window != window)
-		list = &((*list)->next);
-
-	if (*list == NULL)
+	if (del == NULL)
 		return;
 
-	del = *list;
-
-	*list = del->next;
 	free(del);
+
+	ihelp_flush_cache();
 }
 
 
@@ -177,6 +255,8 @@ void ihelp_set_modifier(wimp_w window, char *modifier)
 		return;
 
 	string_copy(window_data->modifier, (modifier != NULL) ? modifier : "", OBJECT_MODIFIER_LENGTH);
+
+	ihelp_flush_cache();
 }
 
 
@@ -189,40 +269,88 @@ void ihelp_set_modifier(wimp_w window, char *modifier)
 
 static struct ihelp_window *ihelp_find_window(wimp_w window)
 {
-	struct ihelp_window	*list;
+	return hash_find(windows, (unsigned int) window);
+}
 
-	list = windows;
 
-	while (list != NULL && list->window != window)
-		list = list->next;
+/**
+ * Add a new interactive help menu definition.
+ *
+ * This is an external interface, documented in ihelp.h.
+ */
 
-	return list;
+void ihelp_add_menu(wimp_menu *menu, char* name)
+{
+	if (ihelp_add_menu_entry(menu, name))
+		ihelp_flush_cache();
 }
 
 
 /**
- * Add a new interactive help menu definition.
+ * Add a set of new interactive help menu definitions in one go.
  *
  * This is an external interface, documented in ihelp.h.
  */
 
-void ihelp_add_menu(wimp_menu *menu, char* name)
+osbool ihelp_add_menus(struct ihelp_menu_definition *definitions, int count)
+{
+	osbool	success = TRUE;
+	int	i;
+
+	if (definitions == NULL || count <= 0)
+		return TRUE;
+
+	/* Size the index for all of the menus at once, if it's new. */
+
+	if (menus == NULL)
+		menus = hash_create(count);
+
+	for (i = 0; i < count; i++) {
+		if (!ihelp_add_menu_entry(definitions[i].menu, definitions[i].name))
+			success = FALSE;
+	}
+
+	ihelp_flush_cache();
+
+	return success;
+}
+
+
+/**
+ * Add a new interactive help menu definition to the menu index.
+ *
+ * \param *menu			The menu handle to attach help to.
+ * \param *name			The token name to associate with the menu.
+ * \return			TRUE if the menu was added; else FALSE.
+ */
+
+static osbool ihelp_add_menu_entry(wimp_menu *menu, char* name)
 {
 	struct ihelp_menu	*new;
 
+	if (menus == NULL) {
+		menus = hash_create(0);
+		if (menus == NULL)
+			return FALSE;
+	}
+
 	if (ihelp_find_menu(menu) != NULL)
-		return;
+		return FALSE;
 
 	new = malloc(sizeof(struct ihelp_menu));
 
 	if (new == NULL)
-		return;
+		return FALSE;
 
 	new->menu = menu;
 	string_copy(new->name, name, OBJECT_NAME_LENGTH);
 
-	new->next = menus;
-	menus = new;
+	if (!hash_add(menus, (unsigned int) menu, new)) {
+		free(new);
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
 
@@ -234,22 +362,16 @@ void ihelp_add_menu(wimp_menu *menu, char* name)
 
 void ihelp_remove_menu(wimp_menu *menu)
 {
-	struct ihelp_menu	**list, *del;
-
-	/* Delink the block and delete it. */
+	struct ihelp_menu	*del;
 
-	list = &menus;
+	del = hash_remove(menus, (unsigned int) menu);
 
-	while (*list != NULL && (*list)->menu != menu)
-		list = &((*list)->next);
-
-	if (*list == NULL)
+	if (del == NULL)
 		return;
 
-	del = *list;
-
-	*list = del->next;
 	free(del);
+
+	ihelp_flush_cache();
 }
 
 
@@ -263,6 +385,8 @@ void ihelp_remove_menu(wimp_menu *menu)
 void ihelp_set_default_menu_token(char *token)
 {
 	string_copy(default_menu_help_token, (token != NULL) ? token : "", MENU_TOKEN_LENGTH);
+
+	ihelp_flush_cache();
 }
 
 
@@ -275,14 +399,7 @@ void ihelp_set_default_menu_token(char *token)
 
 static struct ihelp_menu *ihelp_find_menu(wimp_menu *menu)
 {
-	struct ihelp_menu	*list;
-
-	list = menus;
-
-	while (list != NULL && list->menu != menu)
-		list = list->next;
-
-	return list;
+	return hash_find(menus, (unsigned int) menu);
 }
 
 
@@ -344,12 +461,23 @@ static char *ihelp_get_text(char *buffer, size_t length, wimp_w window, wimp_i i
 
 	*buffer = '\0';
 
+	/* If the messages file has changed, any cached replies are out of date. */
+
+	if (msgs_get_generation() != ihelp_cache_generation) {
+		ihelp_flush_cache();
+		ihelp_cache_generation = msgs_get_generation();
+	}
 
 	if (window == wimp_ICON_BAR) {
 		/* Special case, if the window is the iconbar. */
 
+		if (ihelp_find_cached(buffer, length, wimp_ICON_BAR, wimp_ICON_WINDOW, "", NULL, NULL))
+			return buffer;
+
 		if (msgs_lookup_result("Help.IconBar", help_text, IHELP_LENGTH))
 			string_copy(buffer, help_text, length);
+
+		ihelp_add_cached(buffer, wimp_ICON_BAR, wimp_ICON_WINDOW, "", NULL, NULL);
 	} else if ((window_data = ihelp_find_window(window)) != NULL) {
 		/* Otherwise, if the window is one of the windows registered for interactive help. */
 
@@ -368,6 +496,14 @@ static char *ihelp_get_text(char *buffer, size_t length, wimp_w window, wimp_i i
 		if (*icon_name == '\0' && icon >= 0 && !icons_get_validation_command(icon_name, IHELP_INAME_LEN, window, icon, 'N'))
 			string_printf(icon_name, IHELP_INAME_LEN, "Icon%d", icon);
 
+		/* The results from windows with decoding functions can depend on the pointer
+		 * position, so they can't be cached. Otherwise, a reply can be re-used if the
+		 * icon still has the same name.
+		 */
+
+		if (window_data->pointer_location == NULL && ihelp_find_cached(buffer, length, window, icon, icon_name, NULL, NULL))
+			return buffer;
+
 		/* If an icon name was found from somewhere, look up a token based on that name. */
 
 		if (*icon_name != '\0') {
@@ -386,6 +522,9 @@ static char *ihelp_get_text(char *buffer, size_t length, wimp_w window, wimp_i i
 
 		if (found)
 			string_copy(buffer, help_text, length);
+
+		if (window_data->pointer_location == NULL)
+			ihelp_add_cached(buffer, window, icon, icon_name, NULL, NULL);
 	} else {
 		/* Otherwise, try the window as a menu structure. */
 
@@ -395,6 +534,9 @@ static char *ihelp_get_text(char *buffer, size_t length, wimp_w window, wimp_i i
 		/* The list will be null if this isn't a menu belonging to us (or it isn't a menu at all...). */
 
 		if (menu_selection.items[0] != -1 && current_menu != NULL) {
+			if (ihelp_find_cached(buffer, length, NULL, wimp_ICON_WINDOW, "", current_menu, &menu_selection))
+				return buffer;
+
 			menu_data = ihelp_find_menu(current_menu);
 
 			if (menu_data != NULL || *default_menu_help_token != '\0') {
@@ -408,9 +550,126 @@ static char *ihelp_get_text(char *buffer, size_t length, wimp_w window, wimp_i i
 				if (msgs_lookup_result(token, help_text, IHELP_LENGTH))
 					string_copy(buffer, help_text, length);
 			}
+
+			ihelp_add_cached(buffer, NULL, wimp_ICON_WINDOW, "", current_menu, &menu_selection);
 		}
 	}
 
 	return buffer;
 }
 
+
+/**
+ * Look for a cached help reply matching a window and icon, or a menu
+ * selection, and copy it into the buffer supplied if one is found.
+ *
+ * \param *buffer		A buffer to take the interactive help text.
+ * \param length		The size of the buffer, in bytes.
+ * \param window		The window handle, or NULL for a menu.
+ * \param icon			The icon handle.
+ * \param *name			The icon name, or an empty string for a menu.
+ * \param *menu			The menu, or NULL for a window.
+ * \param *selection		The menu selection, or NULL for a window.
+ * \return			TRUE if a reply was found; else FALSE.
+ */
+
+static osbool ihelp_find_cached(char *buffer, size_t length, wimp_w window, wimp_i icon, char *name, wimp_menu *menu, wimp_selection *selection)
+{
+	int	i;
+
+	for (i = 0; i < IHELP_CACHE_SIZE; i++) {
+		if (!ihelp_cache[i].valid || ihelp_cache[i].window != window || ihelp_cache[i].icon != icon || ihelp_cache[i].menu != menu)
+			continue;
+
+		if (menu != NULL && !ihelp_match_selection(&(ihelp_cache[i].selection), selection))
+			continue;
+
+		if (strcmp(ihelp_cache[i].name, name) != 0)
+			continue;
+
+		ihelp_cache[i].last_used = ++ihelp_cache_clock;
+		string_copy(buffer, ihelp_cache[i].reply, length);
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+/**
+ * Store a help reply in the cache, replacing the least recently used entry.
+ *
+ * \param *buffer		The interactive help text to store.
+ * \param window		The window handle, or NULL for a menu.
+ * \param icon			The icon handle.
+ * \param *name			The icon name, or an empty string for a menu.
+ * \param *menu			The menu, or NULL for a window.
+ * \param *selection		The menu selection, or NULL for a window.
+ */
+
+static void ihelp_add_cached(char *buffer, wimp_w window, wimp_i icon, char *name, wimp_menu *menu, wimp_selection *selection)
+{
+	int	i, entry = 0;
+
+	for (i = 0; i < IHELP_CACHE_SIZE; i++) {
+		if (!ihelp_cache[i].valid) {
+			entry = i;
+			break;
+		}
+
+		if (ihelp_cache[i].last_used < ihelp_cache[entry].last_used)
+			entry = i;
+	}
+
+	ihelp_cache[entry].valid = TRUE;
+	ihelp_cache[entry].last_used = ++ihelp_cache_clock;
+	ihelp_cache[entry].window = window;
+	ihelp_cache[entry].icon = icon;
+	ihelp_cache[entry].menu = menu;
+
+	string_copy(ihelp_cache[entry].name, name, IHELP_INAME_LEN);
+
+	if (selection != NULL)
+		ihelp_cache[entry].selection = *selection;
+
+	string_copy(ihelp_cache[entry].reply, buffer, IHELP_LENGTH);
+}
+
+
+/**
+ * Test two menu selections to see if they refer to the same menu entry.
+ *
+ * \param *a			The first selection to compare.
+ * \param *b			The second selection to compare.
+ * \return			TRUE if the selections match; else FALSE.
+ */
+
+static osbool ihelp_match_selection(wimp_selection *a, wimp_selection *b)
+{
+	int	i;
+
+	for (i = 0; i < (int) (sizeof(a->items) / sizeof(a->items[0])); i++) {
+		if (a->items[i] != b->items[i])
+			return FALSE;
+
+		if (a->items[i] == -1)
+			break;
+	}
+
+	return TRUE;
+}
+
+
+/**
+ * Discard all of the cached help replies.
+ */
+
+static void ihelp_flush_cache(void)
+{
+	int	i;
+
+	for (i = 0; i < IHELP_CACHE_SIZE; i++)
+		ihelp_cache[i].valid = FALSE;
+}
+
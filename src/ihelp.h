@@ -42,6 +42,26 @@
 
 #define IHELP_INAME_LEN 64
 
+/**
+ * A window definition for bulk registration via ihelp_add_windows().
+ */
+
+struct ihelp_window_definition {
+	wimp_w		window;							/**< The window handle to attach help to.			*/
+	char		*name;							/**< The token name to associate with the window.		*/
+	void		(*decode) (char *, wimp_w, wimp_i, os_coord, wimp_mouse_state);
+										/**< A function to help decode clicks, or NULL.		*/
+};
+
+/**
+ * A menu definition for bulk registration via ihelp_add_menus().
+ */
+
+struct ihelp_menu_definition {
+	wimp_menu	*menu;							/**< The menu handle to attach help to.				*/
+	char		*name;							/**< The token name to associate with the menu.			*/
+};
+
 
 /**
  * Initialise the interactive help system.
@@ -61,6 +81,19 @@ void ihelp_initialise(void);
 void ihelp_add_window(wimp_w window, char* name, void (*decode) (char *, wimp_w, wimp_i, os_coord, wimp_mouse_state));
 
 
+/**
+ * Add a set of new interactive help window definitions in one go, such as
+ * for a group of windows created from templates at startup. Windows which
+ * already have definitions are left unchanged.
+ *
+ * \param *definitions		An array of window definitions to add.
+ * \param count			The number of definitions in the array.
+ * \return			TRUE if all the windows were added; else FALSE.
+ */
+
+osbool ihelp_add_windows(struct ihelp_window_definition *definitions, int count);
+
+
 /**
  * Remove an interactive help definition from the window list.
  *
@@ -90,6 +123,18 @@ void ihelp_set_modifier(wimp_w window, char *modifier);
 void ihelp_add_menu(wimp_menu *menu, char* name);
 
 
+/**
+ * Add a set of new interactive help menu definitions in one go. Menus
+ * which already have definitions are left unchanged.
+ *
+ * \param *definitions		An array of menu definitions to add.
+ * \param count			The number of definitions in the array.
+ * \return			TRUE if all the menus were added; else FALSE.
+ */
+
+osbool ihelp_add_menus(struct ihelp_menu_definition *definitions, int count);
+
+
 /**
  * Remove an interactive help definition from the menu list.
  *
@@ -36,6 +36,7 @@
 
 /* SF-Lib header files. */
 
+#include "hash.h"
 #include "menus.h"
 #include "windows.h"
 
@@ -91,6 +92,90 @@
 #define MENU_END_OF_LIST (-1)
 #define MENU_WORD_LENGTH (4)
 
+/* Allocation steps for dynamic menu builders. */
+
+#define MENUS_BUILDER_ENTRY_BLOCK (32)
+#define MENUS_BUILDER_TEXT_BLOCK (1024)
+
+/**
+ * A tag from a menu template block, held in an index.
+ */
+
+struct menus_tag {
+	char			*tag;						/**< The tag text, within the template block.			*/
+	int			*block;						/**< The tag's name block, within the template block.		*/
+
+	struct menus_tag	*chain;						/**< The next tag with the same hash key, or NULL.		*/
+};
+
+/**
+ * The tag indexes for a loaded menu template block.
+ */
+
+struct menus_index {
+	struct hash_table	*menus;						/**< The index of menu tags.					*/
+	struct hash_table	*dialogues;					/**< The index of dialogue box tags.				*/
+	struct menus_tag	*tags;						/**< The array of tags held in the indexes.			*/
+};
+
+/**
+ * An entry in a menu being built by a dynamic menu builder.
+ */
+
+struct menus_builder_entry {
+	size_t			text;						/**< The offset of the entry text in the text buffer.		*/
+	size_t			length;						/**< The length of the entry text, excluding the terminator.	*/
+	wimp_menu_flags		flags;						/**< The menu flags for the entry.				*/
+	wimp_menu		*sub_menu;					/**< The submenu for the entry, or NULL.			*/
+};
+
+/**
+ * A dynamic menu builder instance.
+ */
+
+struct menus_builder {
+	wimp_menu			*menu;					/**< The menu block, or NULL if none has been allocated.	*/
+	size_t				size;					/**< The allocated size of the menu block, in bytes.		*/
+	osbool				valid;					/**< TRUE if the menu block holds a completed menu.		*/
+	unsigned			version;				/**< The content version of the completed menu.			*/
+
+	struct menus_builder_entry	*entries;				/**< The entries added to the menu being built.			*/
+	unsigned			count;					/**< The number of entries added to the menu being built.	*/
+	unsigned			allocation;				/**< The number of entries allocated.				*/
+
+	char				*text;					/**< The buffer holding the text of the menu being built.	*/
+	size_t				text_used;				/**< The number of bytes used in the text buffer.		*/
+	size_t				text_size;				/**< The allocated size of the text buffer.			*/
+
+	size_t				title_length;				/**< The length of the title, which starts the text buffer.	*/
+	osbool				failed;					/**< TRUE if an allocation failed during the current build.	*/
+};
+
+
+static struct hash_table	*menus_indexes = NULL;				/**< The indexes of loaded template blocks, by address.		*/
+static struct menus_memory	*menus_memory_handlers = NULL;			/**< Client memory handlers for template blocks, or NULL.	*/
+
+
+static void		menus_build_index(menu_template data);
+static int		menus_count_tags(int *current, int text);
+static int		menus_index_tags(struct hash_table *table, struct menus_tag *tags, int *current, int text);
+static int		*menus_find_tag(menu_template data, char *tag, osbool dialogue);
+static int		*menus_get_tag_list(menu_template data, osbool dialogue);
+static int		menus_builder_get_width(char *text, size_t length);
+static osbool		menus_builder_add_text(struct menus_builder *builder, char *text, size_t *length);
+
+
+/* Set the memory handlers to be used for claiming template blocks.
+ *
+ * This is an external interface, documented in menus.h
+ */
+
+void menus_set_memory_handlers(struct menus_memory *handlers)
+{
+	menus_memory_handlers = handlers;
+}
+
+
 
 /* Load a menu template block into memory, optionally linking in dialogue
  * boxes and returning the menu block addresses in the supplied array.
@@ -115,14 +200,22 @@ menu_template menus_load_templates(char *filename, wimp_w dbox_list[], wimp_menu
 	if (type != fileswitch_IS_FILE)
 		return NULL;
 
-	data = malloc(size);
+	if (menus_memory_handlers != NULL && menus_memory_handlers->alloc != NULL)
+		data = menus_memory_handlers->alloc(size);
+	else
+		data = malloc(size);
 
 	if (data == NULL)
 		return data;
 
 	error = xosfile_load_stamped_no_path(filename, (byte *) data, NULL, NULL, NULL, NULL, NULL);
 	if (error != NULL) {
-		free(data);
+		if (menus_memory_handlers != NULL && menus_memory_handlers->alloc != NULL) {
+			if (menus_memory_handlers->free != NULL)
+				menus_memory_handlers->free(data);
+		} else {
+			free(data);
+		}
 		return NULL;
 	}
 
@@ -237,6 +330,10 @@ menu_template menus_load_templates(char *filename, wimp_w dbox_list[], wimp_menu
 			menu_block = (int*) ((int) menu_block + (int) data);
 	}
 
+	/* Index the menu and dialogue box tags. */
+
+	menus_build_index(data);
+
 	return data;
 }
 
@@ -253,24 +350,9 @@ osbool menus_link_dbox(menu_template data, char *tag, wimp_w dbox)
 	if (data == NULL || tag == NULL)
 		return FALSE;
 
-	if (*(data + MENU_DIALOGUE_LIST_OFFSET) == MENU_END_OF_LIST)
-		return FALSE;
+	current = menus_find_tag(data, tag, TRUE);
 
-	current = (int *) ((int) data + (int) *(data + MENU_DIALOGUE_LIST_OFFSET));
-
-	if (*current != MENU_ZERO_WORD)
-		return FALSE;
-
-	current++; /* Find the first tag block */
-
-	/* Find the correct dbox list by string matching the tags. */
-
-	while (*current != -1 && strcmp((char *) (current + MENU_DIALOGUE_TEXT), tag) != 0) {
-		current = (int *) ((int) current +
-				((strlen((char *) (current + MENU_DIALOGUE_TEXT)) + 8) & (~3)));
-	}
-
-	if (*current == MENU_END_OF_LIST)
+	if (current == NULL)
 		return FALSE;
 
 	current = (int *) ((int) data + (int) *(current + MENU_DIALOGUE_OFFSET));
@@ -300,19 +382,9 @@ wimp_menu *menus_get_menu(menu_template data, char *tag)
 	if (data == NULL || tag == NULL)
 		return NULL;
 
-	if (*(data + MENU_EXTENDED_HEADER_OFFSET) != MENU_ZERO_WORD || *(data + MENU_NAMES_LIST_OFFSET) == MENU_END_OF_LIST)
-		return NULL;
-
-	current = (int *) ((int) data + (int) *(data + MENU_NAMES_LIST_OFFSET));
-
-	/* Find the correct menu offset by string matching the tags. */
-
-	while (*current != -1 && strcmp((char *) (current + MENU_NAME_TEXT), tag) != 0) {
-		current = (int *) ((int) current +
-				((strlen((char *) (current + MENU_NAME_TEXT)) + 8) & (~3)));
-	}
+	current = menus_find_tag(data, tag, FALSE);
 
-	if (*current == MENU_END_OF_LIST)
+	if (current == NULL)
 		return NULL;
 
 	return (wimp_menu *) ((int) data + (int) *(current + MENU_NAME_OFFSET));
@@ -480,3 +552,504 @@ unsigned menus_get_entries(wimp_menu *menu)
 }
 
 
+/* Create a new dynamic menu builder.
+ *
+ * This is an external interface, documented in menus.h
+ */
+
+struct menus_builder *menus_builder_create(void)
+{
+	struct menus_builder	*builder;
+
+	builder = malloc(sizeof(struct menus_builder));
+	if (builder == NULL)
+		return NULL;
+
+	builder->menu = NULL;
+	builder->size = 0;
+	builder->valid = FALSE;
+	builder->version = 0;
+
+	builder->entries = NULL;
+	builder->count = 0;
+	builder->allocation = 0;
+
+	builder->text = NULL;
+	builder->text_used = 0;
+	builder->text_size = 0;
+
+	builder->title_length = 0;
+	builder->failed = FALSE;
+
+	return builder;
+}
+
+
+/* Destroy a dynamic menu builder, freeing the menu block that it holds.
+ *
+ * This is an external interface, documented in menus.h
+ */
+
+void menus_builder_destroy(struct menus_builder *builder)
+{
+	if (builder == NULL)
+		return;
+
+	if (builder->menu != NULL)
+		free(builder->menu);
+
+	if (builder->entries != NULL)
+		free(builder->entries);
+
+	if (builder->text != NULL)
+		free(builder->text);
+
+	free(builder);
+}
+
+
+/* Test whether the menu held by a builder needs to be rebuilt.
+ *
+ * This is an external interface, documented in menus.h
+ */
+
+osbool menus_builder_needs_update(struct menus_builder *builder, unsigned version)
+{
+	if (builder == NULL)
+		return FALSE;
+
+	return (!builder->valid || builder->version != version) ? TRUE : FALSE;
+}
+
+
+/* Start building a new menu in a builder.
+ *
+ * This is an external interface, documented in menus.h
+ */
+
+osbool menus_builder_start(struct menus_builder *builder, char *title)
+{
+	if (builder == NULL)
+		return FALSE;
+
+	builder->count = 0;
+	builder->text_used = 0;
+	builder->failed = FALSE;
+
+	/* The title is always held at the start of the text buffer. */
+
+	if (!menus_builder_add_text(builder, (title != NULL) ? title : "", &(builder->title_length))) {
+		builder->failed = TRUE;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/* Add an entry to the end of a menu being built.
+ *
+ * This is an external interface, documented in menus.h
+ */
+
+osbool menus_builder_add_entry(struct menus_builder *builder, char *text, wimp_menu_flags flags, wimp_menu *sub_menu)
+{
+	struct menus_builder_entry	*entries, *entry;
+	unsigned			allocation;
+	size_t				offset;
+
+	if (builder == NULL || builder->failed)
+		return FALSE;
+
+	if (builder->count >= builder->allocation) {
+		allocation = (builder->allocation == 0) ? MENUS_BUILDER_ENTRY_BLOCK : builder->allocation * 2;
+
+		entries = realloc(builder->entries, allocation * sizeof(struct menus_builder_entry));
+		if (entries == NULL) {
+			builder->failed = TRUE;
+			return FALSE;
+		}
+
+		builder->entries = entries;
+		builder->allocation = allocation;
+	}
+
+	entry = builder->entries + builder->count;
+	offset = builder->text_used;
+
+	if (!menus_builder_add_text(builder, (text != NULL) ? text : "", &(entry->length))) {
+		builder->failed = TRUE;
+		return FALSE;
+	}
+
+	entry->text = offset;
+	entry->flags = flags & ~(wimp_MENU_LAST | wimp_MENU_TITLE_INDIRECTED);
+	entry->sub_menu = (sub_menu != NULL) ? sub_menu : wimp_NO_SUB_MENU;
+
+	builder->count++;
+
+	return TRUE;
+}
+
+
+/* Complete a menu being built, laying out the menu block and its text.
+ *
+ * This is an external interface, documented in menus.h
+ */
+
+wimp_menu *menus_builder_finish(struct menus_builder *builder, unsigned version)
+{
+	struct menus_builder_entry	*entry;
+	wimp_menu			*menu;
+	wimp_menu_entry			*item;
+	size_t				header, size;
+	char				*text;
+	int				width, max_width;
+	unsigned			i;
+
+	if (builder == NULL)
+		return NULL;
+
+	builder->valid = FALSE;
+
+	if (builder->failed || builder->count == 0)
+		return NULL;
+
+	/* Work out the size of the block, with the text following the
+	 * entries, and grow it if required.
+	 */
+
+	header = sizeof(wimp_menu) + ((builder->count - 1) * sizeof(wimp_menu_entry));
+	size = header + builder->text_used;
+
+	if (size > builder->size) {
+		menu = realloc(builder->menu, size);
+		if (menu == NULL)
+			return NULL;
+
+		builder->menu = menu;
+		builder->size = size;
+	}
+
+	menu = builder->menu;
+	text = (char *) menu + header;
+
+	memcpy(text, builder->text, builder->text_used);
+
+	/* Fill in the menu header, using the standard Style Guide colours. */
+
+	menu->title_data.indirected_text.text = text;
+	menu->title_data.indirected_text.validation = NULL;
+	menu->title_data.indirected_text.size = builder->title_length + 1;
+
+	menu->title_fg = wimp_COLOUR_BLACK;
+	menu->title_bg = wimp_COLOUR_LIGHT_GREY;
+	menu->work_fg = wimp_COLOUR_BLACK;
+	menu->work_bg = wimp_COLOUR_WHITE;
+	menu->height = 44;
+	menu->gap = 0;
+
+	/* Fill in the entries, measuring the text as we go. */
+
+	max_width = menus_builder_get_width(text, builder->title_length);
+
+	for (i = 0; i < builder->count; i++) {
+		entry = builder->entries + i;
+		item = menu->entries + i;
+
+		item->menu_flags = entry->flags;
+		item->sub_menu = entry->sub_menu;
+		item->icon_flags = wimp_ICON_TEXT | wimp_ICON_FILLED | wimp_ICON_VCENTRED | wimp_ICON_INDIRECTED |
+				(wimp_COLOUR_BLACK << wimp_ICON_FG_COLOUR_SHIFT) | (wimp_COLOUR_WHITE << wimp_ICON_BG_COLOUR_SHIFT);
+		item->data.indirected_text.text = text + entry->text;
+		item->data.indirected_text.validation = NULL;
+		item->data.indirected_text.size = entry->length + 1;
+
+		width = menus_builder_get_width(text + entry->text, entry->length);
+		if (width > max_width)
+			max_width = width;
+	}
+
+	menu->entries[0].menu_flags |= wimp_MENU_TITLE_INDIRECTED;
+	menu->entries[builder->count - 1].menu_flags |= wimp_MENU_LAST;
+
+	menu->width = max_width + 16;
+
+	builder->version = version;
+	builder->valid = TRUE;
+
+	return menu;
+}
+
+
+/* Return the menu block last completed by a builder.
+ *
+ * This is an external interface, documented in menus.h
+ */
+
+wimp_menu *menus_builder_get_menu(struct menus_builder *builder)
+{
+	if (builder == NULL || !builder->valid)
+		return NULL;
+
+	return builder->menu;
+}
+
+
+/**
+ * Build hashed indexes of the menu and dialogue box tags in a menu
+ * template block, so that they can be found without scanning the lists.
+ * If there is insufficient memory, no index is built and tags will be
+ * found by scanning instead.
+ *
+ * \param data		The menu template block to index.
+ */
+
+static void menus_build_index(menu_template data)
+{
+	struct menus_index	*index;
+	int			*menu_list, *dialogue_list, menu_count, dialogue_count;
+
+	if (menus_indexes == NULL) {
+		menus_indexes = hash_create(0);
+		if (menus_indexes == NULL)
+			return;
+	}
+
+	menu_list = menus_get_tag_list(data, FALSE);
+	dialogue_list = menus_get_tag_list(data, TRUE);
+
+	menu_count = menus_count_tags(menu_list, MENU_NAME_TEXT);
+	dialogue_count = menus_count_tags(dialogue_list, MENU_DIALOGUE_TEXT);
+
+	index = malloc(sizeof(struct menus_index));
+	if (index == NULL)
+		return;
+
+	index->menus = hash_create(menu_count);
+	index->dialogues = hash_create(dialogue_count);
+	index->tags = malloc(((menu_count + dialogue_count > 0) ? menu_count + dialogue_count : 1) * sizeof(struct menus_tag));
+
+	if (index->menus == NULL || index->dialogues == NULL || index->tags == NULL ||
+			menus_index_tags(index->menus, index->tags, menu_list, MENU_NAME_TEXT) != menu_count ||
+			menus_index_tags(index->dialogues, index->tags + menu_count, dialogue_list, MENU_DIALOGUE_TEXT) != dialogue_count ||
+			!hash_add(menus_indexes, (unsigned int) data, index)) {
+		hash_destroy(index->menus);
+		hash_destroy(index->dialogues);
+		if (index->tags != NULL)
+			free(index->tags);
+		free(index);
+	}
+}
+
+
+/**
+ * Count the tag blocks in a list of menu or dialogue box tags.
+ *
+ * \param *current	The first tag block in the list, or NULL.
+ * \param text		The offset of the tag text in each block, in words.
+ * \return		The number of tags in the list.
+ */
+
+static int menus_count_tags(int *current, int text)
+{
+	int	count = 0;
+
+	if (current == NULL)
+		return 0;
+
+	while (*current != MENU_END_OF_LIST) {
+		count++;
+		current = (int *) ((int) current + ((strlen((char *) (current + text)) + 8) & (~3)));
+	}
+
+	return count;
+}
+
+
+/**
+ * Add the tag blocks in a list of menu or dialogue box tags to an index.
+ * Where a tag appears more than once, the first copy is used.
+ *
+ * \param *table	The index to add the tags to.
+ * \param *tags		The array of tags to use for the entries.
+ * \param *current	The first tag block in the list, or NULL.
+ * \param text		The offset of the tag text in each block, in words.
+ * \return		The number of tags processed, or -1 on failure.
+ */
+
+static int menus_index_tags(struct hash_table *table, struct menus_tag *tags, int *current, int text)
+{
+	struct menus_tag	*entry;
+	unsigned int		key;
+	int			count = 0;
+
+	if (current == NULL)
+		return 0;
+
+	while (*current != MENU_END_OF_LIST) {
+		tags[count].tag = (char *) (current + text);
+		tags[count].block = current;
+
+		key = hash_string(tags[count].tag);
+
+		for (entry = hash_find(table, key); entry != NULL && strcmp(entry->tag, tags[count].tag) != 0; entry = entry->chain);
+
+		if (entry == NULL) {
+			tags[count].chain = hash_find(table, key);
+
+			if (!hash_add(table, key, &(tags[count])))
+				return -1;
+		}
+
+		count++;
+		current = (int *) ((int) current + ((strlen((char *) (current + text)) + 8) & (~3)));
+	}
+
+	return count;
+}
+
+
+/**
+ * Find the tag block for a named menu or dialogue box in a menu template
+ * block, using the index if there is one or scanning the list of tags if not.
+ *
+ * \param data		The menu template block to search.
+ * \param *tag		The tag to find.
+ * \param dialogue	TRUE to find a dialogue box tag; FALSE for a menu tag.
+ * \return		Pointer to the tag block, or NULL if not found.
+ */
+
+static int *menus_find_tag(menu_template data, char *tag, osbool dialogue)
+{
+	struct menus_index	*index;
+	struct menus_tag	*entry;
+	int			*current, text;
+
+	index = hash_find(menus_indexes, (unsigned int) data);
+
+	if (index != NULL) {
+		entry = hash_find((dialogue) ? index->dialogues : index->menus, hash_string(tag));
+
+		while (entry != NULL && strcmp(entry->tag, tag) != 0)
+			entry = entry->chain;
+
+		return (entry != NULL) ? entry->block : NULL;
+	}
+
+	current = menus_get_tag_list(data, dialogue);
+	if (current == NULL)
+		return NULL;
+
+	text = (dialogue) ? MENU_DIALOGUE_TEXT : MENU_NAME_TEXT;
+
+	/* Find the correct tag block by string matching the tags. */
+
+	while (*current != MENU_END_OF_LIST && strcmp((char *) (current + text), tag) != 0) {
+		current = (int *) ((int) current +
+				((strlen((char *) (current + text)) + 8) & (~3)));
+	}
+
+	if (*current == MENU_END_OF_LIST)
+		return NULL;
+
+	return current;
+}
+
+
+/**
+ * Find the first block in the list of menu or dialogue box tags in a
+ * menu template block.
+ *
+ * \param data		The menu template block to search.
+ * \param dialogue	TRUE to find the dialogue box tags; FALSE for menu tags.
+ * \return		Pointer to the first tag block, or NULL if there are none.
+ */
+
+static int *menus_get_tag_list(menu_template data, osbool dialogue)
+{
+	int	*current;
+
+	if (dialogue) {
+		if (*(data + MENU_DIALOGUE_LIST_OFFSET) == MENU_END_OF_LIST)
+			return NULL;
+
+		current = (int *) ((int) data + (int) *(data + MENU_DIALOGUE_LIST_OFFSET));
+
+		/* Named dialogue boxes are only found in new format files. */
+
+		if (*current != MENU_ZERO_WORD)
+			return NULL;
+
+		return current + 1;
+	}
+
+	if (*(data + MENU_EXTENDED_HEADER_OFFSET) != MENU_ZERO_WORD || *(data + MENU_NAMES_LIST_OFFSET) == MENU_END_OF_LIST)
+		return NULL;
+
+	return (int *) ((int) data + (int) *(data + MENU_NAMES_LIST_OFFSET));
+}
+
+
+/**
+ * Find the width of a piece of menu text in OS units, using the desktop
+ * font if possible and falling back to the system font if not.
+ *
+ * \param *text	The text to be measured.
+ * \param length	The length of the text, in bytes.
+ * \return		The width of the text, in OS units.
+ */
+
+static int menus_builder_get_width(char *text, size_t length)
+{
+	int	width;
+
+	if (length == 0)
+		return 0;
+
+	if (xwimptextop_string_width(text, (int) length, &width) != NULL)
+		width = (int) length * 16;
+
+	return width;
+}
+
+
+/**
+ * Append a string to the end of a builder's text buffer, including its
+ * terminator, extending the buffer if required.
+ *
+ * \param *builder	The builder to add the text to.
+ * \param *text		The text to be added.
+ * \param *length	Pointer to a variable to return the length of the
+ *			text, excluding the terminator.
+ * \return		TRUE if successful; FALSE if there was no memory.
+ */
+
+static osbool menus_builder_add_text(struct menus_builder *builder, char *text, size_t *length)
+{
+	char	*buffer;
+	size_t	bytes, size;
+
+	bytes = strlen(text) + 1;
+
+	if (builder->text_used + bytes > builder->text_size) {
+		size = (builder->text_size == 0) ? MENUS_BUILDER_TEXT_BLOCK : builder->text_size;
+
+		while (builder->text_used + bytes > size)
+			size *= 2;
+
+		buffer = realloc(builder->text, size);
+		if (buffer == NULL)
+			return FALSE;
+
+		builder->text = buffer;
+		builder->text_size = size;
+	}
+
+	memcpy(builder->text + builder->text_used, text, bytes);
+	builder->text_used += bytes;
+
+	*length = bytes - 1;
+
+	return TRUE;
+}
@@ -42,6 +42,31 @@
 typedef int * menu_template;
 
 
+/**
+ * Memory handlers which can be supplied to claim the memory for menu
+ * template blocks, such as from a dynamic area. The memory must not move
+ * once it has been allocated.
+ */
+
+struct menus_memory {
+	void *(*alloc)(size_t size);			/**< eg. malloc().	*/
+	void (*free)(void *ptr);			/**< eg. free().	*/
+};
+
+
+/**
+ * Set the memory handlers to be used when claiming memory for any future
+ * menu template blocks loaded with menus_load_templates(). By default,
+ * malloc() is used.
+ *
+ * \param *handlers	The memory handlers to use, or NULL to revert to
+ *			malloc(). The block must remain valid for as long
+ *			as the handlers are in use.
+ */
+
+void menus_set_memory_handlers(struct menus_memory *handlers);
+
+
 /**
  * Load a menu template block into memory, optionally linking in dialogue
  * boxes and returning the menu block addresses in the supplied array.
@@ -176,5 +201,117 @@ char *menus_get_indirected_text_addr(wimp_menu *menu, int entry);
 
 unsigned menus_get_entries(wimp_menu *menu);
 
+
+/**
+ * A dynamic menu builder instance.
+ *
+ * A builder lays out a menu block and all of its indirected text in a
+ * single allocation, which is kept and reused each time the menu is rebuilt.
+ * Clients give each set of content a version number, and can test this in
+ * their event_add_window_menu_prepare() handler so that the work of building
+ * a large menu is only repeated when its contents have changed:
+ *
+ *	if (menus_builder_needs_update(builder, version)) {
+ *		menus_builder_start(builder, "Title");
+ *		...
+ *		menus_builder_add_entry(builder, text, 0, NULL);
+ *		...
+ *		event_set_menu_block(menus_builder_finish(builder, version));
+ *	}
+ *
+ * The block is only moved by menus_builder_finish(), so it can be left open
+ * on screen between rebuilds.
+ */
+
+struct menus_builder;
+
+
+/**
+ * Create a new dynamic menu builder.
+ *
+ * \return		Pointer to the new builder, or NULL on failure.
+ */
+
+struct menus_builder *menus_builder_create(void);
+
+
+/**
+ * Destroy a dynamic menu builder, freeing the menu block that it holds.
+ * The menu must not be open on screen when this is done.
+ *
+ * \param *builder	The builder to be destroyed.
+ */
+
+void menus_builder_destroy(struct menus_builder *builder);
+
+
+/**
+ * Test whether the menu held by a builder needs to be rebuilt, because no
+ * menu has yet been completed or it was completed from a different version
+ * of the client's content.
+ *
+ * \param *builder	The builder to test.
+ * \param version	The current version of the client's menu content.
+ * \return		TRUE if the menu must be rebuilt; else FALSE.
+ */
+
+osbool menus_builder_needs_update(struct menus_builder *builder, unsigned version);
+
+
+/**
+ * Start building a new menu in a builder, discarding any entries added
+ * since the menu block was last completed. The existing menu block remains
+ * valid until menus_builder_finish() is called.
+ *
+ * \param *builder	The builder to use.
+ * \param *title	The title for the menu, which is copied.
+ * \return		TRUE if successful; else FALSE.
+ */
+
+osbool menus_builder_start(struct menus_builder *builder, char *title);
+
+
+/**
+ * Add an entry to the end of a menu being built. The text is copied, and
+ * will be held as indirected text in the completed menu block.
+ *
+ * \param *builder	The builder to add the entry to.
+ * \param *text		The text for the entry.
+ * \param flags		The menu flags for the entry; wimp_MENU_LAST is
+ *			handled by the builder and will be ignored.
+ * \param *sub_menu	The submenu or dialogue box for the entry, or NULL
+ *			for none.
+ * \return		TRUE if the entry was added; FALSE on failure.
+ */
+
+osbool menus_builder_add_entry(struct menus_builder *builder, char *text, wimp_menu_flags flags, wimp_menu *sub_menu);
+
+
+/**
+ * Complete a menu being built, laying out the menu block and its indirected
+ * text and calculating the width of the menu. The block is reused if it is
+ * large enough, and otherwise will be moved.
+ *
+ * If the build fails, the builder is left without a menu and will report
+ * that it needs to be updated.
+ *
+ * \param *builder	The builder to complete.
+ * \param version	The version of the client's content which the menu
+ *			was built from.
+ * \return		Pointer to the menu block, or NULL on failure.
+ */
+
+wimp_menu *menus_builder_finish(struct menus_builder *builder, unsigned version);
+
+
+/**
+ * Return the menu block last completed by a builder.
+ *
+ * \param *builder	The builder of interest.
+ * \return		Pointer to the menu block, or NULL if none.
+ */
+
+wimp_menu *menus_builder_get_menu(struct menus_builder *builder);
+
 #endif
 
@@ -36,9 +36,11 @@
 
 #include "oslib/messagetrans.h"
 #include "oslib/os.h"
+#include "oslib/osfile.h"
 
 /* SF-Lib header files. */
 
+#include "hash.h"
 #include "msgs.h"
 #include "string.h"
 
@@ -48,9 +50,50 @@
 #include <stdlib.h>
 
 
+/**
+ * A cached message token, holding a NUL-terminated copy of its text.
+ */
+
+struct msgs_cache_entry {
+	struct msgs_cache_entry	*chain;						/**< The next entry with the same hash key, or NULL.		*/
+	struct msgs_cache_entry	*next;						/**< The next entry in the cache, or NULL.			*/
+	char			*text;						/**< The message text, or NULL if the token wasn't found.	*/
+	osbool			parameters;					/**< TRUE if the text contains parameter escapes.		*/
+	char			token[1];					/**< The token, followed by the text, extending beyond the end.	*/
+};
+
+
+/**
+ * An entry in the compiled message table.
+ */
+
+struct msgs_table_entry {
+	char			*token;						/**< The token, within the loaded file.				*/
+	char			*text;						/**< The message text, within the loaded file.			*/
+};
+
+
 static messagetrans_control_block	*message_block = NULL;
 static osbool				external_file = FALSE;
 
+static struct hash_table		*msgs_cache = NULL;			/**< The index of looked-up tokens, or NULL if empty.		*/
+static struct msgs_cache_entry		*msgs_cache_list = NULL;		/**< The list of all of the entries in the cache.		*/
+static osbool				msgs_cache_lookups = FALSE;		/**< TRUE if buffered lookups should use the cache.		*/
+
+static char				*msgs_table_data = NULL;		/**< The messages file loaded for the compiled table.		*/
+static struct msgs_table_entry		*msgs_table = NULL;			/**< The compiled table of tokens, sorted by name.		*/
+static int				msgs_table_size = 0;			/**< The number of entries in the compiled table.		*/
+
+static unsigned int			msgs_generation = 0;			/**< A count of the changes to the messages file in use.	*/
+
+
+static struct msgs_cache_entry		*msgs_find_cached(char *token);
+static void				msgs_flush_cache(void);
+static osbool				msgs_compile_table(char *messages_file);
+static void				msgs_free_table(void);
+static int				msgs_compare_table_entries(const void *a, const void *b);
+static osbool				msgs_format(char *text, char *buffer, size_t buffer_size, char *a, char *b, char *c, char *d);
+
 
 /* Iniitialise the Msgs module, loading the specified file and preparing the
  * system to handle message lookups.
@@ -68,6 +111,9 @@ osbool msgs_initialise(char *messages_file)
 	message_buffer = malloc(message_size);
 	messagetrans_open_file(message_block, messages_file, message_buffer);
 
+	msgs_flush_cache();
+	msgs_free_table();
+
 	return TRUE;
 }
 
@@ -83,6 +129,9 @@ osbool msgs_initialise_external(messagetrans_control_block *block)
 	message_block = block;
 	external_file = TRUE;
 
+	msgs_flush_cache();
+	msgs_free_table();
+
 	return TRUE;
 }
 
@@ -106,6 +155,9 @@ osbool msgs_terminate(void)
 	message_block = NULL;
 	external_file = FALSE;
 
+	msgs_flush_cache();
+	msgs_free_table();
+
 	return TRUE;
 }
 
@@ -158,7 +210,9 @@ osbool msgs_lookup_result(char *token, char *buffer, size_t buffer_size)
 
 osbool msgs_param_lookup_result(char *token, char *buffer, size_t buffer_size, char *a, char *b, char *c, char *d)
 {
-	os_error	*error;
+	os_error		*error;
+	struct msgs_cache_entry	*entry;
+	int			id;
 
 	if (buffer == NULL || buffer_size <= 0)
 		return FALSE;
@@ -177,6 +231,36 @@ osbool msgs_param_lookup_result(char *token, char *buffer, size_t buffer_size, c
 		return FALSE;
 	}
 
+	/* If there's a compiled table, try that first. Tokens with defaults, or
+	 * which aren't in the table (perhaps because they are matched by a
+	 * wildcard), are passed on to MessageTrans.
+	 */
+
+	if (msgs_table != NULL && strchr(token, ':') == NULL) {
+		id = msgs_token_id(token);
+
+		if (id != msgs_NO_ID) {
+			msgs_format(msgs_table[id].text, buffer, buffer_size, a, b, c, d);
+			return TRUE;
+		}
+	}
+
+	/* If there are no parameters, try the cache next; messages containing
+	 * parameter escapes still need to go via MessageTrans.
+	 */
+
+	if (msgs_cache_lookups && a == NULL && b == NULL && c == NULL && d == NULL) {
+		entry = msgs_find_cached(token);
+
+		if (entry != NULL && entry->text == NULL) {
+			*buffer = '\0';
+			return FALSE;
+		} else if (entry != NULL && !entry->parameters) {
+			string_copy(buffer, entry->text, buffer_size);
+			return TRUE;
+		}
+	}
+
 	/* Look up the token. */
 
 	error = xmessagetrans_lookup(message_block, token, buffer, buffer_size, a, b, c, d, NULL, NULL);
@@ -191,3 +275,409 @@ osbool msgs_param_lookup_result(char *token, char *buffer, size_t buffer_size, c
 	return TRUE;
 }
 
+
+/* Look up a message token without parameters, returning a pointer to a
+ * cached copy of the text.
+ *
+ * This is an external interface, documented in msgs.h
+ */
+
+char *msgs_lookup_ptr(char *token)
+{
+	struct msgs_cache_entry	*entry;
+	int			id;
+
+	if (token == NULL || message_block == NULL)
+		return NULL;
+
+	id = msgs_token_id(token);
+	if (id != msgs_NO_ID)
+		return msgs_table[id].text;
+
+	entry = msgs_find_cached(token);
+	if (entry == NULL)
+		return NULL;
+
+	return entry->text;
+}
+
+
+/* Initialise the Msgs module, loading the specified file and also compiling
+ * it into a table of tokens which can be referenced by ID.
+ *
+ * This is an external interface, documented in msgs.h
+ */
+
+osbool msgs_initialise_compiled(char *messages_file)
+{
+	if (!msgs_initialise(messages_file))
+		return FALSE;
+
+	return msgs_compile_table(messages_file);
+}
+
+
+/* Find the ID of a token in the compiled message table.
+ *
+ * This is an external interface, documented in msgs.h
+ */
+
+int msgs_token_id(char *token)
+{
+	int	low = 0, high = msgs_table_size - 1, middle, result;
+
+	if (token == NULL || msgs_table == NULL)
+		return msgs_NO_ID;
+
+	while (low <= high) {
+		middle = low + (high - low) / 2;
+
+		result = strcmp(token, msgs_table[middle].token);
+
+		if (result == 0)
+			return middle;
+		else if (result < 0)
+			high = middle - 1;
+		else
+			low = middle + 1;
+	}
+
+	return msgs_NO_ID;
+}
+
+
+/* Return a pointer to the text of a token in the compiled message table.
+ *
+ * This is an external interface, documented in msgs.h
+ */
+
+char *msgs_lookup_id(int id)
+{
+	if (msgs_table == NULL || id < 0 || id >= msgs_table_size)
+		return NULL;
+
+	return msgs_table[id].text;
+}
+
+
+/* Look up a token from the compiled message table, substituting the supplied
+ * parameters and storing the result in the supplied buffer.
+ *
+ * This is an external interface, documented in msgs.h
+ */
+
+char *msgs_param_lookup_id(int id, char *buffer, size_t buffer_size, char *a, char *b, char *c, char *d)
+{
+	if (buffer == NULL || buffer_size <= 0)
+		return buffer;
+
+	if (msgs_table == NULL || id < 0 || id >= msgs_table_size)
+		*buffer = '\0';
+	else
+		msgs_format(msgs_table[id].text, buffer, buffer_size, a, b, c, d);
+
+	return buffer;
+}
+
+
+/* Return a value which changes every time that the messages file in use
+ * is changed or closed.
+ *
+ * This is an external interface, documented in msgs.h
+ */
+
+unsigned int msgs_get_generation(void)
+{
+	return msgs_generation;
+}
+
+
+/* Set whether parameterless lookups into buffers should be taken from the
+ * token cache.
+ *
+ * This is an external interface, documented in msgs.h
+ */
+
+void msgs_set_cache(osbool enable)
+{
+	msgs_cache_lookups = enable;
+}
+
+
+/**
+ * Find a token in the message cache, looking it up via MessageTrans and
+ * adding it to the cache if it isn't already there. Tokens which can't be
+ * found are cached too, with a NULL text pointer.
+ *
+ * \param *token		The token to find.
+ * \return			The cache entry, or NULL on failure.
+ */
+
+static struct msgs_cache_entry *msgs_find_cached(char *token)
+{
+	struct msgs_cache_entry	*entry, *first;
+	unsigned int		key;
+	char			*message;
+	int			length = 0, i;
+	os_error		*error;
+
+	if (msgs_cache == NULL) {
+		msgs_cache = hash_create(0);
+		if (msgs_cache == NULL)
+			return NULL;
+	}
+
+	key = hash_string(token);
+	first = hash_find(msgs_cache, key);
+
+	for (entry = first; entry != NULL; entry = entry->chain) {
+		if (strcmp(entry->token, token) == 0)
+			return entry;
+	}
+
+	/* With no buffer, MessageTrans returns a pointer to the control
+	 * terminated text in the file itself.
+	 */
+
+	error = xmessagetrans_lookup(message_block, token, NULL, 0, NULL, NULL, NULL, NULL, &message, &length);
+	if (error != NULL)
+		length = 0;
+
+	entry = malloc(sizeof(struct msgs_cache_entry) + strlen(token) + length + 1);
+	if (entry == NULL)
+		return NULL;
+
+	strcpy(entry->token, token);
+	entry->parameters = FALSE;
+
+	if (error == NULL) {
+		entry->text = strchr(entry->token, '\0') + 1;
+
+		for (i = 0; i < length && (unsigned char) message[i] >= ' '; i++) {
+			entry->text[i] = message[i];
+
+			if (message[i] == '%')
+				entry->parameters = TRUE;
+		}
+
+		entry->text[i] = '\0';
+	} else {
+		entry->text = NULL;
+	}
+
+	entry->chain = first;
+
+	if (!hash_add(msgs_cache, key, entry)) {
+		free(entry);
+		return NULL;
+	}
+
+	entry->next = msgs_cache_list;
+	msgs_cache_list = entry;
+
+	return entry;
+}
+
+
+/**
+ * Empty the message cache, freeing all of the entries. This is called
+ * whenever the messages file is changed, so it also updates the generation.
+ */
+
+static void msgs_flush_cache(void)
+{
+	struct msgs_cache_entry	*entry;
+
+	msgs_generation++;
+
+	while (msgs_cache_list != NULL) {
+		entry = msgs_cache_list;
+		msgs_cache_list = entry->next;
+		free(entry);
+	}
+
+	hash_destroy(msgs_cache);
+	msgs_cache = NULL;
+}
+
+
+/**
+ * Load a messages file into memory, and compile a sorted table of the tokens
+ * that it contains. The file is tokenised in place, so that the table can
+ * point directly into it.
+ *
+ * Lines are of the form "token:text", with alternative tokens for the same
+ * text separated by "/"; comments start with "#". Where a token appears
+ * more than once, the first definition is used as it would be by MessageTrans.
+ *
+ * \param *messages_file	The file to compile.
+ * \return			TRUE if successful; else FALSE.
+ */
+
+static osbool msgs_compile_table(char *messages_file)
+{
+	fileswitch_object_type	type;
+	int			size, count, i, j;
+	char			*line, *end, *colon, *token;
+
+	msgs_free_table();
+
+	if (xosfile_read_stamped_no_path(messages_file, &type, NULL, NULL, &size, NULL, NULL) != NULL || type != fileswitch_IS_FILE)
+		return FALSE;
+
+	msgs_table_data = malloc(size + 1);
+	if (msgs_table_data == NULL)
+		return FALSE;
+
+	if (xosfile_load_stamped_no_path(messages_file, (byte *) msgs_table_data, NULL, NULL, NULL, NULL, NULL) != NULL) {
+		msgs_free_table();
+		return FALSE;
+	}
+
+	msgs_table_data[size] = '\0';
+
+	/* Count the tokens, to size the table. Every token is followed by
+	 * either a '/' or a ':', so this gives an upper limit.
+	 */
+
+	count = 0;
+
+	for (i = 0; i < size; i++) {
+		if (msgs_table_data[i] == '/' || msgs_table_data[i] == ':')
+			count++;
+	}
+
+	msgs_table = malloc(((count > 0) ? count : 1) * sizeof(struct msgs_table_entry));
+	if (msgs_table == NULL) {
+		msgs_free_table();
+		return FALSE;
+	}
+
+	/* Split the file into lines, and the lines into tokens and text. */
+
+	line = msgs_table_data;
+
+	while (line < msgs_table_data + size) {
+		for (end = line; (unsigned char) *end >= ' ' || *end == '\t'; end++);
+		*end = '\0';
+
+		colon = strchr(line, ':');
+
+		if (*line != '#' && colon != NULL) {
+			*colon = '\0';
+
+			for (token = strtok(line, "/"); token != NULL; token = strtok(NULL, "/")) {
+				msgs_table[msgs_table_size].token = token;
+				msgs_table[msgs_table_size].text = colon + 1;
+				msgs_table_size++;
+			}
+		}
+
+		line = end + 1;
+	}
+
+	/* Sort the table, then remove any duplicate tokens. Entries with the
+	 * same token remain in file order, so the first copy is kept.
+	 */
+
+	qsort(msgs_table, msgs_table_size, sizeof(struct msgs_table_entry), msgs_compare_table_entries);
+
+	for (i = 0, j = 0; i < msgs_table_size; i++) {
+		if (j > 0 && strcmp(msgs_table[i].token, msgs_table[j - 1].token) == 0)
+			continue;
+
+		msgs_table[j++] = msgs_table[i];
+	}
+
+	msgs_table_size = j;
+
+	return TRUE;
+}
+
+
+/**
+ * Free the compiled message table, if there is one.
+ */
+
+static void msgs_free_table(void)
+{
+	if (msgs_table != NULL)
+		free(msgs_table);
+
+	if (msgs_table_data != NULL)
+		free(msgs_table_data);
+
+	msgs_table = NULL;
+	msgs_table_data = NULL;
+	msgs_table_size = 0;
+}
+
+
+/**
+ * Compare two entries in the compiled message table by token, for qsort().
+ * Entries with the same token are ordered by their position in the file.
+ *
+ * \param *a			The first entry to compare.
+ * \param *b			The second entry to compare.
+ * \return			The result of the comparison.
+ */
+
+static int msgs_compare_table_entries(const void *a, const void *b)
+{
+	const struct msgs_table_entry	*entry_a = a, *entry_b = b;
+	int				result;
+
+	result = strcmp(entry_a->token, entry_b->token);
+	if (result != 0)
+		return result;
+
+	return (entry_a->token < entry_b->token) ? -1 : (entry_a->token > entry_b->token) ? 1 : 0;
+}
+
+
+/**
+ * Copy a message into a buffer, substituting parameters for %0 to %3 in the
+ * same way as MessageTrans. Escapes whose parameters are NULL are left in
+ * place, so a message looked up without parameters is copied unchanged.
+ *
+ * \param *text			The message text to format.
+ * \param *buffer		The buffer to hold the result.
+ * \param buffer_size		The size of the result buffer.
+ * \param *a			Parameter for %0.
+ * \param *b			Parameter for %1.
+ * \param *c			Parameter for %2.
+ * \param *d			Parameter for %3.
+ * \return			TRUE if successful; FALSE if the result was
+ *				truncated.
+ */
+
+static osbool msgs_format(char *text, char *buffer, size_t buffer_size, char *a, char *b, char *c, char *d)
+{
+	char	*parameters[4], *insert;
+	size_t	length = 0;
+
+	parameters[0] = a;
+	parameters[1] = b;
+	parameters[2] = c;
+	parameters[3] = d;
+
+	while (*text != '\0' && length < buffer_size - 1) {
+		/* As with MessageTrans, escapes for which no parameter has been
+		 * supplied are copied through unchanged.
+		 */
+
+		if (*text == '%' && *(text + 1) >= '0' && *(text + 1) <= '3' && parameters[*(text + 1) - '0'] != NULL) {
+			insert = parameters[*(text + 1) - '0'];
+			text += 2;
+
+			while (*insert != '\0' && length < buffer_size - 1)
+				buffer[length++] = *insert++;
+		} else {
+			buffer[length++] = *text++;
+		}
+	}
+
+	buffer[length] = '\0';
+
+	return (*text == '\0') ? TRUE : FALSE;
+}
@@ -34,6 +34,12 @@
 #include <stdlib.h>
 #include "oslib/messagetrans.h"
 
+/**
+ * The ID returned for tokens not found in the compiled message table.
+ */
+
+#define msgs_NO_ID (-1)
+
 
 /**
  * Iniitialise the Msgs module, loading the specified file and preparing the
@@ -46,6 +52,23 @@
 osbool msgs_initialise(char *messages_file);
 
 
+/**
+ * Initialise the Msgs module, loading the specified file and preparing the
+ * system to handle message lookups. In addition, the file is compiled into
+ * a sorted table in memory: plain lookups of the tokens that it contains
+ * are then resolved without calling MessageTrans, and tokens can be
+ * converted into IDs with msgs_token_id() for fast access.
+ *
+ * Tokens using MessageTrans wildcards can't be held in the table, so are
+ * still looked up via MessageTrans.
+ *
+ * \param *messages_file	The file to open.
+ * \return			TRUE if successful; else FALSE.
+ */
+
+osbool msgs_initialise_compiled(char *messages_file);
+
+
 /**
  * Initialise the Msgs module using an already prepared MessageTrans
  * Control Block.
@@ -126,5 +149,84 @@ osbool msgs_lookup_result(char *token, char *buffer, size_t buffer_size);
 
 osbool msgs_param_lookup_result(char *token, char *buffer, size_t buffer_size, char *a, char *b, char *c, char *d);
 
-#endif
 
+/**
+ * Look up a message token without parameters, returning a pointer to a
+ * NUL-terminated copy of the text held in the Msgs module's token cache.
+ * No parameter substitution is carried out on the text.
+ *
+ * The pointer remains valid until the messages file is changed or closed,
+ * and the text must not be modified.
+ *
+ * \param *token		The message token to look up.
+ * \return			A pointer to the text, or NULL if the token
+ *				was not found.
+ */
+
+char *msgs_lookup_ptr(char *token);
+
+
+/**
+ * Return a value which changes every time that the messages file in use is
+ * opened, replaced or closed, so that clients holding on to message text can
+ * tell when it needs to be refreshed.
+ *
+ * \return			The current messages file generation.
+ */
+
+unsigned int msgs_get_generation(void);
+
+
+/**
+ * Set whether lookups into buffers which don't supply any parameters should
+ * be taken from the Msgs module's token cache, instead of being passed to
+ * MessageTrans every time. Messages which contain parameter escapes are
+ * always passed to MessageTrans.
+ *
+ * \param enable		TRUE to use the cache; FALSE to go direct to
+ *				MessageTrans.
+ */
+
+void msgs_set_cache(osbool enable);
+
+
+/**
+ * Find the ID of a token in the compiled message table. IDs remain valid
+ * until the messages file is changed or closed.
+ *
+ * \param *token		The message token to look up.
+ * \return			The token's ID, or msgs_NO_ID if not found.
+ */
+
+int msgs_token_id(char *token);
+
+
+/**
+ * Return a pointer to the text of a token in the compiled message table,
+ * without any parameter substitution. The text must not be modified.
+ *
+ * \param id			The ID of the token to look up.
+ * \return			A pointer to the text, or NULL if the ID is
+ *				not valid.
+ */
+
+char *msgs_lookup_id(int id);
+
+
+/**
+ * Look up a token from the compiled message table, substituting the supplied
+ * parameters and storing the result in the supplied buffer.
+ *
+ * \param id			The ID of the token to look up.
+ * \param *buffer		The buffer to hold the result.
+ * \param buffer_size		The size of the result buffer.
+ * \param *a			Parameter for %0.
+ * \param *b			Parameter for %1.
+ * \param *c			Parameter for %2.
+ * \param *d			Parameter for %3.
+ * \return			A pointer to the result.
+ */
+
+char *msgs_param_lookup_id(int id, char *buffer, size_t buffer_size, char *a, char *b, char *c, char *d);
+
+#endif
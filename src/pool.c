@@ -0,0 +1,206 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of SFLib:
+ *
+ *   http://www.stevefryatt.org.uk/software/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file: pool.c
+ *
+ * Fixed-size block pools, which allocate small blocks from larger slabs
+ * claimed from the C heap and recycle freed blocks through a free list.
+ */
+
+/* SF-Lib header files. */
+
+#include "pool.h"
+
+/* ANSII C header files. */
+
+#include <stdlib.h>
+
+#define POOL_DEFAULT_COUNT 32							/**< The default number of blocks in each slab.			*/
+#define POOL_ALIGN(x) (((x) + 7) & ~7)						/**< Round a size up to the alignment used for blocks.		*/
+
+/**
+ * A free block in a pool, linked in to the free list.
+ */
+
+struct pool_free_block {
+	struct pool_free_block	*next;						/**< Pointer to the next free block, or NULL.			*/
+};
+
+/**
+ * The header of a slab of blocks.
+ */
+
+struct pool_slab {
+	struct pool_slab	*next;						/**< Pointer to the next slab in the pool, or NULL.		*/
+};
+
+/**
+ * A block pool instance.
+ */
+
+struct pool {
+	size_t			size;						/**< The size of each block, including alignment padding.	*/
+	unsigned int		count;						/**< The number of blocks in each slab.				*/
+	unsigned int		used;						/**< The number of blocks currently allocated.			*/
+
+	struct pool_slab	*slabs;						/**< Pointer to the chain of slabs, or NULL.			*/
+	struct pool_free_block	*free;						/**< Pointer to the chain of free blocks, or NULL.		*/
+};
+
+
+static struct pool_slab		*pool_add_slab(struct pool *pool);
+
+
+/* Create a new pool of fixed-size blocks.
+ *
+ * This is an external interface, documented in pool.h
+ */
+
+struct pool *pool_create(size_t size, unsigned int count)
+{
+	struct pool	*pool;
+
+	pool = malloc(sizeof(struct pool));
+	if (pool == NULL)
+		return NULL;
+
+	if (size < sizeof(struct pool_free_block))
+		size = sizeof(struct pool_free_block);
+
+	pool->size = POOL_ALIGN(size);
+	pool->count = (count > 0) ? count : POOL_DEFAULT_COUNT;
+	pool->used = 0;
+	pool->slabs = NULL;
+	pool->free = NULL;
+
+	return pool;
+}
+
+
+/* Destroy a pool, freeing all of its slabs.
+ *
+ * This is an external interface, documented in pool.h
+ */
+
+void pool_destroy(struct pool *pool)
+{
+	struct pool_slab	*slab;
+
+	if (pool == NULL)
+		return;
+
+	while (pool->slabs != NULL) {
+		slab = pool->slabs;
+		pool->slabs = slab->next;
+		free(slab);
+	}
+
+	free(pool);
+}
+
+
+/* Allocate a block from a pool.
+ *
+ * This is an external interface, documented in pool.h
+ */
+
+void *pool_alloc(struct pool *pool)
+{
+	struct pool_free_block	*block;
+
+	if (pool == NULL)
+		return NULL;
+
+	if (pool->free == NULL && pool_add_slab(pool) == NULL)
+		return NULL;
+
+	block = pool->free;
+	pool->free = block->next;
+	pool->used++;
+
+	return block;
+}
+
+
+/* Return a block to the pool that it was allocated from.
+ *
+ * This is an external interface, documented in pool.h
+ */
+
+void pool_free(struct pool *pool, void *block)
+{
+	struct pool_free_block	*free_block = block;
+
+	if (pool == NULL || free_block == NULL)
+		return;
+
+	free_block->next = pool->free;
+	pool->free = free_block;
+	pool->used--;
+}
+
+
+/* Return the number of blocks currently allocated from a pool.
+ *
+ * This is an external interface, documented in pool.h
+ */
+
+unsigned int pool_count(struct pool *pool)
+{
+	return (pool != NULL) ? pool->used : 0;
+}
+
+
+/**
+ * Claim a new slab for a pool, and link its blocks on to the free list
+ * in address order, so that consecutive allocations are adjacent.
+ *
+ * \param *pool		The pool to add the slab to.
+ * \return		Pointer to the new slab, or NULL on failure.
+ */
+
+static struct pool_slab *pool_add_slab(struct pool *pool)
+{
+	struct pool_slab	*slab;
+	struct pool_free_block	*block;
+	char			*base;
+	unsigned int		i;
+
+	slab = malloc(POOL_ALIGN(sizeof(struct pool_slab)) + (pool->size * pool->count));
+	if (slab == NULL)
+		return NULL;
+
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+
+	base = (char *) slab + POOL_ALIGN(sizeof(struct pool_slab));
+
+	for (i = pool->count; i > 0; i--) {
+		block = (struct pool_free_block *) (base + ((i - 1) * pool->size));
+		block->next = pool->free;
+		pool->free = block;
+	}
+
+	return slab;
+}
@@ -0,0 +1,96 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of SFLib:
+ *
+ *   http://www.stevefryatt.org.uk/software/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file: pool.h
+ *
+ * Fixed-size block pools, which allocate small blocks from larger slabs
+ * claimed from the C heap and recycle freed blocks through a free list.
+ *
+ * Slabs are only returned to the C heap when the pool is destroyed.
+ */
+
+#ifndef SFLIB_POOL
+#define SFLIB_POOL
+
+#include <stddef.h>
+
+/**
+ * A block pool instance.
+ */
+
+struct pool;
+
+
+/**
+ * Create a new pool of fixed-size blocks.
+ *
+ * \param size		The size of the blocks to be allocated, in bytes.
+ * \param count		The number of blocks to claim in each slab, or
+ *			zero to use a default.
+ * \return		Pointer to the new pool, or NULL on failure.
+ */
+
+struct pool *pool_create(size_t size, unsigned int count);
+
+
+/**
+ * Destroy a pool, freeing all of its slabs. Any blocks still allocated
+ * from the pool become invalid.
+ *
+ * \param *pool		The pool to be destroyed.
+ */
+
+void pool_destroy(struct pool *pool);
+
+
+/**
+ * Allocate a block from a pool.
+ *
+ * \param *pool		The pool to allocate the block from.
+ * \return		Pointer to the block, or NULL on failure.
+ */
+
+void *pool_alloc(struct pool *pool);
+
+
+/**
+ * Return a block to the pool that it was allocated from.
+ *
+ * \param *pool		The pool from which the block was allocated.
+ * \param *block	The block to be freed, or NULL.
+ */
+
+void pool_free(struct pool *pool, void *block);
+
+
+/**
+ * Return the number of blocks currently allocated from a pool.
+ *
+ * \param *pool		The pool of interest.
+ * \return		The number of blocks in use.
+ */
+
+unsigned int pool_count(struct pool *pool);
+
+#endif
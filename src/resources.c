@@ -34,21 +34,30 @@
 #include "oslib/os.h"
 #include "oslib/osbyte.h"
 #include "oslib/osfile.h"
+#include "oslib/osgbpb.h"
 #include "oslib/fileswitch.h"
 #include "oslib/osspriteop.h"
 #include "oslib/serviceinternational.h"
-#include "oslib/wimpreadsysinfo.h"
+#include "oslib/wimp.h"
 
 /* SF-Lib header files. */
 
 #include "resources.h"
 
+#include "event.h"
+#include "general.h"
+#include "hash.h"
 #include "string.h"
 
+#ifdef __CC_NORCROFT
+#include "strdup.h"
+#endif
+
 /* ANSII C header files. */
 
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 
 /**
@@ -63,12 +72,102 @@
 
 #define RESOURCES_MAX_PATH_SET_LEN 256
 
+/**
+ * The size of the buffer used to read directory listings.
+ */
+
+#define RESOURCES_DIR_BUFFER_LEN 2048
+
+/**
+ * An object in a cached directory listing.
+ */
+
+struct resources_object {
+	char			*name;			/**< Pointer to the name of the object.				*/
+	size_t			offset;			/**< The offset of the name into the directory's name block.	*/
+	fileswitch_object_type	object_type;		/**< The type of the object.					*/
+	bits			file_type;		/**< The filetype of the object.				*/
+};
+
+/**
+ * A cached directory listing.
+ */
+
+struct resources_dir {
+	char			*path;			/**< The full pathname of the directory.			*/
+	int			count;			/**< The number of objects in the directory.			*/
+	struct resources_object	*objects;		/**< The objects in the directory, sorted by name.		*/
+	char			*names;			/**< The block holding the object names.			*/
+
+	struct resources_dir	*chain;			/**< The next directory with the same hash key.			*/
+	struct resources_dir	*next;			/**< The next directory in the cache.				*/
+};
+
+/**
+ * The directory listing cache, indexed by hashed pathname.
+ */
+
+static struct hash_table *resources_dirs = NULL;
+
+/**
+ * The list of all the directories in the cache.
+ */
+
+static struct resources_dir *resources_dir_list = NULL;
+
+/**
+ * A shared sprite area.
+ */
+
+struct resources_sprite_area {
+	char			*file;			/**< The name of the sprite file, without suffix.		*/
+	char			*loaded;		/**< The name of the sprite file which was loaded.		*/
+	osspriteop_area		*area;			/**< The sprite area, or NULL if none is loaded.		*/
+	struct resources_memory	*memory;		/**< The memory handlers used to claim the area, or NULL.	*/
+	unsigned int		references;		/**< The number of claims on the area.				*/
+
+	struct resources_sprite_area	*chain;		/**< The next area with the same hash key.			*/
+	struct resources_sprite_area	*next;		/**< The next area in the list.					*/
+};
+
+/**
+ * The shared sprite areas, indexed by hashed filename.
+ */
+
+static struct hash_table *resources_sprite_areas = NULL;
+
+/**
+ * The list of all the shared sprite areas.
+ */
+
+static struct resources_sprite_area *resources_sprite_area_list = NULL;
+
+/**
+ * The memory handlers to use for new shared sprite areas, or NULL for malloc().
+ */
+
+static struct resources_memory *resources_sprite_memory = NULL;
+
+/**
+ * TRUE if the mode change handler has been registered.
+ */
+
+static osbool resources_mode_handler_registered = FALSE;
+
 /* Function Prototypes. */
 
 static osbool resources_read_variable(char *varname, char *buffer, size_t length);
 static osbool resources_read_country(char *buffer, size_t length);
 static void resources_add_path_set(char *path, char *set, char **out, char *end);
 static void resources_copy_and_separate(char *buffer, size_t length, int *tail, char **string);
+static osbool resources_test_object(char *dir, char *leaf, fileswitch_object_type *object_type, bits *file_type);
+static struct resources_dir *resources_find_dir(char *path);
+static struct resources_dir *resources_read_dir(char *path);
+static int resources_compare_objects(const void *a, const void *b);
+static osbool resources_find_sprite_file(char *file, char *buffer, size_t length, int *size);
+static osspriteop_area *resources_load_sprite_file(char *file, int size, struct resources_memory *memory);
+static void resources_free_sprite_memory(osspriteop_area *area, struct resources_memory *memory);
+static osbool resources_message_mode_change(wimp_message *message);
 
 
 /**
@@ -266,7 +365,10 @@ static void resources_add_path_set(char *path, char *set, char **out, char *end)
 		if (*in != '\0') {
 			string_copy(dirname + tail, in, RESOURCES_MAX_FILENAME - tail);
 
-			error = xosfile_read_no_path(dirname, &object_type, NULL, NULL, NULL, NULL);
+			if (resources_test_object(dirname, dirname + tail, &object_type, NULL))
+				error = NULL;
+			else
+				error = xosfile_read_no_path(dirname, &object_type, NULL, NULL, NULL, NULL);
 
 			/* Add the name to the list if it exists. */
 
@@ -322,9 +424,14 @@ osbool resources_find_file(char *paths, char *buffer, size_t length, char *file,
 		resources_copy_and_separate(filename, RESOURCES_MAX_FILENAME, &ptr, &paths);
 		string_copy(filename + ptr, file, RESOURCES_MAX_FILENAME - ptr);
 
-		/* Test for the presence of the file. */
+		/* Test for the presence of the file, using the directory cache
+		 * if possible.
+		 */
 
-		error = xosfile_read_stamped_no_path(filename, &object_type, NULL, NULL, NULL, NULL, &file_type);
+		if (resources_test_object(filename, filename + ptr, &object_type, &file_type))
+			error = NULL;
+		else
+			error = xosfile_read_stamped_no_path(filename, &object_type, NULL, NULL, NULL, NULL, &file_type);
 
 		/* If the file exists, and it is of the correct type, copy its
 		 * name into the supplied buffer and return.
@@ -375,6 +482,262 @@ static void resources_copy_and_separate(char *buffer, size_t length, int *tail,
 }
 
 
+/* Discard the cached directory listings used to resolve resource files.
+ *
+ * This is an external interface, documented in resources.h
+ */
+
+void resources_invalidate_cache(void)
+{
+	struct resources_dir *dir;
+
+	while (resources_dir_list != NULL) {
+		dir = resources_dir_list;
+		resources_dir_list = dir->next;
+
+		free(dir->objects);
+		free(dir->names);
+		free(dir);
+	}
+
+	if (resources_dirs != NULL) {
+		hash_destroy(resources_dirs);
+		resources_dirs = NULL;
+	}
+}
+
+
+/**
+ * Test for an object using the cached listing of its parent directory,
+ * reading the listing if it hasn't been seen before. Only leafnames can be
+ * tested in this way: if the leafname contains a directory separator, or the
+ * directory can't be read into the cache, the caller must test the object
+ * directly.
+ *
+ * \param *dir			Pointer to a buffer holding the full filename,
+ *				whose directory part ends in a separator.
+ * \param *leaf			Pointer to the leafname within the buffer.
+ * \param *object_type		Pointer to a variable to take the object type.
+ * \param *file_type		Pointer to a variable to take the filetype, or NULL.
+ * \return			TRUE if the cache was used; FALSE if the object
+ *				must be tested directly.
+ */
+
+static osbool resources_test_object(char *dir, char *leaf, fileswitch_object_type *object_type, bits *file_type)
+{
+	struct resources_dir	*listing;
+	struct resources_object	key, *object;
+
+	if (dir == NULL || leaf == NULL || leaf <= dir || *(leaf - 1) != '.' || object_type == NULL || strchr(leaf, '.') != NULL)
+		return FALSE;
+
+	/* Find the listing for the directory part of the buffer. */
+
+	*(leaf - 1) = '\0';
+	listing = resources_find_dir(dir);
+	*(leaf - 1) = '.';
+
+	if (listing == NULL)
+		return FALSE;
+
+	/* Look up the leafname in the listing. */
+
+	key.name = leaf;
+
+	object = (listing->count > 0) ? bsearch(&key, listing->objects, listing->count, sizeof(struct resources_object), resources_compare_objects) : NULL;
+
+	if (object == NULL) {
+		*object_type = fileswitch_NOT_FOUND;
+		if (file_type != NULL)
+			*file_type = 0;
+	} else {
+		*object_type = object->object_type;
+		if (file_type != NULL)
+			*file_type = object->file_type;
+	}
+
+	return TRUE;
+}
+
+
+/**
+ * Find the cached listing of a directory, reading it into the cache if it
+ * isn't already there.
+ *
+ * \param *path			Pointer to the full pathname of the directory.
+ * \return			Pointer to the listing, or NULL on failure.
+ */
+
+static struct resources_dir *resources_find_dir(char *path)
+{
+	struct resources_dir	*dir;
+	unsigned int		key;
+
+	if (resources_dirs == NULL) {
+		resources_dirs = hash_create(0);
+		if (resources_dirs == NULL)
+			return NULL;
+	}
+
+	key = hash_string(path);
+
+	dir = hash_find(resources_dirs, key);
+	while (dir != NULL && strcmp(dir->path, path) != 0)
+		dir = dir->chain;
+
+	if (dir != NULL)
+		return dir;
+
+	dir = resources_read_dir(path);
+	if (dir == NULL)
+		return NULL;
+
+	dir->chain = hash_find(resources_dirs, key);
+
+	if (!hash_add(resources_dirs, key, dir)) {
+		free(dir->objects);
+		free(dir->names);
+		free(dir);
+		return NULL;
+	}
+
+	dir->next = resources_dir_list;
+	resources_dir_list = dir;
+
+	return dir;
+}
+
+
+/**
+ * Read the listing of a directory into a new cache entry, using OS_GBPB.
+ * A directory which doesn't exist results in an empty listing; any other
+ * error results in no listing, so that the caller tests objects directly.
+ *
+ * \param *path			Pointer to the full pathname of the directory.
+ * \return			Pointer to the new listing, or NULL on failure.
+ */
+
+static struct resources_dir *resources_read_dir(char *path)
+{
+	struct resources_dir	*dir;
+	struct resources_object	*objects;
+	osgbpb_info_stamped	*info;
+	osgbpb_context		context = 0;
+	char			*names;
+	int			buffer[RESOURCES_DIR_BUFFER_LEN / sizeof(int)], read, i, allocation = 0;
+	size_t			name_length, names_size = 0, names_allocation = 0;
+	os_error		*error;
+	fileswitch_object_type	object_type;
+
+	dir = malloc(sizeof(struct resources_dir) + strlen(path) + 1);
+	if (dir == NULL)
+		return NULL;
+
+	dir->path = (char *) (dir + 1);
+	strcpy(dir->path, path);
+
+	dir->count = 0;
+	dir->objects = NULL;
+	dir->names = NULL;
+	dir->chain = NULL;
+	dir->next = NULL;
+
+	/* Read the directory a bufferful at a time. If the first read fails
+	 * because the directory doesn't exist, we return an empty listing;
+	 * any other failure leaves us without a listing that can be trusted.
+	 */
+
+	while (context != -1) {
+		error = xosgbpb_dir_entries_info_stamped(path, (osgbpb_info_stamped_list *) buffer, RESOURCES_DIR_BUFFER_LEN / 32,
+				context, RESOURCES_DIR_BUFFER_LEN, NULL, &read, &context);
+		if (error != NULL) {
+			if (context == 0 && dir->count == 0 && xosfile_read_no_path(path, &object_type, NULL, NULL, NULL, NULL) == NULL &&
+					object_type == fileswitch_NOT_FOUND)
+				break;
+
+			free(dir->objects);
+			free(dir->names);
+			free(dir);
+			return NULL;
+		}
+
+		info = (osgbpb_info_stamped *) buffer;
+
+		for (i = 0; i < read; i++) {
+			name_length = strlen(info->name) + 1;
+
+			/* Make space for the object and its name. */
+
+			if (dir->count >= allocation) {
+				allocation = (allocation == 0) ? 32 : allocation * 2;
+				objects = realloc(dir->objects, allocation * sizeof(struct resources_object));
+				if (objects == NULL)
+					break;
+				dir->objects = objects;
+			}
+
+			if (names_size + name_length > names_allocation) {
+				names_allocation = (names_allocation == 0) ? 512 : names_allocation * 2;
+				if (names_allocation < names_size + name_length)
+					names_allocation = names_size + name_length;
+				names = realloc(dir->names, names_allocation);
+				if (names == NULL)
+					break;
+				dir->names = names;
+			}
+
+			/* Record the object. */
+
+			strcpy(dir->names + names_size, info->name);
+			dir->objects[dir->count].offset = names_size;
+			dir->objects[dir->count].object_type = info->obj_type;
+			dir->objects[dir->count].file_type = info->file_type;
+			dir->count++;
+
+			names_size += name_length;
+
+			info = (osgbpb_info_stamped *) ((byte *) info + WORDALIGN(offsetof(osgbpb_info_stamped, name) + name_length));
+		}
+
+		/* If we ran out of memory, give up. */
+
+		if (i < read) {
+			free(dir->objects);
+			free(dir->names);
+			free(dir);
+			return NULL;
+		}
+	}
+
+	/* Now that the name block won't move, point the objects at their
+	 * names and sort them for searching.
+	 */
+
+	for (i = 0; i < dir->count; i++)
+		dir->objects[i].name = dir->names + dir->objects[i].offset;
+
+	if (dir->count > 1)
+		qsort(dir->objects, dir->count, sizeof(struct resources_object), resources_compare_objects);
+
+	return dir;
+}
+
+
+/**
+ * Compare two objects in a directory listing by name, ignoring case as
+ * the filing system does.
+ *
+ * \param *a			The first object to compare.
+ * \param *b			The second object to compare.
+ * \return			The result of the comparison.
+ */
+
+static int resources_compare_objects(const void *a, const void *b)
+{
+	return string_nocase_strcmp(((struct resources_object *) a)->name, ((struct resources_object *) b)->name);
+}
+
+
 /* Load a spritefile into a user sprite area, claiming the necessary memory
  * and returning its pointer.
  *
@@ -384,40 +747,230 @@ static void resources_copy_and_separate(char *buffer, size_t length, int *tail,
 osspriteop_area *resources_load_user_sprite_area(char *file)
 {
 	int			size;
-	bits			type;
-	fileswitch_object_type	object_type;
-	osspriteop_area		*area;
-	char			*suffix, full_file[RESOURCES_MAX_FILENAME];
-	os_error		*error;
+	char			full_file[RESOURCES_MAX_FILENAME];
 
 	if (file == NULL)
 		return NULL;
 
-	/* Identify the current mode sprite suffix. */
+	if (!resources_find_sprite_file(file, full_file, RESOURCES_MAX_FILENAME, &size))
+		return NULL;
+
+	return resources_load_sprite_file(full_file, size, NULL);
+}
+
+
+/* Set the memory handlers to be used when claiming memory for shared
+ * sprite areas.
+ *
+ * This is an external interface, documented in resources.h
+ */
+
+void resources_set_sprite_memory_handlers(struct resources_memory *handlers)
+{
+	resources_sprite_memory = handlers;
+}
+
+
+/* Claim a shared sprite area for a sprite file, loading the file if it
+ * isn't already in memory.
+ *
+ * This is an external interface, documented in resources.h
+ */
+
+struct resources_sprite_area *resources_claim_sprite_area(char *file)
+{
+	struct resources_sprite_area	*sprites;
+	unsigned int			key;
+	int				size;
+	char				full_file[RESOURCES_MAX_FILENAME];
+
+	if (file == NULL)
+		return NULL;
+
+	/* If the file is already loaded, just take another reference. */
+
+	key = hash_string(file);
+
+	sprites = hash_find(resources_sprite_areas, key);
+	while (sprites != NULL && strcmp(sprites->file, file) != 0)
+		sprites = sprites->chain;
+
+	if (sprites != NULL) {
+		sprites->references++;
+		return sprites;
+	}
+
+	/* Register for mode changes, so that areas can be reloaded if a
+	 * different sprite file is required.
+	 */
+
+	if (!resources_mode_handler_registered)
+		resources_mode_handler_registered = event_add_message_handler(message_MODE_CHANGE, EVENT_MESSAGE_INCOMING, resources_message_mode_change);
+
+	if (resources_sprite_areas == NULL) {
+		resources_sprite_areas = hash_create(0);
+		if (resources_sprite_areas == NULL)
+			return NULL;
+	}
+
+	/* Find and load the sprite file. */
+
+	if (!resources_find_sprite_file(file, full_file, RESOURCES_MAX_FILENAME, &size))
+		return NULL;
+
+	sprites = malloc(sizeof(struct resources_sprite_area));
+	if (sprites == NULL)
+		return NULL;
+
+	sprites->file = strdup(file);
+	sprites->loaded = strdup(full_file);
+	sprites->memory = resources_sprite_memory;
+	sprites->area = NULL;
+	sprites->references = 1;
+
+	if (sprites->file != NULL && sprites->loaded != NULL)
+		sprites->area = resources_load_sprite_file(full_file, size, sprites->memory);
+
+	sprites->chain = hash_find(resources_sprite_areas, key);
+
+	if (sprites->area == NULL || !hash_add(resources_sprite_areas, key, sprites)) {
+		resources_free_sprite_memory(sprites->area, sprites->memory);
+		free(sprites->file);
+		free(sprites->loaded);
+		free(sprites);
+		return NULL;
+	}
+
+	sprites->next = resources_sprite_area_list;
+	resources_sprite_area_list = sprites;
+
+	return sprites;
+}
+
+
+/* Return the current sprite area for a shared sprite area.
+ *
+ * This is an external interface, documented in resources.h
+ */
+
+osspriteop_area *resources_get_sprite_area(struct resources_sprite_area *sprites)
+{
+	return (sprites != NULL) ? sprites->area : NULL;
+}
+
+
+/* Release a claim on a shared sprite area, freeing the memory once the
+ * last claim has been released.
+ *
+ * This is an external interface, documented in resources.h
+ */
+
+void resources_release_sprite_area(struct resources_sprite_area *sprites)
+{
+	struct resources_sprite_area	*list;
+	unsigned int			key;
+
+	if (sprites == NULL || sprites->references == 0)
+		return;
+
+	if (--sprites->references > 0)
+		return;
+
+	/* Remove the area from the index. */
+
+	key = hash_string(sprites->file);
+
+	list = hash_find(resources_sprite_areas, key);
+
+	if (list == sprites) {
+		if (sprites->chain != NULL)
+			hash_add(resources_sprite_areas, key, sprites->chain);
+		else
+			hash_remove(resources_sprite_areas, key);
+	} else {
+		while (list != NULL && list->chain != sprites)
+			list = list->chain;
+
+		if (list != NULL)
+			list->chain = sprites->chain;
+	}
+
+	/* Remove the area from the list. */
+
+	if (resources_sprite_area_list == sprites) {
+		resources_sprite_area_list = sprites->next;
+	} else {
+		list = resources_sprite_area_list;
 
-	suffix = wimpreadsysinfo_sprite_suffix();
-	string_printf(full_file, RESOURCES_MAX_FILENAME, "%s%s", file, suffix);
+		while (list != NULL && list->next != sprites)
+			list = list->next;
+
+		if (list != NULL)
+			list->next = sprites->next;
+	}
+
+	resources_free_sprite_memory(sprites->area, sprites->memory);
+	free(sprites->file);
+	free(sprites->loaded);
+	free(sprites);
+}
+
+
+/**
+ * Find the sprite file to use for the current mode, checking for a file
+ * with the mode's sprite suffix before falling back to the unsuffixed name.
+ *
+ * \param *file			The sprite file to find, without suffix.
+ * \param *buffer		Pointer to a buffer to take the full filename.
+ * \param length		The length of the buffer.
+ * \param *size			Pointer to a variable to take the file size.
+ * \return			TRUE if a sprite file was found; else FALSE.
+ */
+
+static osbool resources_find_sprite_file(char *file, char *buffer, size_t length, int *size)
+{
+	bits			type;
+	fileswitch_object_type	object_type;
+
+	/* Use the current mode sprite suffix. */
+
+	string_printf(buffer, length, "%s%s", file, general_get_mode_info()->sprite_suffix);
 
 	/* Check for a suffixed sprite file. */
 
-	object_type = osfile_read_stamped_no_path(full_file, NULL, NULL, &size, NULL, &type);
+	object_type = osfile_read_stamped_no_path(buffer, NULL, NULL, size, NULL, &type);
 
 	/* If not found, check for an un-suffixed sprite file. */
 
 	if (object_type != fileswitch_IS_FILE || type != osfile_TYPE_SPRITE) {
-		string_copy(full_file, file, RESOURCES_MAX_FILENAME);
-		object_type = osfile_read_stamped_no_path(full_file, NULL, NULL, &size, NULL, &type);
+		string_copy(buffer, file, length);
+		object_type = osfile_read_stamped_no_path(buffer, NULL, NULL, size, NULL, &type);
 	}
 
-	/* If neither found, exit. */
+	/* Report whether either was found. */
 
-	if (object_type != fileswitch_IS_FILE || type != osfile_TYPE_SPRITE)
-		return NULL;
+	return (object_type == fileswitch_IS_FILE && type == osfile_TYPE_SPRITE) ? TRUE : FALSE;
+}
+
+
+/**
+ * Load a sprite file into a new user sprite area.
+ *
+ * \param *file			The full name of the sprite file to load.
+ * \param size			The size of the sprite file.
+ * \param *memory		The memory handlers to use, or NULL for malloc().
+ * \return			Pointer to the sprite area, or NULL on failure.
+ */
+
+static osspriteop_area *resources_load_sprite_file(char *file, int size, struct resources_memory *memory)
+{
+	osspriteop_area		*area;
+	os_error		*error;
 
 	/* Allocate the sprite area memory. */
 
 	size += sizeof(int);
-	area = malloc(size);
+	area = (memory != NULL) ? memory->alloc(size) : malloc(size);
 	if (area == NULL)
 		return NULL;
 
@@ -428,11 +981,79 @@ osspriteop_area *resources_load_user_sprite_area(char *file)
 
 	/* Load the sprite file into the area. */
 
-	error = xosspriteop_load_sprite_file(osspriteop_USER_AREA, area, full_file);
+	error = xosspriteop_load_sprite_file(osspriteop_USER_AREA, area, file);
 	if (error != NULL) {
-		free(area);
+		resources_free_sprite_memory(area, memory);
 		return NULL;
 	}
 
 	return area;
 }
+
+
+/**
+ * Free the memory used by a sprite area.
+ *
+ * \param *area			The sprite area to free, or NULL.
+ * \param *memory		The memory handlers used to claim it, or NULL.
+ */
+
+static void resources_free_sprite_memory(osspriteop_area *area, struct resources_memory *memory)
+{
+	if (area == NULL)
+		return;
+
+	if (memory != NULL)
+		memory->free(area);
+	else
+		free(area);
+}
+
+
+/**
+ * Handle Message_ModeChange, by reloading any shared sprite areas for which
+ * a different sprite file is now required.
+ *
+ * \param *message		The associated Wimp message block.
+ * \return			FALSE to pass the message on to other handlers.
+ */
+
+static osbool resources_message_mode_change(wimp_message *message)
+{
+	struct resources_sprite_area	*sprites;
+	osspriteop_area			*area;
+	char				full_file[RESOURCES_MAX_FILENAME], *loaded;
+	int				size;
+
+	/* Make sure that the new mode's sprite suffix is used, whichever
+	 * handler receives the message first.
+	 */
+
+	general_invalidate_mode_info();
+
+	for (sprites = resources_sprite_area_list; sprites != NULL; sprites = sprites->next) {
+		if (!resources_find_sprite_file(sprites->file, full_file, RESOURCES_MAX_FILENAME, &size) ||
+				strcmp(full_file, sprites->loaded) == 0)
+			continue;
+
+		/* If the new file can't be loaded, keep the old one. */
+
+		loaded = strdup(full_file);
+		if (loaded == NULL)
+			continue;
+
+		area = resources_load_sprite_file(full_file, size, sprites->memory);
+		if (area == NULL) {
+			free(loaded);
+			continue;
+		}
+
+		resources_free_sprite_memory(sprites->area, sprites->memory);
+		free(sprites->loaded);
+
+		sprites->area = area;
+		sprites->loaded = loaded;
+	}
+
+	return FALSE;
+}
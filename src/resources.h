@@ -35,6 +35,25 @@
 #include "oslib/osspriteop.h"
 
 
+/**
+ * Memory handlers which can be supplied to claim the memory for shared
+ * sprite areas, such as from a dynamic area. The memory must not move
+ * once it has been allocated.
+ */
+
+struct resources_memory {
+	void *(*alloc)(size_t size);			/**< eg. malloc().	*/
+	void (*free)(void *ptr);			/**< eg. free().	*/
+};
+
+
+/**
+ * A shared sprite area.
+ */
+
+struct resources_sprite_area;
+
+
 /**
  * Initialise the resources path set, ready for looking up resource file names.
  * If successful, on exit the *path_set buffer will contain the original
@@ -72,6 +91,15 @@ osbool resources_initialise_paths(char *path_set, size_t length, char *appvar, c
 osbool resources_find_file(char *paths, char *buffer, size_t length, char *file, bits type);
 
 
+/**
+ * Discard the cached directory listings used by resources_initialise_paths()
+ * and resources_find_file(), so that any changes to the resource folders are
+ * seen. The cache will be rebuilt as files are looked up.
+ */
+
+void resources_invalidate_cache(void);
+
+
 /**
  * Load a spritefile into a user sprite area, claiming the necessary memory
  * and returning its pointer.
@@ -82,5 +110,54 @@ osbool resources_find_file(char *paths, char *buffer, size_t length, char *file,
 
 osspriteop_area *resources_load_user_sprite_area(char *file);
 
+
+/**
+ * Set the memory handlers to be used when claiming memory for any future
+ * shared sprite areas claimed with resources_claim_sprite_area(). By default,
+ * malloc() is used.
+ *
+ * \param *handlers	The memory handlers to use, or NULL to revert to
+ *			malloc(). The block must remain valid for as long
+ *			as any areas claimed with it are in use.
+ */
+
+void resources_set_sprite_memory_handlers(struct resources_memory *handlers);
+
+
+/**
+ * Claim a shared sprite area for a sprite file, checking for a file with
+ * the current mode suffix first. If the file is already in memory, the
+ * existing copy is shared; otherwise it is loaded into a new area.
+ *
+ * The area is reloaded automatically on a mode change if a different
+ * suffixed file is required, so resources_get_sprite_area() should be used
+ * to find the area each time that it is required.
+ *
+ * \param *file		The sprite file to load, without any suffix.
+ * \return		The shared sprite area, or NULL on failure.
+ */
+
+struct resources_sprite_area *resources_claim_sprite_area(char *file);
+
+
+/**
+ * Return the current user sprite area of a shared sprite area.
+ *
+ * \param *sprites	The shared sprite area.
+ * \return		Pointer to the sprite area, or NULL if none.
+ */
+
+osspriteop_area *resources_get_sprite_area(struct resources_sprite_area *sprites);
+
+
+/**
+ * Release a claim on a shared sprite area, freeing the memory once the
+ * last claim has been released.
+ *
+ * \param *sprites	The shared sprite area to release.
+ */
+
+void resources_release_sprite_area(struct resources_sprite_area *sprites);
+
 #endif
 
@@ -24,34 +24,181 @@
 /**
  * \file: stack.c
  *
- * Simplistic integer stack implementation.
+ * Simple stack implementation, supporting multiple independent stacks
+ * of arbitrary fixed-size elements which grow as required, plus a default
+ * integer stack.
  */
 
 /* SFLib header files. */
 
 #include "stack.h"
 
+/* ANSII C header files. */
 
-#define STACK_SIZE 200								/**< The stack size.		*/
+#include <stdlib.h>
+#include <string.h>
 
 
-static int	stack[STACK_SIZE];						/**< The stack data.		*/
-static int	ptr = 0;							/**< The stack pointer.		*/
+#define STACK_DEFAULT_ALLOCATION 16						/**< The default initial number of elements in a stack.	*/
 
+/**
+ * A stack instance.
+ */
+
+struct stack_block {
+	size_t		element_size;						/**< The size of each element, in bytes.		*/
+	unsigned int	count;							/**< The number of elements on the stack.		*/
+	unsigned int	allocation;						/**< The number of elements allocated.			*/
+	char		*data;							/**< The stack data.					*/
+};
+
+
+static struct stack_block	*stack_default = NULL;				/**< The default integer stack.	*/
+
+
+/* Create a new, empty stack.
+ *
+ * This is an external interface, documented in stack.h
+ */
+
+struct stack_block *stack_create(size_t element_size, unsigned int allocation)
+{
+	struct stack_block	*new;
+
+	if (element_size == 0)
+		return NULL;
+
+	new = malloc(sizeof(struct stack_block));
+	if (new == NULL)
+		return NULL;
+
+	new->element_size = element_size;
+	new->count = 0;
+	new->allocation = (allocation > 0) ? allocation : STACK_DEFAULT_ALLOCATION;
+
+	new->data = malloc(new->allocation * element_size);
+	if (new->data == NULL) {
+		free(new);
+		return NULL;
+	}
+
+	return new;
+}
+
+
+/* Destroy a stack, freeing the memory that it uses.
+ *
+ * This is an external interface, documented in stack.h
+ */
+
+void stack_destroy(struct stack_block *stack)
+{
+	if (stack == NULL)
+		return;
+
+	free(stack->data);
+	free(stack);
+}
+
+
+/* Push an element on to a stack, extending the stack if required.
+ *
+ * This is an external interface, documented in stack.h
+ */
+
+osbool stack_push_item(struct stack_block *stack, void *item)
+{
+	char		*data;
+	unsigned int	allocation;
+
+	if (stack == NULL || item == NULL)
+		return FALSE;
+
+	/* If the stack is full, double its size. */
+
+	if (stack->count >= stack->allocation) {
+		allocation = stack->allocation * 2;
+		if (allocation <= stack->allocation)
+			return FALSE;
 
-/* Push a value on to the stack.
+		data = realloc(stack->data, allocation * stack->element_size);
+		if (data == NULL)
+			return FALSE;
+
+		stack->data = data;
+		stack->allocation = allocation;
+	}
+
+	memcpy(stack->data + (stack->count++ * stack->element_size), item, stack->element_size);
+
+	return TRUE;
+}
+
+
+/* Pull (remove completely) an element from the top of a stack.
  *
  * This is an external interface, documented in stack.h
  */
 
-void stack_push(int val)
+osbool stack_pull_item(struct stack_block *stack, void *item)
 {
-	if (ptr < STACK_SIZE)
-		stack[ptr++] = val;
+	if (stack == NULL || stack->count == 0)
+		return FALSE;
+
+	stack->count--;
+
+	if (item != NULL)
+		memcpy(item, stack->data + (stack->count * stack->element_size), stack->element_size);
+
+	return TRUE;
+}
+
+
+/* Pop (read without removing) an element from the top of a stack.
+ *
+ * This is an external interface, documented in stack.h
+ */
+
+osbool stack_pop_item(struct stack_block *stack, void *item)
+{
+	if (stack == NULL || stack->count == 0 || item == NULL)
+		return FALSE;
+
+	memcpy(item, stack->data + ((stack->count - 1) * stack->element_size), stack->element_size);
+
+	return TRUE;
 }
 
 
-/* Pull (remove completely) a value from the top of the stack.
+/* Return the number of elements on a stack.
+ *
+ * This is an external interface, documented in stack.h
+ */
+
+unsigned int stack_count(struct stack_block *stack)
+{
+	return (stack != NULL) ? stack->count : 0;
+}
+
+
+/* Push a value on to the default stack.
+ *
+ * This is an external interface, documented in stack.h
+ */
+
+osbool stack_push(int val)
+{
+	if (stack_default == NULL) {
+		stack_default = stack_create(sizeof(int), 0);
+		if (stack_default == NULL)
+			return FALSE;
+	}
+
+	return stack_push_item(stack_default, &val);
+}
+
+
+/* Pull (remove completely) a value from the top of the default stack.
  *
  * This is an external interface, documented in stack.h
  */
@@ -60,14 +207,13 @@ int stack_pull(void)
 {
 	int	val = 0;
 
-	if (ptr > 0)
-		val = stack[--ptr];
+	stack_pull_item(stack_default, &val);
 
 	return val;
 }
 
 
-/* Pop (read without removing) a value from the top of the stack.
+/* Pop (read without removing) a value from the top of the default stack.
  *
  * This is an external interface, documented in stack.h
  */
@@ -76,9 +222,7 @@ int stack_pop(void)
 {
 	int	val = 0;
 
-	if (ptr > 0)
-		val = stack[ptr-1];
+	stack_pop_item(stack_default, &val);
 
 	return val;
 }
-
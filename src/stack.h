@@ -24,23 +24,102 @@
 /**
  * \file: stack.h
  *
- * Simplistic integer stack implementation.
+ * Simple stack implementation, supporting multiple independent stacks
+ * of arbitrary fixed-size elements which grow as required, plus a default
+ * integer stack.
  */
 
 #ifndef SFLIB_STACK
 #define SFLIB_STACK
 
+#include <stddef.h>
+#include "oslib/types.h"
+
+/**
+ * A stack instance.
+ */
+
+struct stack_block;
+
+
+/**
+ * Create a new, empty stack.
+ *
+ * \param element_size	The size of each element on the stack, in bytes.
+ * \param allocation	The number of elements to allocate initially, or
+ *			zero to use a default. The stack doubles in size
+ *			each time that it fills up.
+ * \return		Pointer to the new stack, or NULL on failure.
+ */
+
+struct stack_block *stack_create(size_t element_size, unsigned int allocation);
+
+
 /**
- * Push a value on to the stack.
+ * Destroy a stack, freeing the memory that it uses.
+ *
+ * \param *stack	The stack to be destroyed.
+ */
+
+void stack_destroy(struct stack_block *stack);
+
+
+/**
+ * Push an element on to a stack, extending the stack if required.
+ *
+ * \param *stack	The stack to push the element on to.
+ * \param *item		Pointer to the element to be copied on to the stack.
+ * \return		TRUE if successful; FALSE if there was no memory
+ *			to extend the stack.
+ */
+
+osbool stack_push_item(struct stack_block *stack, void *item);
+
+
+/**
+ * Pull (remove completely) an element from the top of a stack.
+ *
+ * \param *stack	The stack to pull the element from.
+ * \param *item		Pointer to a buffer to take the element, or NULL.
+ * \return		TRUE if an element was pulled; FALSE if empty.
+ */
+
+osbool stack_pull_item(struct stack_block *stack, void *item);
+
+
+/**
+ * Pop (read without removing) an element from the top of a stack.
+ *
+ * \param *stack	The stack to read the element from.
+ * \param *item		Pointer to a buffer to take the element.
+ * \return		TRUE if an element was read; FALSE if empty.
+ */
+
+osbool stack_pop_item(struct stack_block *stack, void *item);
+
+
+/**
+ * Return the number of elements on a stack.
+ *
+ * \param *stack	The stack of interest.
+ * \return		The number of elements on the stack.
+ */
+
+unsigned int stack_count(struct stack_block *stack);
+
+
+/**
+ * Push a value on to the default stack.
  *
  * \param val		The value to push on to the stack.
+ * \return		TRUE if successful; FALSE if there was no memory.
  */
 
-void stack_push(int val);
+osbool stack_push(int val);
 
 
 /**
- * Pull (remove completely) a value from the top of the stack.
+ * Pull (remove completely) a value from the top of the default stack.
  *
  * \return		The top value from the stack, or 0 if empty.
  */
@@ -49,7 +128,7 @@ int stack_pull(void);
 
 
 /**
- * Pop (read without removing) a value from the top of the stack.
+ * Pop (read without removing) a value from the top of the default stack.
  *
  * \return		The top value from the stack, or 0 if empty.
  */
@@ -57,4 +136,3 @@ int stack_pull(void);
 int stack_pop(void);
 
 #endif
-
@@ -45,6 +45,79 @@
 #include <ctype.h>
 #include <string.h>
 
+/**
+ * A compiled wildcard pattern.
+ */
+
+struct string_wildcard {
+	osbool		any_case;		/**< TRUE if the match is case-insensitive.			*/
+	osbool		literal;		/**< TRUE if the pattern contains no wildcards.			*/
+	size_t		minimum;		/**< The minimum length of string which can match.		*/
+	char		pattern[1];		/**< The pattern, case-folded if required, with runs of * collapsed.	*/
+};
+
+/**
+ * The number of entries in a character table.
+ */
+
+#define STRING_TABLE_SIZE 256
+
+/**
+ * Test a word for any byte which is a control character (less than 32),
+ * returning non-zero if one is found. This is exact in reporting whether
+ * a control character is present, but not in where it is.
+ */
+
+#define STRING_WORD_HAS_CTRL(word) (((word) - 0x20202020u) & ~(word) & 0x80808080u)
+
+/**
+ * The type used to read strings a word at a time; under GCC, it must be
+ * allowed to alias the characters that it reads.
+ */
+
+#ifdef __GNUC__
+typedef unsigned int __attribute__((__may_alias__)) string_word;
+#else
+typedef unsigned int string_word;
+#endif
+
+/**
+ * A prepared case-insensitive search.
+ */
+
+struct string_search {
+	size_t		length;				/**< The length of the needle.				*/
+	size_t		skip[STRING_TABLE_SIZE];	/**< The Horspool skip distance for each folded character.	*/
+	char		needle[1];			/**< The needle being searched for.			*/
+};
+
+/**
+ * The table used to convert characters to upper case, and to fold them
+ * for case-insensitive comparisons.
+ */
+
+static unsigned char string_upper_table[STRING_TABLE_SIZE];
+
+/**
+ * The table used to convert characters to lower case.
+ */
+
+static unsigned char string_lower_table[STRING_TABLE_SIZE];
+
+/**
+ * TRUE if the case conversion tables have been initialised.
+ */
+
+static osbool string_tables_initialised = FALSE;
+
+/* Function Prototypes. */
+
+static osbool string_wildcard_test(char *s1, char *s2, osbool any_case);
+static void string_initialise_tables(void);
+static size_t string_ctrl_find(const char *s, size_t len);
+static void string_search_build_skip(size_t *skip, char *needle, size_t length);
+static char *string_search_find(size_t *skip, char *needle, size_t needle_length, char *haystack, size_t haystack_length);
+
 
 /* Perform a strncpy(), sanity-checking the supplied pointer details and
  * ensuring that the copy is zero-terminated even if the source string
@@ -121,17 +194,12 @@ int string_printf(char *str, size_t len, char *cntrl_string, ...)
 
 char *string_ctrl_zero_terminate(char *s1, size_t len)
 {
-	char *s = s1;
-
 	if (s1 == NULL || len == 0)
 		return NULL;
 
-	while (*s1 >= os_VDU_SPACE && --len > 0)
-		s1++;
-
-	*s1 = '\0';
+	s1[string_ctrl_find(s1, len - 1)] = '\0';
 
-	return s;
+	return s1;
 }
 
 
@@ -142,19 +210,17 @@ char *string_ctrl_zero_terminate(char *s1, size_t len)
 
 char *string_ctrl_strncpy(char *s1, const char *s2, size_t len)
 {
-	size_t i = 0;
-	char *s = s1;
+	size_t	i;
 
 	if (s1 == NULL)
 		return NULL;
 
-	while (*s2 >= os_VDU_SPACE && i++ < len)
-		*s1++ = *s2++;
+	i = string_ctrl_find(s2, len);
 
-	while (i++ < len)
-		*s1++ = '\0';
+	memcpy(s1, s2, i);
+	memset(s1 + i, '\0', len - i);
 
-	return s;
+	return s1;
 }
 
 
@@ -165,20 +231,19 @@ char *string_ctrl_strncpy(char *s1, const char *s2, size_t len)
 
 char *string_ctrl_strncat(char *s1, const char *s2, size_t len)
 {
-	char	*s = s1;
+	char	*end;
+	size_t	i;
 
 	if (s1 == NULL)
 		return NULL;
 
-	while (*s1 >= os_VDU_SPACE)
-		s1++;
-
-	while (*s2 >= os_VDU_SPACE && len-- > 0)
-		*s1++ = *s2++;
+	end = s1 + string_ctrl_find(s1, (size_t) -1);
+	i = string_ctrl_find(s2, len);
 
-	*s1 = '\0';
+	memcpy(end, s2, i);
+	end[i] = '\0';
 
-	return s;
+	return s1;
 }
 
 
@@ -189,12 +254,7 @@ char *string_ctrl_strncat(char *s1, const char *s2, size_t len)
 
 size_t string_ctrl_strlen(char *s)
 {
-	int	len = 0;
-
-	while (*s++ >= os_VDU_SPACE)
-		len++;
-
-	return (size_t) len;
+	return string_ctrl_find(s, (size_t) -1);
 }
 
 
@@ -209,8 +269,11 @@ char *string_toupper(char *string)
 
 	start = string;
 
+	if (!string_tables_initialised)
+		string_initialise_tables();
+
 	while (*string != '\0') {
-		*string = toupper(*string);
+		*string = string_upper_table[(unsigned char) *string];
 		string++;
 	}
 
@@ -229,8 +292,11 @@ char *string_tolower(char *string)
 
 	start = string;
 
+	if (!string_tables_initialised)
+		string_initialise_tables();
+
 	while (*string != '\0') {
-		*string = tolower (*string);
+		*string = string_lower_table[(unsigned char) *string];
 		string++;
 	}
 
@@ -238,50 +304,170 @@ char *string_tolower(char *string)
 }
 
 
+/* Compare two strings to see if they match, with one string containing
+ * wildcards.
+ *
+ * This is an external interface, documented in string.h
+ */
+
+osbool string_wildcard_compare(char *s1, char *s2, osbool any_case)
+{
+	if (s1 == NULL || s2 == NULL)
+		return FALSE;
+
+	return string_wildcard_test(s1, s2, any_case);
+}
+
+
+/* Compile a wildcarded pattern, so that it can be matched against a number
+ * of different strings.
+ *
+ * This is an external interface, documented in string.h
+ */
+
+struct string_wildcard *string_wildcard_compile(char *pattern, osbool any_case)
+{
+	struct string_wildcard	*wildcard;
+	char			*out;
+
+	if (pattern == NULL)
+		return NULL;
+
+	wildcard = malloc(sizeof(struct string_wildcard) + strlen(pattern));
+	if (wildcard == NULL)
+		return NULL;
+
+	wildcard->any_case = any_case;
+	wildcard->literal = TRUE;
+	wildcard->minimum = 0;
+
+	/* Copy the pattern, folding the case if required and collapsing any
+	 * runs of * into a single one, and note how many characters a
+	 * string must contain to be able to match.
+	 */
+
+	out = wildcard->pattern;
+
+	while (*pattern != '\0') {
+		if (*pattern == '*') {
+			wildcard->literal = FALSE;
+
+			if (out == wildcard->pattern || *(out - 1) != '*')
+				*out++ = '*';
+		} else {
+			if (*pattern == '#')
+				wildcard->literal = FALSE;
+
+			*out++ = (any_case) ? tolower(*pattern) : *pattern;
+			wildcard->minimum++;
+		}
+
+		pattern++;
+	}
+
+	*out = '\0';
+
+	return wildcard;
+}
+
+
+/* Test a string against a compiled wildcard pattern.
+ *
+ * This is an external interface, documented in string.h
+ */
+
+osbool string_wildcard_match(struct string_wildcard *wildcard, char *string)
+{
+	if (wildcard == NULL || string == NULL)
+		return FALSE;
+
+	/* Patterns without wildcards can be matched directly. */
+
+	if (wildcard->literal) {
+		if (!wildcard->any_case)
+			return (strcmp(wildcard->pattern, string) == 0) ? TRUE : FALSE;
+
+		return (string_nocase_strcmp(wildcard->pattern, string) == 0) ? TRUE : FALSE;
+	}
+
+	/* A string shorter than the fixed parts of the pattern can't match. */
+
+	if (strlen(string) < wildcard->minimum)
+		return FALSE;
+
+	return string_wildcard_test(wildcard->pattern, string, wildcard->any_case);
+}
+
+
+/* Free a compiled wildcard pattern.
+ *
+ * This is an external interface, documented in string.h
+ */
+
+void string_wildcard_free(struct string_wildcard *wildcard)
+{
+	if (wildcard != NULL)
+		free(wildcard);
+}
+
+
 /**
  * Compare two strings to see if they match. One string can contain
  * the wildards # for any single character and * for any zero or
  * more characters.  The comparison can be case-insensitive if required.
  *
+ * The comparison is iterative: when a mismatch is found after a *, the
+ * pattern is restarted from just after the most recent * and the string
+ * from one character on from where that * last started matching. Earlier
+ * stars never need to be revisited, so the stack use is constant and the
+ * time taken is at worst proportional to the product of the lengths.
+ *
  * \param *s1		The string to search for, with wildcards.
  * \param *s2		The string to test.
  * \param any_case	TRUE for a case-insensitive search; else FALSE.
  * \return		TRUE if the strings match; else FALSE.
  */
 
-osbool string_wildcard_compare(char *s1, char *s2, osbool any_case)
+static osbool string_wildcard_test(char *s1, char *s2, osbool any_case)
 {
-	char c1 = *s1, c2 = *s2;
+	char	*star_s1 = NULL, *star_s2 = NULL, c1, c2;
 
-	if (any_case) {
-		c1 = tolower(c1);
-		c2 = tolower(c2);
-	}
+	while (*s2 != '\0') {
+		c1 = *s1;
+		c2 = *s2;
 
-	if (c2 == 0) {
-		while (*s1 == '*')
-			s1++;
-		return (*s1 == 0);
-	}
-
-	if (c1 == c2 || c1 == '#')
-		return string_wildcard_compare(&s1[1], &s2[1], any_case);
+		if (any_case) {
+			c1 = tolower(c1);
+			c2 = tolower(c2);
+		}
 
-	if (c1 == '*') {
-		osbool ok = FALSE;
+		if (c1 == '*') {
+			/* Note the position, and try matching the * against
+			 * nothing to start with.
+			 */
 
-		if (s1[1] == 0)
-			return TRUE;
+			star_s1 = ++s1;
+			star_s2 = s2;
 
-		while (!ok && *s2 != 0) {
-			ok = ok || string_wildcard_compare(&s1[1], s2, any_case);
+			if (*s1 == '\0')
+				return TRUE;
+		} else if (c1 != '\0' && (c1 == c2 || c1 == '#')) {
+			s1++;
 			s2++;
-		}
+		} else if (star_s1 != NULL) {
+			/* Let the last * swallow one more character. */
 
-		return ok;
+			s1 = star_s1;
+			s2 = ++star_s2;
+		} else {
+			return FALSE;
+		}
 	}
 
-	return FALSE;
+	while (*s1 == '*')
+		s1++;
+
+	return (*s1 == '\0') ? TRUE : FALSE;
 }
 
 
@@ -294,12 +480,17 @@ osbool string_wildcard_compare(char *s1, char *s2, osbool any_case)
 
 int string_nocase_strcmp(char *s1, char *s2)
 {
-	while (*s1 != '\0' && *s2 != '\0' && (toupper(*s1) - toupper(*s2)) == 0) {
-		s1++;
-		s2++;
+	unsigned char	*u1 = (unsigned char *) s1, *u2 = (unsigned char *) s2;
+
+	if (!string_tables_initialised)
+		string_initialise_tables();
+
+	while (*u1 != '\0' && string_upper_table[*u1] == string_upper_table[*u2]) {
+		u1++;
+		u2++;
 	}
 
-	return (toupper(*s1) - toupper(*s2));
+	return (string_upper_table[*u1] - string_upper_table[*u2]);
 }
 
 
@@ -312,24 +503,182 @@ int string_nocase_strcmp(char *s1, char *s2)
 
 char *string_nocase_strstr(char *s1, char *s2)
 {
-	char	*s1c, *s2c;
+	size_t	skip[STRING_TABLE_SIZE], s1_length, s2_length;
+	char	*found;
 
-	while (*s1 != '\0') {
-		s1c = s1;
-		s2c = s2;
+	s1_length = strlen(s1);
+	s2_length = strlen(s2);
 
-		while (*s1c != '\0' && *s2c != '\0' && toupper(*s1c) == toupper(*s2c)) {
-			s1c++;
-			s2c++;
-		}
+	if (s2_length == 0)
+		return s1;
 
-		if (*s2c == '\0')
-			break;
+	string_search_build_skip(skip, s2, s2_length);
 
-		s1++;
+	found = string_search_find(skip, s2, s2_length, s1, s1_length);
+
+	/* If there's no match, return the terminator as this always has. */
+
+	return (found != NULL) ? found : s1 + s1_length;
+}
+
+
+/* Prepare a needle for repeated case-insensitive searches.
+ *
+ * This is an external interface, documented in string.h
+ */
+
+struct string_search *string_search_prepare(char *needle)
+{
+	struct string_search	*search;
+	size_t			length;
+
+	if (needle == NULL)
+		return NULL;
+
+	length = strlen(needle);
+
+	search = malloc(sizeof(struct string_search) + length);
+	if (search == NULL)
+		return NULL;
+
+	search->length = length;
+	memcpy(search->needle, needle, length + 1);
+
+	string_search_build_skip(search->skip, search->needle, length);
+
+	return search;
+}
+
+
+/* Find the next case-insensitive match for a prepared needle in a
+ * zero-terminated string.
+ *
+ * This is an external interface, documented in string.h
+ */
+
+char *string_search_next(struct string_search *search, char *haystack)
+{
+	if (search == NULL || haystack == NULL)
+		return NULL;
+
+	return string_search_find(search->skip, search->needle, search->length, haystack, strlen(haystack));
+}
+
+
+/* Find the next case-insensitive match for a prepared needle in a buffer
+ * of a given length.
+ *
+ * This is an external interface, documented in string.h
+ */
+
+char *string_search_next_bounded(struct string_search *search, char *haystack, size_t length)
+{
+	if (search == NULL || haystack == NULL)
+		return NULL;
+
+	return string_search_find(search->skip, search->needle, search->length, haystack, length);
+}
+
+
+/* Free a prepared search.
+ *
+ * This is an external interface, documented in string.h
+ */
+
+void string_search_free(struct string_search *search)
+{
+	if (search != NULL)
+		free(search);
+}
+
+
+/**
+ * Initialise the case conversion tables, using toupper() and tolower() so
+ * that the locale in force at the time of the first conversion is used.
+ */
+
+static void string_initialise_tables(void)
+{
+	int	i;
+
+	for (i = 0; i < STRING_TABLE_SIZE; i++) {
+		string_upper_table[i] = toupper(i);
+		string_lower_table[i] = tolower(i);
 	}
 
-	return s1;
+	string_tables_initialised = TRUE;
+}
+
+
+/**
+ * Build the Horspool skip table for a case-insensitive search: for each
+ * folded character, the distance from its last appearance in the needle
+ * (ignoring the final character) to the end of the needle.
+ *
+ * \param *skip		Pointer to the table to be filled.
+ * \param *needle		The needle to be searched for.
+ * \param length		The length of the needle.
+ */
+
+static void string_search_build_skip(size_t *skip, char *needle, size_t length)
+{
+	size_t	i;
+
+	if (!string_tables_initialised)
+		string_initialise_tables();
+
+	for (i = 0; i < STRING_TABLE_SIZE; i++)
+		skip[i] = length;
+
+	if (length == 0)
+		return;
+
+	for (i = 0; i < length - 1; i++)
+		skip[string_upper_table[(unsigned char) needle[i]]] = length - 1 - i;
+}
+
+
+/**
+ * Search a buffer for a needle, case-insensitively, using the
+ * Boyer-Moore-Horspool algorithm.
+ *
+ * \param *skip			The skip table for the needle.
+ * \param *needle		The needle to search for.
+ * \param needle_length		The length of the needle.
+ * \param *haystack		The buffer to be searched.
+ * \param haystack_length	The length of the buffer.
+ * \return			Pointer to the first match, or NULL if none.
+ */
+
+static char *string_search_find(size_t *skip, char *needle, size_t needle_length, char *haystack, size_t haystack_length)
+{
+	unsigned char	*text = (unsigned char *) haystack, *pattern = (unsigned char *) needle, last;
+	size_t		position, i;
+
+	if (needle_length == 0)
+		return haystack;
+
+	if (needle_length > haystack_length)
+		return NULL;
+
+	last = string_upper_table[pattern[needle_length - 1]];
+
+	/* Test the last character of each alignment first, then work back
+	 * through the rest; skip on according to the folded character in
+	 * the buffer under the end of the needle.
+	 */
+
+	for (position = 0; position <= haystack_length - needle_length; position += skip[string_upper_table[text[position + needle_length - 1]]]) {
+		if (string_upper_table[text[position + needle_length - 1]] != last)
+			continue;
+
+		for (i = 0; i < needle_length - 1 && string_upper_table[text[position + i]] == string_upper_table[pattern[i]]; i++);
+
+		if (i == needle_length - 1)
+			return haystack + position;
+	}
+
+	return NULL;
 }
 
 
@@ -513,3 +862,45 @@ int string_convert_version_number(char *string)
 
 	return atoi(start);
 }
+
+
+/**
+ * Find the length of a ctrl-terminated string, up to a maximum. Once the
+ * pointer is word-aligned the string is tested four bytes at a time, which
+ * never reads past the end of the word holding the terminator.
+ *
+ * \param *s			The string to measure.
+ * \param len			The maximum length to report.
+ * \return			The length of the string, or len if that is less.
+ */
+
+static size_t string_ctrl_find(const char *s, size_t len)
+{
+	const unsigned char	*p = (const unsigned char *) s;
+	const string_word	*w;
+	size_t			i = 0;
+
+	/* Test individual bytes until the pointer is word-aligned. */
+
+	while (i < len && ((size_t) (p + i) & (sizeof(string_word) - 1)) != 0) {
+		if (p[i] < os_VDU_SPACE)
+			return i;
+		i++;
+	}
+
+	/* Test whole words until one contains a control character. */
+
+	w = (const string_word *) (p + i);
+
+	while (len - i >= sizeof(string_word) && !STRING_WORD_HAS_CTRL(*w)) {
+		w++;
+		i += sizeof(string_word);
+	}
+
+	/* Find the terminator within the final word. */
+
+	while (i < len && p[i] >= os_VDU_SPACE)
+		i++;
+
+	return i;
+}
@@ -33,6 +33,17 @@
 #include <stddef.h>
 #include "oslib/types.h"
 
+/**
+ * A compiled wildcard pattern.
+ */
+
+struct string_wildcard;
+
+/**
+ * A prepared case-insensitive search.
+ */
+
+struct string_search;
 
 /**
  * Perform a strncpy(), sanity-checking the supplied pointer details and
@@ -159,6 +170,39 @@ char *string_tolower(char *string);
 osbool string_wildcard_compare(char *s1, char *s2, osbool any_case);
 
 
+/**
+ * Compile a wildcarded pattern, using the same wildcards as
+ * string_wildcard_compare(), so that it can be matched efficiently
+ * against a number of different strings.
+ *
+ * \param *pattern	The pattern to compile.
+ * \param any_case	TRUE for case-insensitive matching; else FALSE.
+ * \return		The compiled pattern, or NULL on failure.
+ */
+
+struct string_wildcard *string_wildcard_compile(char *pattern, osbool any_case);
+
+
+/**
+ * Test a string against a compiled wildcard pattern.
+ *
+ * \param *wildcard	The compiled pattern to match against.
+ * \param *string	The string to test.
+ * \return		TRUE if the string matches; else FALSE.
+ */
+
+osbool string_wildcard_match(struct string_wildcard *wildcard, char *string);
+
+
+/**
+ * Free a compiled wildcard pattern.
+ *
+ * \param *wildcard	The compiled pattern to free.
+ */
+
+void string_wildcard_free(struct string_wildcard *wildcard);
+
+
 /**
  * Perform a strcmp() case-insensitively on two strings, returning
  * a value less than, equal to or greater than zero depending on
@@ -185,6 +229,53 @@ int string_nocase_strcmp(char *s1, char *s2);
 char *string_nocase_strstr(char *s1, char *s2);
 
 
+/**
+ * Prepare a needle for repeated case-insensitive searches, such as
+ * finding all of the matches in a large document.
+ *
+ * \param *needle	The string to search for.
+ * \return		The prepared search, or NULL on failure.
+ */
+
+struct string_search *string_search_prepare(char *needle);
+
+
+/**
+ * Find the next case-insensitive match for a prepared needle in a
+ * zero-terminated string. To find further matches, call again with
+ * a pointer one on from the previous match.
+ *
+ * \param *search	The prepared search to use.
+ * \param *haystack	The string to search.
+ * \return		Pointer to the first match, or NULL if not found.
+ */
+
+char *string_search_next(struct string_search *search, char *haystack);
+
+
+/**
+ * Find the next case-insensitive match for a prepared needle in a buffer
+ * of a given length, which does not need to be terminated and can contain
+ * zero bytes.
+ *
+ * \param *search	The prepared search to use.
+ * \param *haystack	The buffer to search.
+ * \param length	The number of bytes in the buffer.
+ * \return		Pointer to the first match, or NULL if not found.
+ */
+
+char *string_search_next_bounded(struct string_search *search, char *haystack, size_t length);
+
+
+/**
+ * Free a prepared search.
+ *
+ * \param *search	The prepared search to free.
+ */
+
+void string_search_free(struct string_search *search);
+
+
 /**
  * Strip whitespace from the supplied string.  Space at the end is
  * removed by overwiting the first character with zero; the returned
@@ -35,14 +35,50 @@
 /* SFLib header files. */
 
 #include "errors.h"
+#include "event.h"
+#include "hash.h"
 #include "msgs.h"
+#include "string.h"
 
 #include "tasks.h"
 
 /* ANSII C header files. */
 
+#include <stdlib.h>
 #include <string.h>
 
+/**
+ * A task in the registry of running tasks.
+ */
+
+struct tasks_entry {
+	wimp_t			task;			/**< The task handle.					*/
+	char			*name;			/**< The task name.					*/
+
+	struct tasks_entry	*chain;			/**< The next task with the same name hash.		*/
+};
+
+/**
+ * The registry of running tasks, indexed by hashed task name, or NULL if
+ * running tasks aren't being tracked.
+ */
+
+static struct hash_table *tasks_name_index = NULL;
+
+/**
+ * The registry of running tasks, indexed by task handle.
+ */
+
+static struct hash_table *tasks_handle_index = NULL;
+
+/* Function Prototypes. */
+
+static osbool tasks_enumerate_running(char *task_name, wimp_t ignore_task);
+static osbool tasks_add_entry(wimp_t task, char *name);
+static void tasks_remove_entry(wimp_t task);
+static osbool tasks_message_task_initialise(wimp_message *message);
+static osbool tasks_message_task_close_down(wimp_message *message);
+
 
 /* Check if a named task is running.
  *
@@ -50,20 +86,69 @@
  */
 
 osbool tasks_get_running(char *task_name, wimp_t ignore_task)
+{
+	struct tasks_entry	*entry;
+
+	if (task_name == NULL)
+		return FALSE;
+
+	if (tasks_name_index == NULL)
+		return tasks_enumerate_running(task_name, ignore_task);
+
+	for (entry = hash_find(tasks_name_index, hash_string(task_name)); entry != NULL; entry = entry->chain) {
+		if (entry->task != ignore_task && strcmp(entry->name, task_name) == 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+/* Start to track the running tasks, so that tasks_get_running() can answer
+ * queries without enumerating them each time.
+ *
+ * This is an external interface, documented in tasks.h
+ */
+
+osbool tasks_track_running(void)
 {
 	taskmanager_task	task_data;
 	int			next = 0;
-	osbool			found = FALSE;
 	char			*end;
 
+	if (tasks_name_index != NULL)
+		return TRUE;
+
+	/* Register for the messages before reading the task list, so that no
+	 * changes can be missed.
+	 */
+
+	if (!event_add_message_handler(message_TASK_INITIALISE, EVENT_MESSAGE_INCOMING, tasks_message_task_initialise) ||
+			!event_add_message_handler(message_TASK_CLOSE_DOWN, EVENT_MESSAGE_INCOMING, tasks_message_task_close_down))
+		return FALSE;
+
+	tasks_name_index = hash_create(0);
+	tasks_handle_index = hash_create(0);
+
+	if (tasks_name_index == NULL || tasks_handle_index == NULL) {
+		hash_destroy(tasks_name_index);
+		hash_destroy(tasks_handle_index);
+		tasks_name_index = NULL;
+		tasks_handle_index = NULL;
+		return FALSE;
+	}
+
+	/* Add the tasks which are already running. */
+
 	while (next >= 0) {
-		next = taskmanager_enumerate_tasks(next, &task_data, sizeof(taskmanager_task), &end);
+		if (xtaskmanager_enumerate_tasks(next, &task_data, sizeof(taskmanager_task), &next, &end) != NULL)
+			break;
 
-		if (end > (char *) &task_data && strcmp(task_data.name, task_name) == 0 && task_data.task != ignore_task)
-			found = TRUE;
+		if (end > (char *) &task_data)
+			tasks_add_entry(task_data.task, task_data.name);
 	}
 
-	return found;
+	return TRUE;
 }
 
 
@@ -94,3 +179,146 @@ osbool tasks_test_for_duplicate(char *task_name, wimp_t handle, char *message, c
 	return exit;
 }
 
+
+/**
+ * Check if a named task is running by enumerating all of the tasks via
+ * the Task Manager.
+ *
+ * \param *task_name		The name to test against.
+ * \param ignore_task		A task handle to ignore, even if the name matches.
+ * \return			TRUE if a match was found; else FALSE.
+ */
+
+static osbool tasks_enumerate_running(char *task_name, wimp_t ignore_task)
+{
+	taskmanager_task	task_data;
+	int			next = 0;
+	char			*end;
+
+	while (next >= 0) {
+		next = taskmanager_enumerate_tasks(next, &task_data, sizeof(taskmanager_task), &end);
+
+		if (end > (char *) &task_data && strcmp(task_data.name, task_name) == 0 && task_data.task != ignore_task)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+/**
+ * Add a task to the registry of running tasks.
+ *
+ * \param task			The handle of the task.
+ * \param *name			The name of the task, which can be ctrl-terminated.
+ * \return			TRUE if successful; else FALSE.
+ */
+
+static osbool tasks_add_entry(wimp_t task, char *name)
+{
+	struct tasks_entry	*entry;
+	size_t			length;
+	unsigned int		key;
+
+	if (name == NULL)
+		return FALSE;
+
+	/* A task handle can only be in use once. */
+
+	tasks_remove_entry(task);
+
+	length = string_ctrl_strlen(name) + 1;
+
+	entry = malloc(sizeof(struct tasks_entry) + length);
+	if (entry == NULL)
+		return FALSE;
+
+	entry->task = task;
+	entry->name = (char *) (entry + 1);
+	string_ctrl_copy(entry->name, name, length);
+
+	key = hash_string(entry->name);
+	entry->chain = hash_find(tasks_name_index, key);
+
+	if (!hash_add(tasks_handle_index, (unsigned int) task, entry)) {
+		free(entry);
+		return FALSE;
+	}
+
+	if (!hash_add(tasks_name_index, key, entry)) {
+		hash_remove(tasks_handle_index, (unsigned int) task);
+		free(entry);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/**
+ * Remove a task from the registry of running tasks.
+ *
+ * \param task			The handle of the task to remove.
+ */
+
+static void tasks_remove_entry(wimp_t task)
+{
+	struct tasks_entry	*entry, *parent;
+	unsigned int		key;
+
+	entry = hash_remove(tasks_handle_index, (unsigned int) task);
+	if (entry == NULL)
+		return;
+
+	key = hash_string(entry->name);
+	parent = hash_find(tasks_name_index, key);
+
+	if (parent == entry) {
+		if (entry->chain != NULL)
+			hash_add(tasks_name_index, key, entry->chain);
+		else
+			hash_remove(tasks_name_index, key);
+	} else {
+		while (parent != NULL && parent->chain != entry)
+			parent = parent->chain;
+
+		if (parent != NULL)
+			parent->chain = entry->chain;
+	}
+
+	free(entry);
+}
+
+
+/**
+ * Handle incoming Message_TaskInitialise, by adding the new task to the
+ * registry of running tasks.
+ *
+ * \param *message		The message data block.
+ * \return			FALSE to pass the message on to other handlers.
+ */
+
+static osbool tasks_message_task_initialise(wimp_message *message)
+{
+	if (message != NULL && tasks_name_index != NULL)
+		tasks_add_entry(message->sender, message->data.task_initialise.task_name);
+
+	return FALSE;
+}
+
+
+/**
+ * Handle incoming Message_TaskCloseDown, by removing the task from the
+ * registry of running tasks.
+ *
+ * \param *message		The message data block.
+ * \return			FALSE to pass the message on to other handlers.
+ */
+
+static osbool tasks_message_task_close_down(wimp_message *message)
+{
+	if (message != NULL && tasks_name_index != NULL)
+		tasks_remove_entry(message->sender);
+
+	return FALSE;
+}
@@ -38,6 +38,10 @@
  * Check if a named task is running.  If ignore_task is a valid task handle, then
  * that task will be ignored in the comparison.
  *
+ * If tasks_track_running() has been called, the query is answered from the
+ * registry of running tasks; otherwise the tasks are enumerated via the
+ * Task Manager.
+ *
  * \param *task_name		The name to test against.
  * \param ignore_task		A task handle to ignore, even if the name matches.
  * \return			TRUE if a match was found; else FALSE.
@@ -46,6 +50,19 @@
 osbool tasks_get_running(char *task_name, wimp_t ignore_task);
 
 
+/**
+ * Start to track the running tasks, building a registry from the Task Manager
+ * which is kept up to date from Message_TaskInitialise and Message_TaskCloseDown
+ * so that tasks_get_running() doesn't need to enumerate the tasks each time.
+ * The messages are received via the event library, so the application must
+ * pass all of its Wimp_Poll events to event_process_event().
+ *
+ * \return			TRUE if tasks are being tracked; else FALSE.
+ */
+
+osbool tasks_track_running(void);
+
+
 /**
  * Test for a duplicate copy of the named task, ignoring the task with the
  * specified handle.  If one is found, ask the user whether to quit.
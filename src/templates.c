@@ -43,13 +43,54 @@
 
 #include "templates.h"
 #include "errors.h"
+#include "hash.h"
 #include "menus.h"
 #include "msgs.h"
+#include "string.h"
 #include "windows.h"
 
 
+#define TEMPLATES_NAME_LENGTH 13						/**< The space allocated for a template name.			*/
+#define TEMPLATES_ALIGN(x) (((x) + 3) & ~3)					/**< Round a size up to a whole number of words.		*/
+
+/**
+ * The details of a template found while scanning the templates file for
+ * templates_preload().
+ */
+
+struct templates_preload_scan {
+	int				context;				/**< The index context from which the template was found.	*/
+	int				definition_size;			/**< The size of the window definition.				*/
+	int				indirected_size;			/**< The size of the indirected data.				*/
+};
+
+/**
+ * A window template held in the template cache.
+ */
+
+struct templates_cache_entry {
+	char				name[TEMPLATES_NAME_LENGTH];		/**< The name of the template.					*/
+
+	wimp_window			*definition;				/**< The window definition.					*/
+	int				definition_size;			/**< The size of the window definition.				*/
+	char				*indirected;				/**< The indirected data for the window.			*/
+	int				indirected_size;			/**< The size of the indirected data.				*/
+
+	struct templates_cache_entry	*chain;					/**< The next template with the same hash key, or NULL.		*/
+};
+
+
 static menu_template	menu_definitions;					/**< The menu definition block handle.				*/
 
+static struct hash_table	*templates_cache = NULL;			/**< The index of cached window templates.			*/
+
+
+static struct templates_cache_entry	*templates_find_cached(char *name);
+static struct templates_cache_entry	*templates_load_cached(char *name);
+static osbool				templates_add_cached(struct templates_cache_entry *entry);
+static wimp_window			*templates_copy_cached(struct templates_cache_entry *entry);
+static void				templates_relocate_icon_data(wimp_icon_flags flags, wimp_icon_data *data, char *old_base, int size, char *new_base);
+
 
 /**
  * Open the window templates file for processing.
@@ -86,7 +127,21 @@ void templates_close(void)
 
 wimp_window *templates_load_window(char *name)
 {
-	wimp_window	*definition;
+	struct templates_cache_entry	*entry;
+	wimp_window			*definition;
+
+	/* Use a preloaded copy of the template if there is one. */
+
+	entry = templates_find_cached(name);
+
+	if (entry != NULL) {
+		definition = templates_copy_cached(entry);
+
+		if (definition == NULL)
+			error_msgs_report_fatal("NoMemNewWin:Insufficient memory to create window.");
+
+		return definition;
+	}
 
 	definition = windows_load_template(name);
 
@@ -109,6 +164,11 @@ wimp_w templates_create_window(char *name)
 	wimp_window	*definition;
 	wimp_w		w = NULL;
 
+	/* Use a preloaded copy of the template if there is one. */
+
+	if (templates_find_cached(name) != NULL)
+		return templates_create_window_cached(name);
+
 	definition = windows_load_template(name);
 
 	if (definition != NULL) {
@@ -122,6 +182,168 @@ wimp_w templates_create_window(char *name)
 }
 
 
+/**
+ * Create a window from the template cache, loading the template from the
+ * current templates file and adding it to the cache if it is not already
+ * there.
+ *
+ * This is an external interface, documented in templates.h
+ */
+
+wimp_w templates_create_window_cached(char *name)
+{
+	struct templates_cache_entry	*entry;
+	wimp_window			*definition;
+	wimp_w				w;
+
+	entry = templates_find_cached(name);
+	if (entry == NULL)
+		entry = templates_load_cached(name);
+
+	if (entry == NULL) {
+		error_msgs_param_report_fatal("BadTemplate:Window template '%0' not found.", name, NULL, NULL, NULL);
+		return NULL;
+	}
+
+	definition = templates_copy_cached(entry);
+
+	if (definition == NULL) {
+		error_msgs_report_fatal("NoMemNewWin:Insufficient memory to create window.");
+		return NULL;
+	}
+
+	w = wimp_create_window(definition);
+	free(definition);
+
+	return w;
+}
+
+
+/**
+ * Preload all of the window templates whose names match a wildcarded
+ * pattern into the template cache.
+ *
+ * This is an external interface, documented in templates.h
+ */
+
+osbool templates_preload(char *pattern)
+{
+	struct templates_preload_scan	*scan = NULL, *extended;
+	struct templates_cache_entry	*entries;
+	char				name[TEMPLATES_NAME_LENGTH], *block, *position;
+	int				count = 0, allocation = 0, loaded = 0, context = 0, next, definition_size, indirected_size, i;
+	size_t				total = 0;
+	os_error			*error;
+	osbool				scan_failed;
+
+	if (pattern == NULL)
+		return FALSE;
+
+	/* Scan the index of the templates file for templates matching the
+	 * pattern, noting where each one was found and how big it is.
+	 */
+
+	while (TRUE) {
+		string_copy(name, pattern, TEMPLATES_NAME_LENGTH);
+
+		error = xwimp_load_template(wimp_GET_SIZE, 0, 0, wimp_NO_FONTS, name, context, &definition_size, &indirected_size, &next);
+		if (error != NULL || next == 0)
+			break;
+
+		if (templates_find_cached(string_ctrl_zero_terminate(name, TEMPLATES_NAME_LENGTH)) == NULL) {
+			if (count >= allocation) {
+				allocation = (allocation == 0) ? 16 : allocation * 2;
+
+				extended = realloc(scan, allocation * sizeof(struct templates_preload_scan));
+				if (extended == NULL) {
+					free(scan);
+					return FALSE;
+				}
+
+				scan = extended;
+			}
+
+			scan[count].context = context;
+			scan[count].definition_size = TEMPLATES_ALIGN(definition_size);
+			scan[count].indirected_size = TEMPLATES_ALIGN(indirected_size);
+			total += scan[count].definition_size + scan[count].indirected_size;
+			count++;
+		}
+
+		context = next;
+	}
+
+	/* If the scan failed part way through, the templates found so far
+	 * are still loaded, but the preload is reported as incomplete.
+	 */
+
+	scan_failed = (error != NULL) ? TRUE : FALSE;
+
+	if (count == 0) {
+		if (scan != NULL)
+			free(scan);
+
+		return (scan_failed) ? FALSE : TRUE;
+	}
+
+	/* Claim a single block for all of the templates, and an array for
+	 * their cache entries.
+	 */
+
+	block = malloc(total);
+	entries = malloc(count * sizeof(struct templates_cache_entry));
+
+	if (block == NULL || entries == NULL) {
+		if (block != NULL)
+			free(block);
+		if (entries != NULL)
+			free(entries);
+		free(scan);
+
+		return FALSE;
+	}
+
+	/* Load the templates, in file order, into consecutive parts of the block. */
+
+	position = block;
+
+	for (i = 0; i < count; i++) {
+		string_copy(name, pattern, TEMPLATES_NAME_LENGTH);
+
+		entries[loaded].definition = (wimp_window *) position;
+		entries[loaded].definition_size = scan[i].definition_size;
+		entries[loaded].indirected = position + scan[i].definition_size;
+		entries[loaded].indirected_size = scan[i].indirected_size;
+
+		position += scan[i].definition_size + scan[i].indirected_size;
+
+		error = xwimp_load_template(entries[loaded].definition, entries[loaded].indirected,
+				entries[loaded].indirected + entries[loaded].indirected_size,
+				wimp_NO_FONTS, name, scan[i].context, NULL, NULL, &next);
+		if (error != NULL || next == 0)
+			continue;
+
+		string_copy(entries[loaded].name, string_ctrl_zero_terminate(name, TEMPLATES_NAME_LENGTH), TEMPLATES_NAME_LENGTH);
+
+		if (templates_add_cached(&(entries[loaded])))
+			loaded++;
+	}
+
+	free(scan);
+
+	/* The block and entries stay in the cache for the life of the
+	 * application, unless nothing could be loaded at all.
+	 */
+
+	if (loaded == 0) {
+		free(block);
+		free(entries);
+	}
+
+	return (loaded == count && !scan_failed) ? TRUE : FALSE;
+}
+
+
 /**
  * Load the menu file into memory and link in any dialogue boxes.  The
  * templates file must be open when this function is called.
@@ -171,3 +393,179 @@ wimp_menu *templates_get_menu(char *menu)
 	return handle;
 }
 
+
+/**
+ * Find a named window template in the template cache.
+ *
+ * \param *name		The name of the template to find.
+ * \return		Pointer to the cached template, or NULL if not found.
+ */
+
+static struct templates_cache_entry *templates_find_cached(char *name)
+{
+	struct templates_cache_entry	*entry;
+
+	if (name == NULL)
+		return NULL;
+
+	entry = hash_find(templates_cache, hash_string(name));
+
+	while (entry != NULL && strcmp(entry->name, name) != 0)
+		entry = entry->chain;
+
+	return entry;
+}
+
+
+/**
+ * Load a named window template from the current templates file into the
+ * template cache. The definition and its indirected data share a single
+ * block of memory.
+ *
+ * \param *name		The name of the template to load.
+ * \return		Pointer to the cached template, or NULL on failure.
+ */
+
+static struct templates_cache_entry *templates_load_cached(char *name)
+{
+	struct templates_cache_entry	*entry;
+	int				definition_size, indirected_size, context = 0;
+	os_error			*error;
+
+	if (name == NULL)
+		return NULL;
+
+	error = xwimp_load_template(wimp_GET_SIZE, 0, 0, wimp_NO_FONTS, name, 0, &definition_size, &indirected_size, &context);
+	if (error != NULL || context == 0)
+		return NULL;
+
+	definition_size = TEMPLATES_ALIGN(definition_size);
+
+	entry = malloc(sizeof(struct templates_cache_entry) + definition_size + indirected_size);
+	if (entry == NULL)
+		return NULL;
+
+	entry->definition = (wimp_window *) (entry + 1);
+	entry->definition_size = definition_size;
+	entry->indirected = (char *) entry->definition + definition_size;
+	entry->indirected_size = indirected_size;
+
+	context = 0;
+
+	error = xwimp_load_template(entry->definition, entry->indirected, entry->indirected + indirected_size,
+			wimp_NO_FONTS, name, 0, NULL, NULL, &context);
+	if (error != NULL || context == 0) {
+		free(entry);
+		return NULL;
+	}
+
+	string_copy(entry->name, name, TEMPLATES_NAME_LENGTH);
+
+	if (!templates_add_cached(entry)) {
+		free(entry);
+		return NULL;
+	}
+
+	return entry;
+}
+
+
+/**
+ * Add a loaded window template to the template cache index.
+ *
+ * \param *entry	The template to add.
+ * \return		TRUE if successful; else FALSE.
+ */
+
+static osbool templates_add_cached(struct templates_cache_entry *entry)
+{
+	unsigned int	key;
+
+	if (templates_cache == NULL) {
+		templates_cache = hash_create(0);
+		if (templates_cache == NULL)
+			return FALSE;
+	}
+
+	key = hash_string(entry->name);
+	entry->chain = hash_find(templates_cache, key);
+
+	return hash_add(templates_cache, key, entry);
+}
+
+
+/**
+ * Make a copy of a cached window template, with its own copy of the
+ * indirected data. The definition should be freed after use, but the
+ * indirected data must remain for as long as any window created from it.
+ *
+ * \param *entry	The cached template to copy.
+ * \return		Pointer to the new definition, or NULL on failure.
+ */
+
+static wimp_window *templates_copy_cached(struct templates_cache_entry *entry)
+{
+	wimp_window	*definition;
+	char		*indirected = NULL;
+	int		i;
+
+	definition = malloc(entry->definition_size);
+
+	if (entry->indirected_size > 0)
+		indirected = malloc(entry->indirected_size);
+
+	if (definition == NULL || (entry->indirected_size > 0 && indirected == NULL)) {
+		if (definition != NULL)
+			free(definition);
+		if (indirected != NULL)
+			free(indirected);
+
+		return NULL;
+	}
+
+	memcpy(definition, entry->definition, entry->definition_size);
+
+	if (indirected != NULL) {
+		memcpy(indirected, entry->indirected, entry->indirected_size);
+
+		/* Point the copied definition at the copied indirected data. */
+
+		templates_relocate_icon_data(definition->title_flags, &(definition->title_data),
+				entry->indirected, entry->indirected_size, indirected);
+
+		for (i = 0; i < definition->icon_count; i++)
+			templates_relocate_icon_data(definition->icons[i].flags, &(definition->icons[i].data),
+					entry->indirected, entry->indirected_size, indirected);
+	}
+
+	return definition;
+}
+
+
+/**
+ * Update the pointers in an indirected icon's data, so that any which
+ * pointed into one copy of a window's indirected data point to the
+ * same place in another.
+ *
+ * \param flags		The icon's flags.
+ * \param *data		The icon data to be updated.
+ * \param *old_base	The start of the original indirected data.
+ * \param size		The size of the indirected data.
+ * \param *new_base	The start of the new copy of the indirected data.
+ */
+
+static void templates_relocate_icon_data(wimp_icon_flags flags, wimp_icon_data *data, char *old_base, int size, char *new_base)
+{
+	if (!(flags & wimp_ICON_INDIRECTED))
+		return;
+
+	/* The first two words of the data are pointers for text and sprite icons
+	 * alike, but only those falling within the data block need to change.
+	 */
+
+	if (data->indirected_text.text >= old_base && data->indirected_text.text < old_base + size)
+		data->indirected_text.text = new_base + (data->indirected_text.text - old_base);
+
+	if (data->indirected_text.validation >= old_base && data->indirected_text.validation < old_base + size)
+		data->indirected_text.validation = new_base + (data->indirected_text.validation - old_base);
+}
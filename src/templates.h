@@ -67,6 +67,35 @@ wimp_window *templates_load_window(char *name);
 
 wimp_w templates_create_window(char *name);
 
+/**
+ * Create a window from a cached copy of its template. The first time that
+ * a template is used, it is loaded from the current templates file into
+ * the cache; after that, new windows are created from the cached copy
+ * without accessing the file, so the templates file need not remain open.
+ *
+ * \param *name		The name of the window to create.
+ * \return		The window handle if the new window.
+ */
+
+wimp_w templates_create_window_cached(char *name);
+
+
+/**
+ * Preload all of the window templates whose names match a pattern into the
+ * template cache, making a single pass through the current templates file
+ * and storing the templates in one block of memory. Subsequent calls to
+ * templates_load_window(), templates_create_window() and
+ * templates_create_window_cached() for these templates are then satisfied
+ * from memory.
+ *
+ * \param *pattern	The template name to match, which can contain the
+ *			usual Wimp wildcards (eg. "*" for all templates).
+ * \return		TRUE if all the templates were loaded; else FALSE.
+ */
+
+osbool templates_preload(char *pattern);
+
+
 /**
  * Load the menu file into memory and link in any dialogue boxes.  The
  * templates file must be open when this function is called.
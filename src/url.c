@@ -32,6 +32,10 @@
  *  3) If that succeeds, wait for success or failure wimp message
  *  4) If either fails, try ANT URL_Open
  *  5) If that fails, give error message
+ *
+ * Any number of launches can be in progress at once, each tracked by its own
+ * request. The method which worked for each URL scheme is remembered, so that
+ * later launches of the same scheme start from that method.
  */
 
 /* OS-Lib header files. */
@@ -50,16 +54,74 @@
 #include "general.h"
 #include "string.h"
 
+#ifdef __CC_NORCROFT
+#include "strdup.h"
+#endif
+
 /* ANSII C header files. */
 
 #include <string.h>
 #include <stdlib.h>
 
 #define URL_BUFFER_LENGTH 512
+#define URL_SCHEME_LENGTH 16								/**< The maximum length of a remembered URL scheme.			*/
+#define URL_BROADCAST_TIMEOUT 200							/**< The time to wait for an ANT broadcast to bounce, in cs.		*/
+
+/**
+ * The methods which can be used to launch a URL, in the order that they
+ * are tried.
+ */
+
+enum url_method {
+	URL_METHOD_ANT_BROADCAST = 0,							/**< The ANT Open URL broadcast.					*/
+	URL_METHOD_ACORN_URI,								/**< The Acorn URI Handler.						*/
+	URL_METHOD_ANT_LOAD,								/**< The ANT Alias$URLOpen_ system variables.				*/
+	URL_METHOD_NONE									/**< No methods are left to try.					*/
+};
+
+/**
+ * An outstanding URL launch request.
+ */
+
+struct url_request {
+	unsigned int		reference;						/**< The reference returned to the client.				*/
+	char			*url;							/**< The URL being launched.						*/
+	enum url_method		first;							/**< The first method which was tried.					*/
+	enum url_method		method;							/**< The method currently being tried.					*/
+	int			my_ref;							/**< The reference of the ANT broadcast, if in progress.		*/
+	uri_h			uri;							/**< The Acorn URI handle, if in progress.				*/
+	unsigned int		timeout;						/**< The handle of the broadcast timeout callback, or 0.		*/
+
+	void			(*callback)(unsigned int reference, osbool success, void *data);	/**< The client's completion callback, or NULL.	*/
+	void			*data;							/**< Data to pass to the completion callback.				*/
+
+	struct url_request	*next;							/**< The next outstanding request.					*/
+};
+
+/**
+ * The method which last worked for a URL scheme.
+ */
+
+struct url_scheme {
+	char			scheme[URL_SCHEME_LENGTH];				/**< The URL scheme, such as "http".					*/
+	enum url_method		method;							/**< The method which last worked for the scheme.			*/
+
+	struct url_scheme	*next;							/**< The next remembered scheme.					*/
+};
 
-static osbool		url_antbroadcast(const char *url);
+static struct url_request	*url_requests = NULL;					/**< The list of outstanding requests.					*/
+static struct url_scheme	*url_schemes = NULL;					/**< The list of remembered schemes.					*/
+static unsigned int		url_next_reference = 1;					/**< The next request reference to be allocated.			*/
+
+
+static void		url_try_method(struct url_request *request, enum url_method method);
+static enum url_method	url_get_next_method(struct url_request *request);
+static osbool		url_antbroadcast(struct url_request *request);
 static osbool		url_antload(const char *url);
-static osbool		url_acornlaunch(const char *url);
+static osbool		url_acornlaunch(struct url_request *request);
+static void		url_complete(struct url_request *request, osbool success);
+static struct url_scheme	*url_find_scheme(const char *url, osbool create);
+static osbool		url_broadcast_timeout(os_t time, void *data);
 static osbool		url_bounce(wimp_message *mess);
 
 
@@ -89,37 +151,176 @@ osbool url_initialise(void)
 
 void url_launch(const char *url)
 {
-	if (!url_antbroadcast(url))
+	if (url_launch_request(url, NULL, NULL) == 0)
 		error_msgs_report_info("URLFailed:Failed to launch URL.");
 }
 
 
+/* Start to launch a URL, reporting the outcome to a callback.
+ *
+ * This function is an external interface, documented in url.h.
+ */
+
+unsigned int url_launch_request(const char *url, void (*callback)(unsigned int reference, osbool success, void *data), void *data)
+{
+	struct url_request	*request;
+	struct url_scheme	*scheme;
+	unsigned int		reference;
+
+	if (url == NULL)
+		return 0;
+
+	request = malloc(sizeof(struct url_request));
+	if (request == NULL)
+		return 0;
+
+	request->url = strdup(url);
+	if (request->url == NULL) {
+		free(request);
+		return 0;
+	}
+
+	request->reference = url_next_reference++;
+	if (url_next_reference == 0)
+		url_next_reference = 1;
+
+	request->first = URL_METHOD_ANT_BROADCAST;
+	request->method = URL_METHOD_NONE;
+	request->my_ref = 0;
+	request->uri = 0;
+	request->timeout = 0;
+	request->callback = callback;
+	request->data = data;
+
+	request->next = url_requests;
+	url_requests = request;
+
+	/* Start from the method which last worked for this scheme, if known. */
+
+	scheme = url_find_scheme(url, FALSE);
+	request->first = (scheme != NULL) ? scheme->method : URL_METHOD_ANT_BROADCAST;
+
+	reference = request->reference;
+
+	url_try_method(request, request->first);
+
+	return reference;
+}
+
+
 /**
- * Launch a URL via the ANT broadcast protocol.
+ * Try to launch a request's URL, starting with a given method and moving on
+ * through the others until one is under way or all have been tried.
  *
- * \param *url		The URL to broadcast.
- * \return		TRUE if the broadcast was sent; else FALSE.
+ * \param *request	The request to be launched.
+ * \param method	The first method to try.
+ */
+
+static void url_try_method(struct url_request *request, enum url_method method)
+{
+	osbool	started = FALSE;
+
+	request->my_ref = 0;
+	request->uri = 0;
+
+	while (!started && method != URL_METHOD_NONE) {
+		request->method = method;
+
+		switch (method) {
+		case URL_METHOD_ANT_BROADCAST:
+			started = url_antbroadcast(request);
+			break;
+
+		case URL_METHOD_ACORN_URI:
+			started = url_acornlaunch(request);
+			break;
+
+		case URL_METHOD_ANT_LOAD:
+			/* The load is complete as soon as the task has started. */
+
+			if (url_antload(request->url)) {
+				url_complete(request, TRUE);
+				return;
+			}
+			break;
+
+		case URL_METHOD_NONE:
+			break;
+		}
+
+		if (!started)
+			method = url_get_next_method(request);
+	}
+
+	if (!started)
+		url_complete(request, FALSE);
+}
+
+
+/**
+ * Find the next method to try for a request, after the current one. The
+ * methods are tried in order, wrapping round to the start if the request
+ * didn't start with the first method, until all have been tried.
+ *
+ * \param *request	The request of interest.
+ * \return		The next method to try, or URL_METHOD_NONE.
  */
 
-static osbool url_antbroadcast(const char *url)
+static enum url_method url_get_next_method(struct url_request *request)
+{
+	enum url_method		next;
+
+	next = request->method + 1;
+
+	if (next == URL_METHOD_NONE)
+		next = URL_METHOD_ANT_BROADCAST;
+
+	return (next == request->first) ? URL_METHOD_NONE : next;
+}
+
+
+/**
+ * Launch a URL via the ANT broadcast protocol. If nobody bounces the
+ * message within the timeout, the launch is treated as successful.
+ *
+ * \param *request	The request to broadcast.
+ * \return		TRUE if the broadcast was sent and its timeout set
+ *			up; else FALSE.
+ */
+
+static osbool url_antbroadcast(struct url_request *request)
 {
 	url_message  urlblock;
 	os_error     *error;
 
 
-	urlblock.size = WORDALIGN(20 + strlen(url) + 1);
+	if (strlen(request->url) >= sizeof(urlblock.data.url))
+		return FALSE;
+
+	urlblock.size = WORDALIGN(20 + strlen(request->url) + 1);
 	urlblock.your_ref = 0;
 	urlblock.action = message_ANT_OPEN_URL;
 
 	*urlblock.data.url = 0;
-	strncat(urlblock.data.url, url, sizeof(urlblock.data.url) - 1);
+	strncat(urlblock.data.url, request->url, sizeof(urlblock.data.url) - 1);
+
+	/* Set up the timeout first, as nothing would ever complete the
+	 * request if the broadcast was sent without one.
+	 */
+
+	request->timeout = event_add_callback(NULL, URL_BROADCAST_TIMEOUT, 0, url_broadcast_timeout, request);
+	if (request->timeout == 0)
+		return FALSE;
 
 	error = xwimp_send_message(wimp_USER_MESSAGE_RECORDED, (wimp_message *) &urlblock, wimp_BROADCAST);
 	if (error != NULL) {
-		error_report_os_error(error, wimp_ERROR_BOX_CANCEL_ICON);
+		event_cancel_callback(request->timeout);
+		request->timeout = 0;
 		return FALSE;
 	}
 
+	request->my_ref = urlblock.my_ref;
+
 	return TRUE;
 }
 
@@ -168,33 +369,143 @@ static osbool url_antload(const char *url)
 
 
 /**
- * Launch a URL via the Acorn URI protocol.
+ * Launch a URL via the Acorn URI protocol, asking to be informed of the
+ * result.
  *
- * \param *url		The URL to broadcast.
- * \return		TRUE if successful; else FALSE.
+ * \param *request	The request to dispatch.
+ * \return		TRUE if the dispatch is in progress; else FALSE.
  */
 
-static osbool url_acornlaunch(const char *url)
+static osbool url_acornlaunch(struct url_request *request)
 {
 	wimp_t			taskhan = 0;
-	osbool			success = TRUE;
 	uri_dispatch_flags	flags;
+	uri_h			handle;
 
 
 	if (xwimpreadsysinfo_task (&taskhan, NULL) != NULL)
-		success = FALSE;
+		return FALSE;
 
-	if (success)
-		if (xuri_dispatch (uri_DISPATCH_INFORM_CALLER, url, taskhan, &flags, NULL, NULL) != NULL || flags & 1)
-			success = FALSE;
+	if (xuri_dispatch (uri_DISPATCH_INFORM_CALLER, request->url, taskhan, &flags, NULL, &handle) != NULL || flags & 1)
+		return FALSE;
 
-	if (!success)
-		url_antload(url);
+	request->uri = handle;
 
 	return TRUE;
 }
 
 
+/**
+ * Complete a request, remembering the successful method for the URL's
+ * scheme, calling the client and freeing the request.
+ *
+ * \param *request	The request to complete.
+ * \param success	TRUE if the URL was launched; else FALSE.
+ */
+
+static void url_complete(struct url_request *request, osbool success)
+{
+	struct url_request	*parent;
+	struct url_scheme	*scheme;
+
+	if (request == NULL)
+		return;
+
+	if (request->timeout != 0)
+		event_cancel_callback(request->timeout);
+
+	if (success) {
+		scheme = url_find_scheme(request->url, TRUE);
+		if (scheme != NULL)
+			scheme->method = request->method;
+	}
+
+	/* Unlink the request, then tell the client. */
+
+	if (url_requests == request) {
+		url_requests = request->next;
+	} else {
+		for (parent = url_requests; parent != NULL && parent->next != request; parent = parent->next);
+
+		if (parent != NULL)
+			parent->next = request->next;
+	}
+
+	if (request->callback != NULL)
+		request->callback(request->reference, success, request->data);
+	else if (!success)
+		error_msgs_report_info("URLFailed:Failed to launch URL.");
+
+	free(request->url);
+	free(request);
+}
+
+
+/**
+ * Find the record for a URL's scheme.
+ *
+ * \param *url		The URL whose scheme is to be found.
+ * \param create	TRUE to create a new record if there isn't one.
+ * \return		The scheme record, or NULL if not found.
+ */
+
+static struct url_scheme *url_find_scheme(const char *url, osbool create)
+{
+	struct url_scheme	*scheme;
+	char			*end;
+	size_t			length;
+
+	end = strchr(url, ':');
+	if (end == NULL)
+		return NULL;
+
+	length = end - url;
+	if (length == 0 || length >= URL_SCHEME_LENGTH)
+		return NULL;
+
+	for (scheme = url_schemes; scheme != NULL; scheme = scheme->next) {
+		if (strlen(scheme->scheme) == length && strncmp(scheme->scheme, url, length) == 0)
+			return scheme;
+	}
+
+	if (!create)
+		return NULL;
+
+	scheme = malloc(sizeof(struct url_scheme));
+	if (scheme == NULL)
+		return NULL;
+
+	memcpy(scheme->scheme, url, length);
+	scheme->scheme[length] = '\0';
+	scheme->method = URL_METHOD_ANT_BROADCAST;
+
+	scheme->next = url_schemes;
+	url_schemes = scheme;
+
+	return scheme;
+}
+
+
+/**
+ * Callback for the end of the ANT broadcast timeout: if the broadcast hasn't
+ * bounced by now, it has been claimed.
+ *
+ * \param time		The current time.
+ * \param *data		The request whose broadcast has timed out.
+ * \return		FALSE, as the callback doesn't claim a Null Poll.
+ */
+
+static osbool url_broadcast_timeout(os_t time, void *data)
+{
+	struct url_request	*request = data;
+
+	request->timeout = 0;
+	url_complete(request, TRUE);
+
+	return FALSE;
+}
+
+
 /**
  * Message handler for user messages and bounces.
  *
@@ -204,36 +515,47 @@ static osbool url_acornlaunch(const char *url)
 
 static osbool url_bounce(wimp_message *mess)
 {
-	char		buf[URL_BUFFER_LENGTH];
-	os_error	*error;
+	struct url_request	*request;
 
 
 	if (mess->action == message_URI_RETURN_RESULT) {
 		uri_full_message_return_result *result = (uri_full_message_return_result *) mess;
 
-		if ((result->flags & uri_RETURN_RESULT_NOT_CLAIMED) == 0)
-			return TRUE; /* url was claimed */
-
-		/* failed AcornURI. Try ANT launch */
-		error = xuri_request_uri(0, buf, URL_BUFFER_LENGTH, result->handle, NULL);
-
-		if (error) {
-			error_report_os_error(error, wimp_ERROR_BOX_CANCEL_ICON);
-			return TRUE;
+		for (request = url_requests; request != NULL; request = request->next) {
+			if (request->method == URL_METHOD_ACORN_URI && request->uri == result->handle)
+				break;
 		}
 
-		if (!url_antload(buf))
-			error_msgs_report_info("URLFailed:Failed to launch URL.");
+		if (request == NULL)
+			return FALSE;
 
-		/* we haven't acknowledged the returnresult message, so the URI
-		 * handler task will automatically free the URI */
+		/* If the URI was claimed, the launch has succeeded; else try the
+		 * ANT launch. We haven't acknowledged the returnresult message, so
+		 * the URI handler task will automatically free the URI.
+		 */
+
+		if ((result->flags & uri_RETURN_RESULT_NOT_CLAIMED) == 0)
+			url_complete(request, TRUE);
+		else
+			url_try_method(request, url_get_next_method(request));
 
 	} else if (mess->action == message_ANT_OPEN_URL) {
-		url_message *failed = (url_message *) mess;
+		for (request = url_requests; request != NULL; request = request->next) {
+			if (request->method == URL_METHOD_ANT_BROADCAST && request->my_ref == mess->my_ref)
+				break;
+		}
+
+		if (request == NULL)
+			return FALSE;
 
-		/* otherwise, it was an ANT url broadcast that failed - try Acorn broadcast/launch */
+		/* The ANT url broadcast failed - try Acorn broadcast/launch. */
+
+		if (request->timeout != 0) {
+			event_cancel_callback(request->timeout);
+			request->timeout = 0;
+		}
 
-		url_acornlaunch(failed->data.url);
+		url_try_method(request, url_get_next_method(request));
 	}
 
 	return TRUE;
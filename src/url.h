@@ -32,6 +32,10 @@
  *  3) If that succeeds, wait for success or failure wimp message
  *  4) If either fails, try ANT URL_Open
  *  5) If that fails, give error message
+ *
+ * Any number of launches can be in progress at once, each tracked by its own
+ * request. The method which worked for each URL scheme is remembered, so that
+ * later launches of the same scheme start from that method.
  */
 
 #ifndef SFLIB_URL
@@ -93,4 +97,25 @@ osbool url_initialise(void);
 
 void url_launch(const char *url);
 
+
+/**
+ * Start to launch a URL, trying each method in turn without waiting, and
+ * report the outcome to a callback once the launch has succeeded or all
+ * of the methods have failed. The callback can be made before this call
+ * returns, if the outcome is known immediately.
+ *
+ * A broadcast which doesn't bounce within two seconds is taken as having
+ * succeeded, so the application must be receiving Null Events for the
+ * event library's callbacks.
+ *
+ * \param *url		The URL to launch.
+ * \param *callback	The function to call with the outcome, or NULL to
+ *			report a failure to the user with the URLFailed token.
+ * \param *data		Data to pass to the callback function.
+ * \return		A non-zero reference for the request, which will be
+ *			passed to the callback; or 0 if it failed to start.
+ */
+
+unsigned int url_launch_request(const char *url, void (*callback)(unsigned int reference, osbool success, void *data), void *data);
+
 #endif
@@ -36,6 +36,7 @@
 /* SF-Lib header files. */
 
 #include "general.h"
+#include "hash.h"
 #include "msgs.h"
 #include "string.h"
 #include "windows.h"
@@ -47,6 +48,29 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define WINDOWS_REDRAW_BOXES 8							/**< The maximum number of separate invalid boxes held for a window.		*/
+
+/**
+ * The invalid areas of a window, which are waiting to be redrawn.
+ */
+
+struct windows_pending {
+	wimp_w			w;						/**< The window to be redrawn.							*/
+	osbool			all;						/**< TRUE if the whole visible area is to be redrawn.				*/
+	int			count;						/**< The number of invalid boxes.						*/
+	os_box			boxes[WINDOWS_REDRAW_BOXES];			/**< The invalid boxes, in work area coordinates.				*/
+
+	struct windows_pending	*next;						/**< The next window waiting to be redrawn.					*/
+};
+
+static struct hash_table	*windows_pending_index = NULL;			/**< The windows waiting to be redrawn, indexed by window handle.		*/
+static struct windows_pending	*windows_pending_list = NULL;			/**< The list of windows waiting to be redrawn.					*/
+
+
+static struct windows_pending	*windows_find_pending(wimp_w w);
+static int			windows_get_box_growth(os_box *box, os_box *add);
+static void			windows_merge_box(os_box *box, os_box *add);
+
 
 /* Open a window at the top of the window stack.
  *
@@ -556,6 +580,238 @@ void windows_redraw(wimp_w w)
 }
 
 
+/* Schedule the redraw of the visible parts of a window when the pending
+ * redraws are next flushed.
+ *
+ * This is an external interface, documented in windows.h
+ */
+
+osbool windows_schedule_redraw(wimp_w w)
+{
+	struct windows_pending	*pending;
+
+	pending = windows_find_pending(w);
+	if (pending == NULL) {
+		windows_redraw(w);
+		return FALSE;
+	}
+
+	pending->all = TRUE;
+	pending->count = 0;
+
+	return TRUE;
+}
+
+
+/* Schedule the redraw of part of a window's work area when the pending
+ * redraws are next flushed.
+ *
+ * This is an external interface, documented in windows.h
+ */
+
+osbool windows_schedule_redraw_box(wimp_w w, int x0, int y0, int x1, int y1)
+{
+	struct windows_pending	*pending;
+	os_box			box;
+	int			i, best, growth, best_growth;
+
+	if (x1 <= x0 || y1 <= y0)
+		return TRUE;
+
+	pending = windows_find_pending(w);
+	if (pending == NULL) {
+		wimp_force_redraw(w, x0, y0, x1, y1);
+		return FALSE;
+	}
+
+	if (pending->all)
+		return TRUE;
+
+	box.x0 = x0;
+	box.y0 = y0;
+	box.x1 = x1;
+	box.y1 = y1;
+
+	/* Absorb any existing boxes which overlap or touch the new one, repeating
+	 * until none are left, as each merge can bring in more boxes.
+	 */
+
+	i = 0;
+
+	while (i < pending->count) {
+		if (pending->boxes[i].x0 <= box.x1 && pending->boxes[i].x1 >= box.x0 &&
+				pending->boxes[i].y0 <= box.y1 && pending->boxes[i].y1 >= box.y0) {
+			windows_merge_box(&box, pending->boxes + i);
+			pending->boxes[i] = pending->boxes[--pending->count];
+			i = 0;
+		} else {
+			i++;
+		}
+	}
+
+	/* Add the box if there's room; otherwise merge it with the box that
+	 * grows the least as a result.
+	 */
+
+	if (pending->count < WINDOWS_REDRAW_BOXES) {
+		pending->boxes[pending->count++] = box;
+		return TRUE;
+	}
+
+	best = 0;
+	best_growth = windows_get_box_growth(pending->boxes, &box);
+
+	for (i = 1; i < pending->count; i++) {
+		growth = windows_get_box_growth(pending->boxes + i, &box);
+
+		if (growth < best_growth) {
+			best = i;
+			best_growth = growth;
+		}
+	}
+
+	windows_merge_box(pending->boxes + best, &box);
+
+	return TRUE;
+}
+
+
+/* Redraw all of the areas which have been scheduled for redraw since the
+ * last flush.
+ *
+ * This is an external interface, documented in windows.h
+ */
+
+void windows_flush_redraws(void)
+{
+	struct windows_pending	*pending;
+	wimp_window_state	window;
+	int			i;
+
+	while (windows_pending_list != NULL) {
+		pending = windows_pending_list;
+		windows_pending_list = pending->next;
+
+		hash_remove(windows_pending_index, (unsigned int) pending->w);
+
+		if (pending->all) {
+			window.w = pending->w;
+
+			if (xwimp_get_window_state(&window) == NULL)
+				xwimp_force_redraw(pending->w, window.xscroll, window.yscroll - (window.visible.y1 - window.visible.y0),
+						window.xscroll + (window.visible.x1 - window.visible.x0), window.yscroll);
+		} else {
+			for (i = 0; i < pending->count; i++)
+				xwimp_force_redraw(pending->w, pending->boxes[i].x0, pending->boxes[i].y0,
+						pending->boxes[i].x1, pending->boxes[i].y1);
+		}
+
+		free(pending);
+	}
+}
+
+
+/* Discard any scheduled redraws for a window.
+ *
+ * This is an external interface, documented in windows.h
+ */
+
+void windows_cancel_redraws(wimp_w w)
+{
+	struct windows_pending	*pending, *parent;
+
+	pending = hash_remove(windows_pending_index, (unsigned int) w);
+	if (pending == NULL)
+		return;
+
+	if (windows_pending_list == pending) {
+		windows_pending_list = pending->next;
+	} else {
+		for (parent = windows_pending_list; parent != NULL && parent->next != pending; parent = parent->next);
+
+		if (parent != NULL)
+			parent->next = pending->next;
+	}
+
+	free(pending);
+}
+
+
+/* Run the Wimp redraw loop for a window, passing each clip rectangle to
+ * a client callback in work area coordinates.
+ *
+ * This is an external interface, documented in windows.h
+ */
+
+void windows_process_redraw(wimp_draw *redraw, void (*callback)(struct windows_redraw *area, void *data), void *data)
+{
+	struct windows_redraw	area;
+	osbool			more;
+
+	if (redraw == NULL)
+		return;
+
+	area.redraw = redraw;
+
+	more = wimp_redraw_window(redraw);
+
+	/* The work area origin only changes between redraws, so it can be
+	 * found once, before the loop starts.
+	 */
+
+	area.ox = redraw->box.x0 - redraw->xscroll;
+	area.oy = redraw->box.y1 - redraw->yscroll;
+
+	while (more) {
+		area.clip.x0 = redraw->clip.x0 - area.ox;
+		area.clip.y0 = redraw->clip.y0 - area.oy;
+		area.clip.x1 = redraw->clip.x1 - area.ox;
+		area.clip.y1 = redraw->clip.y1 - area.oy;
+
+		if (callback != NULL)
+			callback(&area, data);
+
+		more = wimp_get_rectangle(redraw);
+	}
+}
+
+
+/* Find the rows of a list-style window which fall inside the current
+ * redraw clip rectangle.
+ *
+ * This is an external interface, documented in windows.h
+ */
+
+osbool windows_get_redraw_rows(struct windows_redraw *area, int top, int height, int rows, int *first, int *last)
+{
+	int	from, to;
+
+	if (area == NULL || height <= 0 || rows <= 0)
+		return FALSE;
+
+	/* Row n occupies the work area from top - (n + 1) * height up to
+	 * top - n * height; find the rows covering the clip rectangle.
+	 */
+
+	if (area->clip.y1 <= top - (rows * height) || area->clip.y0 >= top)
+		return FALSE;
+
+	from = (area->clip.y1 >= top) ? 0 : (top - area->clip.y1) / height;
+	to = (top - area->clip.y0 - 1) / height;
+
+	if (to >= rows)
+		to = rows - 1;
+
+	if (first != NULL)
+		*first = from;
+
+	if (last != NULL)
+		*last = to;
+
+	return TRUE;
+}
+
+
 /* Load a window template into memory from the currently open template file,
  * storing the details in a newly malloc()'d block.  The block should be released
  * after use with free() if no longer required.
@@ -602,3 +858,94 @@ wimp_window *windows_load_template(char *name)
 
 	return window_def;
 }
+
+
+/**
+ * Find the pending redraw record for a window, creating a new one if
+ * there isn't one already.
+ *
+ * \param w			The window of interest.
+ * \return			The pending redraw record, or NULL on failure.
+ */
+
+static struct windows_pending *windows_find_pending(wimp_w w)
+{
+	struct windows_pending	*pending;
+
+	if (w == NULL)
+		return NULL;
+
+	pending = hash_find(windows_pending_index, (unsigned int) w);
+	if (pending != NULL)
+		return pending;
+
+	if (windows_pending_index == NULL) {
+		windows_pending_index = hash_create(0);
+		if (windows_pending_index == NULL)
+			return NULL;
+	}
+
+	pending = malloc(sizeof(struct windows_pending));
+	if (pending == NULL)
+		return NULL;
+
+	pending->w = w;
+	pending->all = FALSE;
+	pending->count = 0;
+
+	if (!hash_add(windows_pending_index, (unsigned int) w, pending)) {
+		free(pending);
+		return NULL;
+	}
+
+	pending->next = windows_pending_list;
+	windows_pending_list = pending;
+
+	return pending;
+}
+
+
+/**
+ * Calculate how much the area of a box would grow if another box were to
+ * be merged into it. The result is in units of 16 square OS units, to keep
+ * the values for large work areas within range.
+ *
+ * \param *box			The box to be grown.
+ * \param *add			The box to be merged in.
+ * \return			The growth in area.
+ */
+
+static int windows_get_box_growth(os_box *box, os_box *add)
+{
+	os_box	merged;
+
+	merged = *box;
+	windows_merge_box(&merged, add);
+
+	return (((merged.x1 - merged.x0) / 4) * ((merged.y1 - merged.y0) / 4)) -
+			(((box->x1 - box->x0) / 4) * ((box->y1 - box->y0) / 4));
+}
+
+
+/**
+ * Merge one box into another, so that the first becomes the bounding box
+ * of the two.
+ *
+ * \param *box			The box to be grown.
+ * \param *add			The box to be merged in.
+ */
+
+static void windows_merge_box(os_box *box, os_box *add)
+{
+	if (add->x0 < box->x0)
+		box->x0 = add->x0;
+
+	if (add->y0 < box->y0)
+		box->y0 = add->y0;
+
+	if (add->x1 > box->x1)
+		box->x1 = add->x1;
+
+	if (add->y1 > box->y1)
+		box->y1 = add->y1;
+}
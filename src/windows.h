@@ -41,6 +41,19 @@
 #define sf_PANE_ICON_OFFSET 8							/**< The inset in OS units used when placing a pane in a window icon.		*/
 
 
+/**
+ * Details of a redraw rectangle, passed to windows_process_redraw()
+ * callbacks.
+ */
+
+struct windows_redraw {
+	wimp_draw	*redraw;						/**< The Wimp redraw block.							*/
+	int		ox;							/**< The screen X coordinate of the work area origin.				*/
+	int		oy;							/**< The screen Y coordinate of the work area origin.				*/
+	os_box		clip;							/**< The clip rectangle, in work area coordinates.				*/
+};
+
+
 /**
  * Open a window at the top of the window stack.
  *
@@ -272,6 +285,88 @@ void windows_place_in_icon(wimp_window *parent, wimp_window *pane, int icon, int
 void windows_redraw(wimp_w w);
 
 
+/**
+ * Schedule the redraw of the visible parts of a window, to take place when
+ * windows_flush_redraws() is next called. This happens automatically each
+ * time that event_process_event() handles an event.
+ *
+ * \param w		The window to redraw.
+ * \return		TRUE if the redraw was scheduled; FALSE if there was
+ *			no memory, and the window was redrawn immediately.
+ */
+
+osbool windows_schedule_redraw(wimp_w w);
+
+
+/**
+ * Schedule the redraw of part of a window's work area, to take place when
+ * windows_flush_redraws() is next called. Overlapping areas are merged, so
+ * bursts of updates result in as few redraws as possible.
+ *
+ * \param w		The window to redraw.
+ * \param x0		The minimum X work area coordinate to redraw.
+ * \param y0		The minimum Y work area coordinate to redraw.
+ * \param x1		The maximum X work area coordinate to redraw.
+ * \param y1		The maximum Y work area coordinate to redraw.
+ * \return		TRUE if the redraw was scheduled; FALSE if there was
+ *			no memory, and the area was redrawn immediately.
+ */
+
+osbool windows_schedule_redraw_box(wimp_w w, int x0, int y0, int x1, int y1);
+
+
+/**
+ * Force the redraw of all of the areas which have been scheduled for
+ * redraw since the last flush.
+ */
+
+void windows_flush_redraws(void);
+
+
+/**
+ * Discard any scheduled redraws for a window, such as when it is about to
+ * be deleted. This is called automatically by event_delete_window().
+ *
+ * \param w		The window whose redraws are to be discarded.
+ */
+
+void windows_cancel_redraws(wimp_w w);
+
+
+/**
+ * Run the Wimp redraw loop for a window, calling Wimp_RedrawWindow and
+ * Wimp_GetRectangle and passing each clip rectangle to a callback in work
+ * area coordinates so that only the visible items need to be plotted.
+ * This can be called from a handler registered with
+ * event_add_window_redraw_event().
+ *
+ * \param *redraw	The redraw block from the Redraw_Window_Request.
+ * \param *callback	The function to call for each rectangle; it should
+ *			add area->ox and area->oy to work area coordinates
+ *			to find the screen coordinates to plot at.
+ * \param *data		Data to pass to the callback function.
+ */
+
+void windows_process_redraw(wimp_draw *redraw, void (*callback)(struct windows_redraw *area, void *data), void *data);
+
+
+/**
+ * Find the rows of a list-style window which fall inside the current
+ * redraw clip rectangle, where the rows run down from a given work area
+ * Y coordinate and are all the same height.
+ *
+ * \param *area		The redraw rectangle details.
+ * \param top		The work area Y coordinate of the top of the first row.
+ * \param height	The height of each row, in OS units.
+ * \param rows		The total number of rows.
+ * \param *first	Pointer to a variable to take the first visible row.
+ * \param *last		Pointer to a variable to take the last visible row.
+ * \return		TRUE if any rows are visible; FALSE if none.
+ */
+
+osbool windows_get_redraw_rows(struct windows_redraw *area, int top, int height, int rows, int *first, int *last);
+
+
 /**
  * Load a window template into memory from the currently open template file,
  * storing the details in a newly malloc()'d block.  The block should be released